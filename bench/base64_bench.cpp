@@ -0,0 +1,48 @@
+#include "benchmark.h"
+#include "encode/base64.h"
+
+#include <random>
+
+using namespace terra;
+
+namespace
+{
+	std::vector<uint8_t> MakePayload(int64_t size)
+	{
+		std::mt19937 rng(12345);
+		std::vector<uint8_t> payload(static_cast<size_t>(size));
+		for (auto& byte : payload)
+		{
+			byte = static_cast<uint8_t>(rng());
+		}
+		return payload;
+	}
+}
+
+/** Encodes range(0) random bytes, items are input bytes. */
+void BM_Base64_Encode(bench::State& state)
+{
+	const std::vector<uint8_t> payload = MakePayload(state.range(0));
+	size_t length = 0;
+	while (state.KeepRunning())
+	{
+		length += Base64Encoding::Encode(payload).size();
+	}
+	bench::DoNotOptimize(length);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+CETUS_BENCHMARK(BM_Base64_Encode)->Arg(16)->Arg(1024)->Arg(65536);
+
+/** Decodes the encoding of range(0) random bytes, items are output bytes. */
+void BM_Base64_Decode(bench::State& state)
+{
+	const std::string encoded = Base64Encoding::Encode(MakePayload(state.range(0)));
+	std::vector<uint8_t> decoded;
+	while (state.KeepRunning())
+	{
+		Base64Encoding::Decode(encoded, decoded);
+	}
+	bench::DoNotOptimize(decoded.data());
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+CETUS_BENCHMARK(BM_Base64_Decode)->Arg(16)->Arg(1024)->Arg(65536);
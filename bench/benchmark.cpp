@@ -0,0 +1,402 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <new>
+#include <thread>
+
+using namespace terra;
+using namespace terra::bench;
+
+namespace
+{
+	std::atomic<int64_t> GAllocationCount{ 0 };
+}
+
+// Count every heap allocation of the process, so benchmarks can show allocation free paths stay that way.
+// The array and nothrow forms end up here too.
+void* operator new(size_t size)
+{
+	GAllocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void* ptr = std::malloc(size ? size : 1))
+	{
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+int64_t terra::bench::GetAllocationCount()
+{
+	return GAllocationCount.load(std::memory_order_relaxed);
+}
+
+namespace
+{
+	std::vector<std::unique_ptr<Benchmark>>& GetRegistry()
+	{
+		static std::vector<std::unique_ptr<Benchmark>> registry;
+		return registry;
+	}
+
+	std::string MakeRunName(const Benchmark& benchmark, const std::vector<int64_t>& args)
+	{
+		std::string name = benchmark.GetName();
+		for (auto arg : args)
+		{
+			name += "/" + std::to_string(arg);
+		}
+		return name;
+	}
+
+	struct RunOptions
+	{
+		std::string filter;
+		/** Grow the iteration count until a run takes at least this long, like google benchmark does */
+		double min_time_s{ 0.5 };
+		int repetitions{ 1 };
+		bool json_to_stdout{ false };
+		/** Also write the json report to this file when not empty */
+		std::string out_path;
+	};
+
+	struct RunResult
+	{
+		std::string name;
+		/** Aggregates of repeated runs are named after the run with a _mean, _median or _stddev suffix */
+		std::string aggregate_name;
+		int repetition_index{ 0 };
+		int64_t iterations{ 0 };
+		double ns_per_iter{ 0 };
+		/** 0 when the benchmark doesn't report items */
+		double items_per_second{ 0 };
+		double allocs_per_iter{ 0 };
+		std::string label;
+	};
+
+	constexpr int64_t kMaxIterations = 1000000000;
+
+	RunResult RunOne(const Benchmark& benchmark, const std::vector<int64_t>& args, const RunOptions& options)
+	{
+		int64_t iterations = 1;
+		while (true)
+		{
+			State state(iterations, args);
+			benchmark.GetFunction()(state);
+
+			const double elapsed = state.GetElapsedSeconds();
+			if (elapsed >= options.min_time_s || iterations >= kMaxIterations)
+			{
+				RunResult result;
+				result.name = MakeRunName(benchmark, args);
+				result.iterations = iterations;
+				result.ns_per_iter = elapsed * 1e9 / iterations;
+				if (state.GetItemsProcessed() > 0 && elapsed > 0)
+				{
+					result.items_per_second = state.GetItemsProcessed() / elapsed;
+				}
+				result.allocs_per_iter = static_cast<double>(state.GetAllocations()) / iterations;
+				result.label = state.GetLabel();
+				return result;
+			}
+
+			// predict the count needed to hit the min time, but never grow by more than 10x per round
+			const double multiplier = elapsed > 0 ? options.min_time_s * 1.4 / elapsed : 10.0;
+			const int64_t next = static_cast<int64_t>(iterations * std::min(multiplier, 10.0));
+			iterations = std::min(std::max(next, iterations + 1), kMaxIterations);
+		}
+	}
+
+	/** Mean, median and stddev of the repetitions of one run. */
+	void AddAggregates(const std::vector<RunResult>& runs, std::vector<RunResult>& out_results)
+	{
+		std::vector<double> times;
+		double sum = 0;
+		for (const auto& run : runs)
+		{
+			times.push_back(run.ns_per_iter);
+			sum += run.ns_per_iter;
+		}
+		std::sort(times.begin(), times.end());
+		const double mean = sum / times.size();
+		const double median = times.size() % 2 ? times[times.size() / 2] : (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+		double variance = 0;
+		for (double time : times)
+		{
+			variance += (time - mean) * (time - mean);
+		}
+		const double stddev = times.size() > 1 ? std::sqrt(variance / (times.size() - 1)) : 0.0;
+
+		const std::pair<const char*, double> aggregates[] = { { "mean", mean }, { "median", median }, { "stddev", stddev } };
+		for (const auto& aggregate : aggregates)
+		{
+			RunResult result = runs.front();
+			result.aggregate_name = aggregate.first;
+			result.ns_per_iter = aggregate.second;
+			// only the time is aggregated
+			result.items_per_second = 0;
+			result.label.clear();
+			out_results.push_back(result);
+		}
+	}
+
+	std::string GetDisplayName(const RunResult& result)
+	{
+		return result.aggregate_name.empty() ? result.name : result.name + "_" + result.aggregate_name;
+	}
+
+	void PrintConsoleHeader()
+	{
+		std::printf("%-72s %17s %12s\n", "Benchmark", "Time", "Iterations");
+	}
+
+	void PrintConsoleResult(const RunResult& result)
+	{
+		std::printf("%-72s %14.1f ns %12lld", GetDisplayName(result).c_str(), result.ns_per_iter, static_cast<long long>(result.iterations));
+		if (result.items_per_second > 0)
+		{
+			std::printf(" %12.3fM items/s", result.items_per_second / 1e6);
+		}
+		std::printf(" %10.3f allocs/iter", result.allocs_per_iter);
+		if (!result.label.empty())
+		{
+			std::printf(" %s", result.label.c_str());
+		}
+		std::printf("\n");
+		std::fflush(stdout);
+	}
+
+	std::string EscapeJson(const std::string& text)
+	{
+		std::string escaped;
+		escaped.reserve(text.size());
+		for (char c : text)
+		{
+			switch (c)
+			{
+			case '"': escaped += "\\\""; break;
+			case '\\': escaped += "\\\\"; break;
+			case '\n': escaped += "\\n"; break;
+			case '\t': escaped += "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20)
+				{
+					char code[8];
+					std::snprintf(code, sizeof(code), "\\u%04x", c);
+					escaped += code;
+				}
+				else
+				{
+					escaped += c;
+				}
+			}
+		}
+		return escaped;
+	}
+
+	/** Same layout as google benchmark's json reporter, so its compare tooling can diff two reports. */
+	void WriteJson(FILE* file, const std::vector<RunResult>& results)
+	{
+		char date[64] = "";
+		const std::time_t now = std::time(nullptr);
+		std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+		std::fprintf(file, "{\n  \"context\": {\n");
+		std::fprintf(file, "    \"date\": \"%s\",\n", date);
+		std::fprintf(file, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+#ifdef NDEBUG
+		std::fprintf(file, "    \"library_build_type\": \"release\"\n");
+#else
+		std::fprintf(file, "    \"library_build_type\": \"debug\"\n");
+#endif
+		std::fprintf(file, "  },\n  \"benchmarks\": [");
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const RunResult& result = results[i];
+			std::fprintf(file, "%s\n    {\n", i == 0 ? "" : ",");
+			std::fprintf(file, "      \"name\": \"%s\",\n", EscapeJson(GetDisplayName(result)).c_str());
+			std::fprintf(file, "      \"run_name\": \"%s\",\n", EscapeJson(result.name).c_str());
+			if (result.aggregate_name.empty())
+			{
+				std::fprintf(file, "      \"run_type\": \"iteration\",\n");
+				std::fprintf(file, "      \"repetition_index\": %d,\n", result.repetition_index);
+			}
+			else
+			{
+				std::fprintf(file, "      \"run_type\": \"aggregate\",\n");
+				std::fprintf(file, "      \"aggregate_name\": \"%s\",\n", result.aggregate_name.c_str());
+			}
+			std::fprintf(file, "      \"iterations\": %lld,\n", static_cast<long long>(result.iterations));
+			std::fprintf(file, "      \"real_time\": %.3f,\n", result.ns_per_iter);
+			std::fprintf(file, "      \"time_unit\": \"ns\",\n");
+			if (result.items_per_second > 0)
+			{
+				std::fprintf(file, "      \"items_per_second\": %.3f,\n", result.items_per_second);
+			}
+			if (!result.label.empty())
+			{
+				std::fprintf(file, "      \"label\": \"%s\",\n", EscapeJson(result.label).c_str());
+			}
+			std::fprintf(file, "      \"allocs_per_iter\": %.3f\n    }", result.allocs_per_iter);
+		}
+		std::fprintf(file, "\n  ]\n}\n");
+	}
+
+	bool ParseFlag(const char* arg, const char* flag, std::string& out_value)
+	{
+		const size_t length = std::strlen(flag);
+		if (std::strncmp(arg, flag, length) != 0 || arg[length] != '=')
+		{
+			return false;
+		}
+		out_value = arg + length + 1;
+		return true;
+	}
+
+	bool ParseOptions(int argc, char** argv, RunOptions& out_options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string value;
+			if (ParseFlag(argv[i], "--benchmark_filter", value))
+			{
+				out_options.filter = value;
+			}
+			else if (ParseFlag(argv[i], "--benchmark_min_time", value))
+			{
+				out_options.min_time_s = std::max(std::atof(value.c_str()), 0.0);
+			}
+			else if (ParseFlag(argv[i], "--benchmark_repetitions", value))
+			{
+				out_options.repetitions = std::max(std::atoi(value.c_str()), 1);
+			}
+			else if (ParseFlag(argv[i], "--benchmark_format", value))
+			{
+				if (value != "json" && value != "console")
+				{
+					std::fprintf(stderr, "unknown format %s, expected console or json\n", value.c_str());
+					return false;
+				}
+				out_options.json_to_stdout = value == "json";
+			}
+			else if (ParseFlag(argv[i], "--benchmark_out", value))
+			{
+				out_options.out_path = value;
+			}
+			else if (argv[i][0] != '-')
+			{
+				// a bare argument is the filter, the way the runner always took it
+				out_options.filter = argv[i];
+			}
+			else
+			{
+				std::fprintf(stderr,
+					"usage: %s [filter] [--benchmark_filter=<substring>] [--benchmark_min_time=<seconds>]\n"
+					"       [--benchmark_repetitions=<n>] [--benchmark_format=console|json] [--benchmark_out=<file>]\n",
+					argv[0]);
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+Benchmark* terra::bench::RegisterBenchmark(const char* name, BenchmarkFunction fn)
+{
+	GetRegistry().emplace_back(std::make_unique<Benchmark>(name, fn));
+	return GetRegistry().back().get();
+}
+
+int terra::bench::RunBenchmarks(int argc, char** argv)
+{
+	RunOptions options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		return 1;
+	}
+
+	// json on stdout must stay parseable, the console table goes to nowhere then
+	const bool print_console = !options.json_to_stdout;
+	if (print_console)
+	{
+		PrintConsoleHeader();
+	}
+
+	std::vector<RunResult> results;
+	auto run = [&](const Benchmark& benchmark, const std::vector<int64_t>& args) {
+		std::vector<RunResult> repetitions;
+		for (int i = 0; i < options.repetitions; ++i)
+		{
+			RunResult result = RunOne(benchmark, args, options);
+			result.repetition_index = i;
+			if (print_console)
+			{
+				PrintConsoleResult(result);
+			}
+			repetitions.push_back(result);
+		}
+		results.insert(results.end(), repetitions.begin(), repetitions.end());
+		if (repetitions.size() > 1)
+		{
+			const size_t first_aggregate = results.size();
+			AddAggregates(repetitions, results);
+			for (size_t i = first_aggregate; print_console && i < results.size(); ++i)
+			{
+				PrintConsoleResult(results[i]);
+			}
+		}
+	};
+
+	for (const auto& benchmark : GetRegistry())
+	{
+		if (benchmark->GetName().find(options.filter) == std::string::npos)
+		{
+			continue;
+		}
+		if (benchmark->GetArgs().empty())
+		{
+			run(*benchmark, {});
+		}
+		for (const auto& args : benchmark->GetArgs())
+		{
+			run(*benchmark, args);
+		}
+	}
+
+	if (options.json_to_stdout)
+	{
+		WriteJson(stdout, results);
+	}
+	if (!options.out_path.empty())
+	{
+		FILE* file = std::fopen(options.out_path.c_str(), "w");
+		if (!file)
+		{
+			std::fprintf(stderr, "can't open %s for writing\n", options.out_path.c_str());
+			return 1;
+		}
+		WriteJson(file, results);
+		std::fclose(file);
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	return RunBenchmarks(argc, argv);
+}
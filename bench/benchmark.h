@@ -0,0 +1,167 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace terra
+{
+	namespace bench
+	{
+		/** Number of global operator new calls so far, the bench binary replaces operator new to count them. */
+		int64_t GetAllocationCount();
+
+		/**
+		* Per run state handed to a benchmark function, modeled after google benchmark.
+		*
+		*	void BM_Foo(bench::State& state)
+		*	{
+		*		// setup, not timed
+		*		while (state.KeepRunning())
+		*		{
+		*			// timed body
+		*		}
+		*		state.SetItemsProcessed(state.iterations());
+		*	}
+		*	CETUS_BENCHMARK(BM_Foo)->Arg(1000)->Arg(100000);
+		*/
+		class State
+		{
+		private:
+			using Clock = std::chrono::steady_clock;
+
+			const int64_t max_iterations_;
+			int64_t remaining_;
+			const std::vector<int64_t>& args_;
+			Clock::time_point start_time_;
+			Clock::duration elapsed_{ 0 };
+			int64_t start_allocations_{ 0 };
+			/** Heap allocations made while timing was running */
+			int64_t allocations_{ 0 };
+			bool running_{ false };
+			int64_t items_processed_{ 0 };
+			std::string label_;
+
+		public:
+			State(int64_t max_iterations, const std::vector<int64_t>& args)
+				: max_iterations_(max_iterations)
+				, remaining_(max_iterations)
+				, args_(args)
+			{
+			}
+
+			bool KeepRunning()
+			{
+				if (!running_ && remaining_ == max_iterations_)
+				{
+					ResumeTiming();
+				}
+				if (remaining_ > 0)
+				{
+					--remaining_;
+					return true;
+				}
+				if (running_)
+				{
+					PauseTiming();
+				}
+				return false;
+			}
+
+			/** Excludes per-iteration setup from the measurement. */
+			void PauseTiming()
+			{
+				elapsed_ += Clock::now() - start_time_;
+				allocations_ += GetAllocationCount() - start_allocations_;
+				running_ = false;
+			}
+			void ResumeTiming()
+			{
+				start_allocations_ = GetAllocationCount();
+				start_time_ = Clock::now();
+				running_ = true;
+			}
+
+			int64_t range(size_t idx = 0) const { return idx < args_.size() ? args_[idx] : 0; }
+			int64_t iterations() const { return max_iterations_; }
+
+			void SetItemsProcessed(int64_t items) { items_processed_ = items; }
+			int64_t GetItemsProcessed() const { return items_processed_; }
+
+			/** Extra text printed after the run, e.g. latency percentiles. */
+			void SetLabel(const std::string& label) { label_ = label; }
+			const std::string& GetLabel() const { return label_; }
+
+			int64_t GetAllocations() const { return allocations_; }
+
+			double GetElapsedSeconds() const { return std::chrono::duration<double>(elapsed_).count(); }
+		};
+
+		using BenchmarkFunction = void(*)(State&);
+
+		class Benchmark
+		{
+		private:
+			std::string name_;
+			BenchmarkFunction fn_;
+			std::vector<std::vector<int64_t>> args_;
+
+		public:
+			Benchmark(const char* name, BenchmarkFunction fn) : name_(name), fn_(fn) {}
+
+			Benchmark* Arg(int64_t arg)
+			{
+				args_.push_back({ arg });
+				return this;
+			}
+			Benchmark* Args(const std::vector<int64_t>& args)
+			{
+				args_.push_back(args);
+				return this;
+			}
+			/** Lets a function add args that are only known at run time, e.g. thread counts. */
+			Benchmark* Apply(void (*custom_arguments)(Benchmark* benchmark))
+			{
+				custom_arguments(this);
+				return this;
+			}
+
+			const std::string& GetName() const { return name_; }
+			BenchmarkFunction GetFunction() const { return fn_; }
+			const std::vector<std::vector<int64_t>>& GetArgs() const { return args_; }
+		};
+
+		Benchmark* RegisterBenchmark(const char* name, BenchmarkFunction fn);
+
+		/**
+		* Runs every registered benchmark whose name contains the filter, returns the process exit code.
+		* Takes a subset of google benchmark's flags: --benchmark_filter, --benchmark_min_time, --benchmark_repetitions,
+		* --benchmark_format=console|json and --benchmark_out=<file>, which writes a json report besides the console table.
+		*/
+		int RunBenchmarks(int argc, char** argv);
+
+		/** Keeps the compiler from optimizing away a value computed in a benchmark loop. */
+		template <typename T>
+		inline void DoNotOptimize(const T& value)
+		{
+#if defined(__GNUC__) || defined(__clang__)
+			asm volatile("" : : "r,m"(value) : "memory");
+#else
+			static volatile const void* sink;
+			sink = &value;
+#endif
+		}
+	}
+}
+
+#define CETUS_BENCHMARK_CONCAT_IMPL(a, b) a##b
+#define CETUS_BENCHMARK_CONCAT(a, b) CETUS_BENCHMARK_CONCAT_IMPL(a, b)
+
+#define CETUS_BENCHMARK(fn) \
+	static ::terra::bench::Benchmark* CETUS_BENCHMARK_CONCAT(cetus_benchmark_, __LINE__) = \
+		::terra::bench::RegisterBenchmark(#fn, fn)
+
+#define CETUS_BENCHMARK_TEMPLATE(fn, arg) \
+	static ::terra::bench::Benchmark* CETUS_BENCHMARK_CONCAT(cetus_benchmark_, __LINE__) = \
+		::terra::bench::RegisterBenchmark(#fn "<" #arg ">", fn<arg>)
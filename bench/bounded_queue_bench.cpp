@@ -0,0 +1,116 @@
+#include "benchmark.h"
+#include "container/bounded_queue.h"
+
+#include <thread>
+#include <vector>
+
+using namespace terra;
+
+/** Enqueue then Dequeue of one item on the same thread, compare with BM_TQueue_EnqueueDequeue. */
+template <EQueueMode kMode>
+void BM_TBoundedQueue_EnqueueDequeue(bench::State& state)
+{
+	TBoundedQueue<int64_t, kMode> queue(1024);
+	int64_t item = 0;
+	while (state.KeepRunning())
+	{
+		queue.TryEnqueue(item);
+		queue.TryDequeue(item);
+		++item;
+	}
+	bench::DoNotOptimize(item);
+	state.SetItemsProcessed(state.iterations());
+}
+CETUS_BENCHMARK_TEMPLATE(BM_TBoundedQueue_EnqueueDequeue, EQueueMode::Spsc);
+CETUS_BENCHMARK_TEMPLATE(BM_TBoundedQueue_EnqueueDequeue, EQueueMode::Mpsc);
+CETUS_BENCHMARK_TEMPLATE(BM_TBoundedQueue_EnqueueDequeue, EQueueMode::Mpmc);
+
+/** Fills the queue range(0) items at a time and empties it the same way, one position update per batch. */
+void BM_TBoundedQueue_Batch(bench::State& state)
+{
+	const size_t batch = static_cast<size_t>(state.range(0));
+	TBoundedQueue<int64_t> queue(1024);
+	std::vector<int64_t> items(batch, 1);
+	std::vector<int64_t> popped(batch);
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		for (size_t done = 0; done < 1024; done += batch)
+		{
+			queue.TryEnqueueBatch(items.begin(), batch);
+		}
+		for (size_t done = 0; done < 1024; done += batch)
+		{
+			queue.TryDequeueBatch(popped.begin(), batch);
+			sum += popped[0];
+		}
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations() * 1024);
+}
+CETUS_BENCHMARK(BM_TBoundedQueue_Batch)->Arg(1)->Arg(16)->Arg(256);
+
+/**
+* range(1) producer threads push range(0) items each through a 1024 slot queue, waiting when it is full. The
+* calling thread and range(2) more consumer threads drain it 64 at a time, compare with
+* BM_TQueue_ProducerConsumer.
+*/
+template <EQueueMode kMode>
+void BM_TBoundedQueue_ProducerConsumer(bench::State& state)
+{
+	const int64_t count = state.range(0);
+	const int64_t producer_count = state.range(1);
+	const int64_t extra_consumers = state.range(2);
+	const int64_t total = count * producer_count;
+	TBoundedQueue<int64_t, kMode> queue(1024);
+	std::atomic<int64_t> sum{ 0 };
+	while (state.KeepRunning())
+	{
+		std::atomic<int64_t> received{ 0 };
+		auto consume = [&queue, &received, &sum, total]() {
+			int64_t items[64];
+			int64_t local = 0;
+			while (received.load(std::memory_order_relaxed) < total)
+			{
+				const size_t n = queue.TryDequeueBatch(items, 64);
+				for (size_t i = 0; i < n; ++i)
+				{
+					local += items[i];
+				}
+				if (n > 0)
+				{
+					received.fetch_add(static_cast<int64_t>(n), std::memory_order_relaxed);
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+			sum.fetch_add(local, std::memory_order_relaxed);
+		};
+		std::vector<std::thread> threads;
+		for (int64_t p = 0; p < producer_count; ++p)
+		{
+			threads.emplace_back([&queue, count]() {
+				for (int64_t i = 0; i < count; ++i)
+				{
+					queue.Enqueue(i);
+				}
+			});
+		}
+		for (int64_t c = 0; c < extra_consumers; ++c)
+		{
+			threads.emplace_back(consume);
+		}
+		consume();
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+	}
+	bench::DoNotOptimize(sum.load());
+	state.SetItemsProcessed(state.iterations() * count * producer_count);
+}
+CETUS_BENCHMARK_TEMPLATE(BM_TBoundedQueue_ProducerConsumer, EQueueMode::Spsc)->Args({ 100000, 1, 0 });
+CETUS_BENCHMARK_TEMPLATE(BM_TBoundedQueue_ProducerConsumer, EQueueMode::Mpsc)->Args({ 100000, 1, 0 })->Args({ 100000, 4, 0 })->Args({ 100000, 16, 0 });
+CETUS_BENCHMARK_TEMPLATE(BM_TBoundedQueue_ProducerConsumer, EQueueMode::Mpmc)->Args({ 100000, 4, 3 });
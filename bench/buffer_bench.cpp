@@ -0,0 +1,236 @@
+#include "benchmark.h"
+#include "container/buffer_pool.h"
+#include "container/ringbuffer.h"
+#include "container/socket_buffer.h"
+
+using namespace terra;
+
+namespace
+{
+	/** A 4KB ring with writes and reads of range(0) bytes chasing each other, so they wrap around the end. */
+	constexpr int kRingSize = 4096;
+}
+
+/** write() then read() of range(0) bytes, items are bytes. */
+void BM_RingBuffer_WriteRead(bench::State& state)
+{
+	const int len = static_cast<int>(state.range(0));
+	ring_buffer buffer(kRingSize);
+	std::vector<char> data(static_cast<size_t>(len), 'x');
+	std::vector<char> out(static_cast<size_t>(len));
+	while (state.KeepRunning())
+	{
+		buffer.write(data.data(), len);
+		buffer.read(out.data(), len);
+	}
+	bench::DoNotOptimize(out[0]);
+	state.SetItemsProcessed(state.iterations() * len);
+}
+CETUS_BENCHMARK(BM_RingBuffer_WriteRead)->Arg(16)->Arg(256)->Arg(1500);
+
+/**
+* Append() of range(0) bytes and PopFront() of the same amount a packet later, the way a connection's send buffer
+* always holds one packet in flight. Items are bytes.
+*/
+void BM_SocketBuffer_AppendPop(bench::State& state)
+{
+	const uint32_t len = static_cast<uint32_t>(state.range(0));
+	SocketBuffer buffer(kRingSize);
+	std::vector<char> data(len, 'x');
+	buffer.Append(data.data(), len);
+	while (state.KeepRunning())
+	{
+		buffer.Append(data.data(), len);
+		bench::DoNotOptimize(*buffer.GetBuffer());
+		buffer.PopFront(len);
+	}
+	state.SetItemsProcessed(state.iterations() * len);
+}
+CETUS_BENCHMARK(BM_SocketBuffer_AppendPop)->Arg(16)->Arg(256)->Arg(1500);
+
+/** Grows a fresh buffer from its default capacity with range(0) bytes in 64 byte appends, mostly ExpandBuffer. */
+void BM_SocketBuffer_Grow(bench::State& state)
+{
+	const int64_t total = state.range(0);
+	char data[64] = {};
+	while (state.KeepRunning())
+	{
+		SocketBuffer buffer;
+		for (int64_t written = 0; written < total; written += sizeof(data))
+		{
+			buffer.Append(data, sizeof(data));
+		}
+		bench::DoNotOptimize(buffer.Size());
+	}
+	state.SetItemsProcessed(state.iterations() * total);
+}
+CETUS_BENCHMARK(BM_SocketBuffer_Grow)->Arg(4096)->Arg(65536)->Arg(1 << 20);
+
+/** BM_SocketBuffer_Grow in chained mode, blocks come from the default pool and are warm after the first round. */
+void BM_SocketBuffer_GrowChained(bench::State& state)
+{
+	const int64_t total = state.range(0);
+	char data[64] = {};
+	while (state.KeepRunning())
+	{
+		SocketBuffer buffer(SocketBlockPool::Default());
+		for (int64_t written = 0; written < total; written += sizeof(data))
+		{
+			buffer.Append(data, sizeof(data));
+		}
+		bench::DoNotOptimize(buffer.Size());
+	}
+	state.SetItemsProcessed(state.iterations() * total);
+}
+CETUS_BENCHMARK(BM_SocketBuffer_GrowChained)->Arg(4096)->Arg(65536)->Arg(1 << 20);
+
+/**
+* A send buffer holding a 1MB backlog: each iteration appends 16KB and sends 16KB from the front, through
+* GetBuffer() in contiguous mode (range(0) 0) and through GetReadableIoVecs() in chained mode (range(0) 1).
+* Items are bytes sent, the cost is what the buffer spends moving its own bytes around.
+*/
+void BM_SocketBuffer_Backlog(bench::State& state)
+{
+	const bool chained = state.range(0) != 0;
+	const uint32_t backlog = 1 << 20;
+	const uint32_t chunk = 16 << 10;
+	std::vector<char> data(chunk, 'x');
+	std::unique_ptr<SocketBuffer> buffer(chained ? new SocketBuffer(SocketBlockPool::Default()) : new SocketBuffer());
+	for (uint32_t filled = 0; filled < backlog; filled += chunk)
+	{
+		buffer->Append(data.data(), chunk);
+	}
+	IoVec iov[16];
+	size_t sent = 0;
+	while (state.KeepRunning())
+	{
+		buffer->Append(data.data(), chunk);
+		if (chained)
+		{
+			const int count = buffer->GetReadableIoVecs(iov, 16);
+			uint32_t bytes = 0;
+			for (int i = 0; i < count && bytes < chunk; ++i)
+			{
+				bytes += std::min<uint32_t>(chunk - bytes, IoVecSize(iov[i]));
+			}
+			buffer->PopFront(bytes);
+			sent += bytes;
+		}
+		else
+		{
+			bench::DoNotOptimize(*buffer->GetBuffer());
+			buffer->PopFront(chunk);
+			sent += chunk;
+		}
+	}
+	bench::DoNotOptimize(sent);
+	state.SetItemsProcessed(state.iterations() * chunk);
+	state.SetLabel(chained ? "chained" : "contiguous");
+}
+CETUS_BENCHMARK(BM_SocketBuffer_Backlog)->Arg(0)->Arg(1);
+
+/** Alloc() and Free() of range(0) bytes on a warm pool, the cost of a buffer growing or shrinking by one step. */
+void BM_BufferPool_AllocFree(bench::State& state)
+{
+	const uint32_t size = static_cast<uint32_t>(state.range(0));
+	BufferPool pool;
+	pool.Free(pool.Alloc(size), size);
+	while (state.KeepRunning())
+	{
+		char* data = pool.Alloc(size);
+		bench::DoNotOptimize(*data);
+		pool.Free(data, size);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+CETUS_BENCHMARK(BM_BufferPool_AllocFree)->Arg(64)->Arg(4096)->Arg(1 << 20);
+
+/**
+* A traffic spike over 256 connections: every receive buffer grows to 256KB and is read empty again, then the
+* pool is trimmed twice the way its timer would after two quiet intervals. Items are connections, the label has
+* the pool's reserved memory at the peak, after the drain and after the trims.
+*/
+void BM_SocketBuffer_Spike(bench::State& state)
+{
+	const int connections = 256;
+	const uint32_t spike = 256 << 10;
+	std::vector<char> data(16 << 10, 'x');
+	BufferPoolOptions options;
+	options.trim_interval = std::chrono::milliseconds(0);
+	BufferPool pool(options);
+	BufferPoolStats peak, drained, trimmed;
+	while (state.KeepRunning())
+	{
+		std::vector<std::unique_ptr<SocketBuffer>> buffers;
+		for (int i = 0; i < connections; ++i)
+		{
+			buffers.emplace_back(new SocketBuffer(1024, pool));
+		}
+		for (auto& buffer : buffers)
+		{
+			for (uint32_t filled = 0; filled < spike; filled += static_cast<uint32_t>(data.size()))
+			{
+				buffer->Append(data.data(), static_cast<uint32_t>(data.size()));
+			}
+		}
+		pool.GetStats(peak);
+		for (auto& buffer : buffers)
+		{
+			buffer->PopFront(buffer->Size());
+		}
+		pool.GetStats(drained);
+		pool.Trim();
+		pool.Trim();
+		pool.GetStats(trimmed);
+	}
+	state.SetItemsProcessed(state.iterations() * connections);
+	state.SetLabel("reserved KB peak " + std::to_string(peak.bytes_reserved >> 10) + " drained " + std::to_string(drained.bytes_reserved >> 10)
+		+ " trimmed " + std::to_string(trimmed.bytes_reserved >> 10) + " fragmentation " + std::to_string(trimmed.GetFragmentation()));
+}
+CETUS_BENCHMARK(BM_SocketBuffer_Spike);
+
+/**
+* BM_SocketBuffer_Spike without manual Trim() calls: after the spike a trickle of small allocations, one per
+* millisecond, is all the pool sees, and its own trim every 5ms has to give the spike back. Items are the quiet
+* milliseconds it took, the label has the reserved memory before and after.
+*/
+void BM_BufferPool_IdleTrim(bench::State& state)
+{
+	const int connections = 64;
+	const uint32_t spike = 256 << 10;
+	std::vector<char> data(16 << 10, 'x');
+	BufferPoolOptions options;
+	options.trim_interval = std::chrono::milliseconds(5);
+	BufferPool pool(options);
+	BufferPoolStats drained, quiet;
+	int64_t quiet_ms = 0;
+	while (state.KeepRunning())
+	{
+		{
+			std::vector<std::unique_ptr<SocketBuffer>> buffers;
+			for (int i = 0; i < connections; ++i)
+			{
+				buffers.emplace_back(new SocketBuffer(1024, pool));
+				for (uint32_t filled = 0; filled < spike; filled += static_cast<uint32_t>(data.size()))
+				{
+					buffers.back()->Append(data.data(), static_cast<uint32_t>(data.size()));
+				}
+			}
+		}
+		pool.GetStats(drained);
+		for (int ms = 0; ms < 1000; ++ms)
+		{
+			pool.Free(pool.Alloc(64), 64);
+			pool.GetStats(quiet);
+			if (quiet.bytes_reserved < (1 << 20))
+			{
+				quiet_ms += ms;
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	state.SetItemsProcessed(quiet_ms);
+	state.SetLabel("reserved KB drained " + std::to_string(drained.bytes_reserved >> 10) + " quiet " + std::to_string(quiet.bytes_reserved >> 10));
+}
+CETUS_BENCHMARK(BM_BufferPool_IdleTrim);
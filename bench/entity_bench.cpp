@@ -0,0 +1,76 @@
+#include "benchmark.h"
+#include "entity/entity.h"
+#include "entity/component.h"
+
+using namespace terra;
+
+namespace
+{
+	struct PositionComponent : public IComponent
+	{
+		float x{ 0 };
+		float y{ 0 };
+	};
+	struct HealthComponent : public IComponent
+	{
+		int hp{ 100 };
+	};
+	struct InventoryComponent : public IComponent
+	{
+		int slots{ 20 };
+	};
+	/** Never added, for the miss path */
+	struct QuestComponent : public IComponent
+	{
+	};
+
+	void MakeEntity(Entity& entity)
+	{
+		entity.Add<PositionComponent>().Add<HealthComponent>().Add<InventoryComponent>();
+	}
+}
+
+void BM_Entity_Get(bench::State& state)
+{
+	Entity entity;
+	MakeEntity(entity);
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		sum += entity.Get<HealthComponent>()->hp;
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations());
+}
+CETUS_BENCHMARK(BM_Entity_Get);
+
+/** Get<Cs...>() of three components at once, a Has() per component then a Get() per component. */
+void BM_Entity_GetMany(bench::State& state)
+{
+	Entity entity;
+	MakeEntity(entity);
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		auto components = entity.Get<PositionComponent, HealthComponent, InventoryComponent>();
+		sum += std::get<1>(components)->hp + std::get<2>(components)->slots;
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations());
+}
+CETUS_BENCHMARK(BM_Entity_GetMany);
+
+void BM_Entity_Has(bench::State& state)
+{
+	Entity entity;
+	MakeEntity(entity);
+	int64_t hits = 0;
+	while (state.KeepRunning())
+	{
+		hits += entity.Has<HealthComponent>();
+		hits += entity.Has<QuestComponent>();
+	}
+	bench::DoNotOptimize(hits);
+	state.SetItemsProcessed(state.iterations() * 2);
+}
+CETUS_BENCHMARK(BM_Entity_Has);
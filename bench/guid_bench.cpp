@@ -0,0 +1,61 @@
+#include "benchmark.h"
+#include "guid/fguid.h"
+#include "guid/snowflake.h"
+
+using namespace terra;
+
+void BM_FGuid_NewGuid(bench::State& state)
+{
+	uint32_t hash = 0;
+	while (state.KeepRunning())
+	{
+		hash ^= FGuid::NewGuid()[0];
+	}
+	bench::DoNotOptimize(hash);
+	state.SetItemsProcessed(state.iterations());
+}
+CETUS_BENCHMARK(BM_FGuid_NewGuid);
+
+void BM_FGuid_ToString(bench::State& state)
+{
+	const FGuid guid = FGuid::NewGuid();
+	size_t length = 0;
+	while (state.KeepRunning())
+	{
+		length += guid.ToString().size();
+	}
+	bench::DoNotOptimize(length);
+	state.SetItemsProcessed(state.iterations());
+}
+CETUS_BENCHMARK(BM_FGuid_ToString);
+
+void BM_FGuid_Parse(bench::State& state)
+{
+	const std::string text = FGuid::NewGuid().ToString();
+	FGuid guid;
+	while (state.KeepRunning())
+	{
+		FGuid::Parse(text, guid);
+	}
+	bench::DoNotOptimize(guid[0]);
+	state.SetItemsProcessed(state.iterations());
+}
+CETUS_BENCHMARK(BM_FGuid_Parse);
+
+/**
+* Snowflake::Generate() back to back. A generator hands out 4096 ids per millisecond, so past that rate the
+* numbers show the wait for the next millisecond rather than the generation cost.
+*/
+void BM_Snowflake_Generate(bench::State& state)
+{
+	Snowflake snowflake;
+	snowflake.set_machine_id(1);
+	int64_t id = 0;
+	while (state.KeepRunning())
+	{
+		id ^= snowflake.Generate();
+	}
+	bench::DoNotOptimize(id);
+	state.SetItemsProcessed(state.iterations());
+}
+CETUS_BENCHMARK(BM_Snowflake_Generate);
@@ -0,0 +1,64 @@
+#include "benchmark.h"
+#include "core.h"
+#include "reflection/json.hpp"
+#include "reflection/detail/string_stream.hpp"
+
+using namespace terra;
+
+namespace
+{
+	struct BenchItem
+	{
+		int32_t item_id;
+		int32_t count;
+	};
+	REFLECTION(BenchItem, item_id, count)
+
+	struct BenchPlayer
+	{
+		int64_t player_id;
+		std::string name;
+		int32_t level;
+		double exp;
+		std::vector<int32_t> skills;
+		BenchItem weapon;
+	};
+	REFLECTION(BenchPlayer, player_id, name, level, exp, skills, weapon)
+
+	BenchPlayer MakePlayer()
+	{
+		return BenchPlayer{ 1234567890123, "bench_player", 60, 12345.5, { 1, 2, 3, 4, 5, 6, 7, 8 }, { 1001, 1 } };
+	}
+}
+
+/** Serializes a player record, items are bytes written. */
+void BM_Json_ToJson(bench::State& state)
+{
+	const BenchPlayer player = MakePlayer();
+	string_stream ss;
+	while (state.KeepRunning())
+	{
+		ss.clear();
+		json::to_json(ss, player);
+	}
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(ss.write_length()));
+}
+CETUS_BENCHMARK(BM_Json_ToJson);
+
+/** Parses the same record back, items are bytes read. */
+void BM_Json_FromJson(bench::State& state)
+{
+	string_stream ss;
+	json::to_json(ss, MakePlayer());
+	const std::string text = ss.str();
+	int64_t level = 0;
+	while (state.KeepRunning())
+	{
+		BenchPlayer player{};
+		json::from_json(player, text.data(), text.size());
+		level += player.level;
+	}
+	bench::DoNotOptimize(level);
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(text.size()));
+}
+CETUS_BENCHMARK(BM_Json_FromJson);
@@ -0,0 +1,130 @@
+#include "benchmark.h"
+#include "container/mpsc_queue.h"
+
+#include <thread>
+
+using namespace terra;
+
+/** Enqueue then Dequeue of one item on the same thread, the uncontended cost of a hand-off. */
+template <EQueueMode kMode>
+void BM_TQueue_EnqueueDequeue(bench::State& state)
+{
+	TQueue<int64_t, kMode> queue;
+	int64_t item = 0;
+	while (state.KeepRunning())
+	{
+		queue.Enqueue(item);
+		queue.Dequeue(item);
+		++item;
+	}
+	bench::DoNotOptimize(item);
+	state.SetItemsProcessed(state.iterations());
+}
+CETUS_BENCHMARK_TEMPLATE(BM_TQueue_EnqueueDequeue, EQueueMode::Spsc);
+CETUS_BENCHMARK_TEMPLATE(BM_TQueue_EnqueueDequeue, EQueueMode::Mpsc);
+
+/** Fills the queue with range(0) items then drains it, the consumer sees a backlog the way a busy frame does. */
+template <EQueueMode kMode>
+void BM_TQueue_Burst(bench::State& state)
+{
+	const int64_t count = state.range(0);
+	TQueue<int64_t, kMode> queue;
+	int64_t item = 0;
+	while (state.KeepRunning())
+	{
+		for (int64_t i = 0; i < count; ++i)
+		{
+			queue.Enqueue(i);
+		}
+		while (queue.Dequeue(item));
+	}
+	bench::DoNotOptimize(item);
+	state.SetItemsProcessed(state.iterations() * count);
+}
+CETUS_BENCHMARK_TEMPLATE(BM_TQueue_Burst, EQueueMode::Spsc)->Arg(64)->Arg(4096);
+CETUS_BENCHMARK_TEMPLATE(BM_TQueue_Burst, EQueueMode::Mpsc)->Arg(64)->Arg(4096);
+
+/** Same as BM_TQueue_Burst but the consumer empties the queue with one Drain() call. */
+template <EQueueMode kMode>
+void BM_TQueue_BurstDrain(bench::State& state)
+{
+	const int64_t count = state.range(0);
+	TQueue<int64_t, kMode> queue;
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		for (int64_t i = 0; i < count; ++i)
+		{
+			queue.Enqueue(i);
+		}
+		queue.Drain([&sum](int64_t&& item) { sum += item; });
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations() * count);
+}
+CETUS_BENCHMARK_TEMPLATE(BM_TQueue_BurstDrain, EQueueMode::Mpsc)->Arg(64)->Arg(4096);
+
+/** Same as BM_TQueue_Burst but the consumer takes up to 64 items per DequeueBatch() call. */
+template <EQueueMode kMode>
+void BM_TQueue_BurstDequeueBatch(bench::State& state)
+{
+	const int64_t count = state.range(0);
+	TQueue<int64_t, kMode> queue;
+	int64_t items[64];
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		for (int64_t i = 0; i < count; ++i)
+		{
+			queue.Enqueue(i);
+		}
+		while (size_t n = queue.DequeueBatch(items, 64))
+		{
+			sum += items[n - 1];
+		}
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations() * count);
+}
+CETUS_BENCHMARK_TEMPLATE(BM_TQueue_BurstDequeueBatch, EQueueMode::Mpsc)->Arg(64)->Arg(4096);
+
+/**
+* range(1) producer threads push range(0) items each while the calling thread drains, items are items moved
+* end to end. Spsc runs with a single producer only.
+*/
+template <EQueueMode kMode>
+void BM_TQueue_ProducerConsumer(bench::State& state)
+{
+	const int64_t count = state.range(0);
+	const int64_t producer_count = state.range(1);
+	TQueue<int64_t, kMode> queue;
+	int64_t item = 0;
+	while (state.KeepRunning())
+	{
+		std::vector<std::thread> producers;
+		for (int64_t p = 0; p < producer_count; ++p)
+		{
+			producers.emplace_back([&queue, count]() {
+				for (int64_t i = 0; i < count; ++i)
+				{
+					queue.Enqueue(i);
+				}
+			});
+		}
+		for (int64_t received = 0; received < count * producer_count;)
+		{
+			if (queue.Dequeue(item))
+			{
+				++received;
+			}
+		}
+		for (auto& producer : producers)
+		{
+			producer.join();
+		}
+	}
+	bench::DoNotOptimize(item);
+	state.SetItemsProcessed(state.iterations() * count * producer_count);
+}
+CETUS_BENCHMARK_TEMPLATE(BM_TQueue_ProducerConsumer, EQueueMode::Spsc)->Args({ 100000, 1 });
+CETUS_BENCHMARK_TEMPLATE(BM_TQueue_ProducerConsumer, EQueueMode::Mpsc)->Args({ 100000, 1 })->Args({ 100000, 4 })->Args({ 100000, 16 });
@@ -0,0 +1,147 @@
+#include "benchmark.h"
+#include "thread/parallel_algorithm.hpp"
+
+#include <numeric>
+#include <random>
+
+using namespace terra;
+
+namespace
+{
+	/** A few hundred cycles of math per element, like recomputing one entity's AOI distance set. */
+	float ElementWork(float value)
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			value = std::sqrt(value * value + 1.0f) * 0.999f;
+		}
+		return value;
+	}
+
+	std::vector<float> MakeValues(int64_t count)
+	{
+		std::mt19937 rng(12345);
+		std::uniform_real_distribution<float> dist(0.0f, 100.0f);
+		std::vector<float> values(static_cast<size_t>(count));
+		for (auto& value : values)
+		{
+			value = dist(rng);
+		}
+		return values;
+	}
+
+	std::vector<int32_t> MakeKeys(int64_t count)
+	{
+		std::mt19937 rng(12345);
+		std::vector<int32_t> keys(static_cast<size_t>(count));
+		for (auto& key : keys)
+		{
+			key = static_cast<int32_t>(rng());
+		}
+		return keys;
+	}
+
+	/** Pool of the default size, the calling thread makes one more participant. */
+	ThreadPool& GetBenchPool()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+}
+
+/** Baseline for BM_ParallelFor, items are elements. */
+void BM_SerialFor(bench::State& state)
+{
+	std::vector<float> values = MakeValues(state.range(0));
+	while (state.KeepRunning())
+	{
+		for (auto& value : values)
+		{
+			value = ElementWork(value);
+		}
+	}
+	bench::DoNotOptimize(values[0]);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+CETUS_BENCHMARK(BM_SerialFor)->Arg(1000)->Arg(100000);
+
+void BM_ParallelFor(bench::State& state)
+{
+	ThreadPool& pool = GetBenchPool();
+	std::vector<float> values = MakeValues(state.range(0));
+	while (state.KeepRunning())
+	{
+		parallel_for(pool, 0, values.size(), 0, [&values](size_t i)
+		{
+			values[i] = ElementWork(values[i]);
+		});
+	}
+	bench::DoNotOptimize(values[0]);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	state.SetLabel(std::to_string(pool.size() + 1) + " participants");
+}
+CETUS_BENCHMARK(BM_ParallelFor)->Arg(1000)->Arg(100000);
+
+/** Baseline for BM_ParallelReduce: a memory bound sum, items are elements. */
+void BM_SerialReduce(bench::State& state)
+{
+	const std::vector<int32_t> keys = MakeKeys(state.range(0));
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		sum += std::accumulate(keys.begin(), keys.end(), int64_t{ 0 });
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+CETUS_BENCHMARK(BM_SerialReduce)->Arg(100000)->Arg(10000000);
+
+void BM_ParallelReduce(bench::State& state)
+{
+	ThreadPool& pool = GetBenchPool();
+	const std::vector<int32_t> keys = MakeKeys(state.range(0));
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		sum += parallel_reduce(pool, 0, keys.size(), 0, int64_t{ 0 },
+			[&keys](size_t i) { return static_cast<int64_t>(keys[i]); },
+			[](int64_t lhs, int64_t rhs) { return lhs + rhs; });
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	state.SetLabel(std::to_string(pool.size() + 1) + " participants");
+}
+CETUS_BENCHMARK(BM_ParallelReduce)->Arg(100000)->Arg(10000000);
+
+/** Baseline for BM_ParallelSort, items are elements. */
+void BM_SerialSort(bench::State& state)
+{
+	const std::vector<int32_t> keys = MakeKeys(state.range(0));
+	std::vector<int32_t> work;
+	while (state.KeepRunning())
+	{
+		state.PauseTiming();
+		work = keys;
+		state.ResumeTiming();
+		std::sort(work.begin(), work.end());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+CETUS_BENCHMARK(BM_SerialSort)->Arg(100000)->Arg(1000000);
+
+void BM_ParallelSort(bench::State& state)
+{
+	ThreadPool& pool = GetBenchPool();
+	const std::vector<int32_t> keys = MakeKeys(state.range(0));
+	std::vector<int32_t> work;
+	while (state.KeepRunning())
+	{
+		state.PauseTiming();
+		work = keys;
+		state.ResumeTiming();
+		parallel_sort(pool, work.begin(), work.end());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	state.SetLabel(std::to_string(pool.size() + 1) + " participants");
+}
+CETUS_BENCHMARK(BM_ParallelSort)->Arg(100000)->Arg(1000000);
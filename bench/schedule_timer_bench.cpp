@@ -0,0 +1,471 @@
+#include "benchmark.h"
+#include "timer/schedule_timer.h"
+#include "timer/schedule_timer_lite.h"
+
+#include <random>
+
+using namespace terra;
+
+namespace
+{
+	constexpr int kFrameMs = 16;
+
+	void NextFrame(ScheduleTimer& timer_manager, int tick_ms)
+	{
+		++GTLFrameCounter;
+		timer_manager.Tick(tick_ms);
+	}
+
+	/** Fills the manager with count live timers spread over [min_ms, max_ms], the way a zone full of NPCs looks. */
+	void PopulateTimers(ScheduleTimer& timer_manager, std::vector<TimerHandle>& handles, int64_t count, int min_ms, int max_ms, bool loop, int64_t& fired)
+	{
+		std::mt19937 rng(12345);
+		std::uniform_int_distribution<int> rate(min_ms, max_ms);
+		handles.resize(static_cast<size_t>(count));
+		for (auto& handle : handles)
+		{
+			timer_manager.SetTimer(handle, [&fired]() { ++fired; }, rate(rng), loop);
+		}
+	}
+}
+
+/** Fills an empty manager with range(0) timers, items are SetTimer calls. */
+template <ETimerQueueType kQueueType>
+void BM_ScheduleTimer_SetTimer(bench::State& state)
+{
+	const int64_t count = state.range(0);
+	int64_t fired = 0;
+	std::vector<TimerHandle> handles;
+
+	while (state.KeepRunning())
+	{
+		state.PauseTiming();
+		std::unique_ptr<ScheduleTimer> timer_manager = std::make_unique<ScheduleTimer>(kQueueType);
+		NextFrame(*timer_manager, kFrameMs);
+		handles.assign(static_cast<size_t>(count), TimerHandle());
+		state.ResumeTiming();
+
+		PopulateTimers(*timer_manager, handles, count, kFrameMs, 60000, false, fired);
+
+		state.PauseTiming();
+		timer_manager.reset();
+		state.ResumeTiming();
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_SetTimer, ETimerQueueType::BINARY_HEAP)->Arg(1000)->Arg(10000)->Arg(200000);
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_SetTimer, ETimerQueueType::TIMING_WHEEL)->Arg(1000)->Arg(10000)->Arg(200000);
+
+/** Cancel then re-arm a random live timer out of range(0). */
+template <ETimerQueueType kQueueType>
+void BM_ScheduleTimer_ClearTimer(bench::State& state)
+{
+	const int64_t count = state.range(0);
+	int64_t fired = 0;
+	std::mt19937 rng(54321);
+	std::uniform_int_distribution<size_t> pick(0, static_cast<size_t>(count) - 1);
+
+	ScheduleTimer timer_manager(kQueueType);
+	NextFrame(timer_manager, kFrameMs);
+	std::vector<TimerHandle> handles;
+	PopulateTimers(timer_manager, handles, count, kFrameMs, 60000, false, fired);
+
+	while (state.KeepRunning())
+	{
+		TimerHandle& handle = handles[pick(rng)];
+		timer_manager.ClearTimer(handle);
+		timer_manager.SetTimer(handle, [&fired]() { ++fired; }, 30000, false);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_ClearTimer, ETimerQueueType::BINARY_HEAP)->Arg(1000)->Arg(10000)->Arg(200000);
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_ClearTimer, ETimerQueueType::TIMING_WHEEL)->Arg(1000)->Arg(10000)->Arg(200000);
+
+/** One 16ms frame with range(0) looping timers of 16ms..10s rate, items are fired callbacks. */
+template <ETimerQueueType kQueueType>
+void BM_ScheduleTimer_Tick(bench::State& state)
+{
+	const int64_t count = state.range(0);
+	int64_t fired = 0;
+
+	ScheduleTimer timer_manager(kQueueType);
+	NextFrame(timer_manager, kFrameMs);
+	std::vector<TimerHandle> handles;
+	PopulateTimers(timer_manager, handles, count, kFrameMs, 10000, true, fired);
+	NextFrame(timer_manager, kFrameMs);
+
+	fired = 0;
+	while (state.KeepRunning())
+	{
+		NextFrame(timer_manager, kFrameMs);
+	}
+	state.SetItemsProcessed(fired);
+}
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_Tick, ETimerQueueType::BINARY_HEAP)->Arg(1000)->Arg(10000)->Arg(200000);
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_Tick, ETimerQueueType::TIMING_WHEEL)->Arg(1000)->Arg(10000)->Arg(200000);
+
+/** IsTimerActive/GetTimerRemaining on a random handle out of range(0) live timers. */
+template <ETimerQueueType kQueueType>
+void BM_ScheduleTimer_FindTimer(bench::State& state)
+{
+	const int64_t count = state.range(0);
+	int64_t fired = 0;
+	std::mt19937 rng(54321);
+	std::uniform_int_distribution<size_t> pick(0, static_cast<size_t>(count) - 1);
+
+	ScheduleTimer timer_manager(kQueueType);
+	NextFrame(timer_manager, kFrameMs);
+	std::vector<TimerHandle> handles;
+	PopulateTimers(timer_manager, handles, count, kFrameMs, 60000, false, fired);
+
+	int64_t remaining = 0;
+	while (state.KeepRunning())
+	{
+		const TimerHandle& handle = handles[pick(rng)];
+		if (timer_manager.IsTimerActive(handle))
+		{
+			remaining += timer_manager.GetTimerRemaining(handle);
+		}
+	}
+	bench::DoNotOptimize(remaining);
+	state.SetItemsProcessed(state.iterations());
+}
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_FindTimer, ETimerQueueType::BINARY_HEAP)->Arg(1000)->Arg(10000)->Arg(200000);
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_FindTimer, ETimerQueueType::TIMING_WHEEL)->Arg(1000)->Arg(10000)->Arg(200000);
+
+/**
+* Stress run: range(0) looping timers whose delegates clear, re-arm and pause other timers and themselves
+* while they are executing. Every handle must still be alive at the end.
+*/
+template <ETimerQueueType kQueueType>
+void BM_ScheduleTimer_CancelDuringCallback(bench::State& state)
+{
+	const size_t count = static_cast<size_t>(state.range(0));
+	int64_t fired = 0;
+	std::mt19937 rng(777);
+	std::uniform_int_distribution<size_t> pick(0, count - 1);
+	std::uniform_int_distribution<int> rate(1, 2000);
+
+	ScheduleTimer timer_manager(kQueueType);
+	std::vector<TimerHandle> handles(count);
+	std::function<void(size_t)> arm = [&](size_t idx) {
+		timer_manager.SetTimer(handles[idx], [&, idx]() {
+			++fired;
+			const size_t other = pick(rng);
+			switch (fired % 4)
+			{
+			case 0:
+				// cancel someone else and bring it back
+				timer_manager.ClearTimer(handles[other]);
+				Expects(!timer_manager.IsTimerExists(handles[other]));
+				arm(other);
+				break;
+			case 1:
+				// cancel and re-arm ourselves, the running delegate must survive this
+				arm(idx);
+				break;
+			case 2:
+				timer_manager.PauseTimer(handles[other]);
+				timer_manager.ContiuneTimer(handles[other]);
+				break;
+			default:
+				timer_manager.PauseTimer(handles[idx]);
+				timer_manager.ContiuneTimer(handles[idx]);
+				break;
+			}
+		}, rate(rng), true);
+	};
+	for (size_t i = 0; i < count; ++i)
+	{
+		arm(i);
+	}
+
+	while (state.KeepRunning())
+	{
+		NextFrame(timer_manager, kFrameMs);
+	}
+
+	for (const auto& handle : handles)
+	{
+		Expects(timer_manager.IsTimerExists(handle));
+	}
+	state.SetItemsProcessed(fired);
+}
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_CancelDuringCallback, ETimerQueueType::BINARY_HEAP)->Arg(1000)->Arg(100000);
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_CancelDuringCallback, ETimerQueueType::TIMING_WHEEL)->Arg(1000)->Arg(100000);
+
+/**
+* range(0) looping timers set with empty callables, which the manager keeps but never calls, like std::function
+* did. Items are timers ticked.
+*/
+void BM_ScheduleTimer_NullCallback(bench::State& state)
+{
+	const int64_t count = state.range(0);
+	void(*null_fn)() = nullptr;
+	Expects(!TimerCallback(std::function<void()>()));
+	Expects(!TimerCallback(null_fn));
+	bool thrown = false;
+	try
+	{
+		TimerCallback()();
+	}
+	catch (const std::bad_function_call&)
+	{
+		thrown = true;
+	}
+	Expects(thrown);
+
+	ScheduleTimer timer_manager;
+	NextFrame(timer_manager, kFrameMs);
+	std::vector<TimerHandle> handles(static_cast<size_t>(count));
+	for (size_t i = 0; i < handles.size(); ++i)
+	{
+		if (i % 2 == 0)
+		{
+			timer_manager.SetTimer(handles[i], std::function<void()>(), kFrameMs, true);
+		}
+		else
+		{
+			timer_manager.SetTimer(handles[i], null_fn, kFrameMs, true);
+		}
+	}
+
+	while (state.KeepRunning())
+	{
+		NextFrame(timer_manager, kFrameMs);
+	}
+
+	for (const auto& handle : handles)
+	{
+		Expects(timer_manager.IsTimerExists(handle));
+	}
+
+	// ScheduleTimerLite skips empty callbacks the same way
+	ScheduleTimerLite timer_manager_lite(kFrameMs);
+	timer_manager_lite.RunAfter(kFrameMs, std::function<void()>());
+	TimerHandleLite loop_handle = timer_manager_lite.RunEvery(kFrameMs, null_fn);
+	for (int i = 0; i < 4; ++i)
+	{
+		timer_manager_lite.Tick(kFrameMs);
+	}
+	Expects(timer_manager_lite.IsPending(loop_handle) && timer_manager_lite.Size() == 1);
+	state.SetItemsProcessed(state.iterations() * count);
+}
+CETUS_BENCHMARK(BM_ScheduleTimer_NullCallback)->Arg(1000);
+
+namespace
+{
+	struct ChurnContext
+	{
+		ScheduleTimer* timer_manager{ nullptr };
+		ScheduleTimerLite* timer_manager_lite{ nullptr };
+		std::vector<TimerHandle> handles;
+		std::mt19937 rng{ 4242 };
+		std::uniform_int_distribution<int> rate{ kFrameMs, 2000 };
+		int64_t fired{ 0 };
+		int64_t checksum{ 0 };
+	};
+
+	// 40 bytes of captures, about what a gameplay delegate holding an owner pointer and a few values carries
+	void ArmChurnTimer(ChurnContext& ctx, size_t idx)
+	{
+		const int64_t armed_at = ctx.fired;
+		const int64_t payload_a = static_cast<int64_t>(idx) * 3;
+		const int64_t payload_b = static_cast<int64_t>(idx) * 7;
+		auto timer_cb = [&ctx, idx, armed_at, payload_a, payload_b]() {
+			++ctx.fired;
+			ctx.checksum += armed_at + payload_a - payload_b;
+			ArmChurnTimer(ctx, idx);
+		};
+		static_assert(TimerCallback::IsStoredInline<decltype(timer_cb)>(), "churn delegate is expected to fit the inline buffer");
+
+		if (ctx.timer_manager)
+		{
+			ctx.timer_manager->SetTimer(ctx.handles[idx], std::move(timer_cb), ctx.rate(ctx.rng), false);
+		}
+		else
+		{
+			ctx.timer_manager_lite->RunAfter(ctx.rate(ctx.rng), std::move(timer_cb));
+		}
+	}
+}
+
+/**
+* Steady state churn: range(0) one shot timers, each one re-armed from its own delegate with a fresh capture.
+* Once warmed up, a frame must not touch the heap, see the allocs/iter column.
+*/
+template <ETimerQueueType kQueueType>
+void BM_ScheduleTimer_Churn(bench::State& state)
+{
+	const size_t count = static_cast<size_t>(state.range(0));
+	ScheduleTimer timer_manager(kQueueType);
+	ChurnContext ctx;
+	ctx.timer_manager = &timer_manager;
+	ctx.handles.resize(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		ArmChurnTimer(ctx, i);
+	}
+	// let every container grow to its working size
+	for (int i = 0; i < 1000; ++i)
+	{
+		NextFrame(timer_manager, kFrameMs);
+	}
+
+	const int64_t fired_before = ctx.fired;
+	while (state.KeepRunning())
+	{
+		NextFrame(timer_manager, kFrameMs);
+	}
+	bench::DoNotOptimize(ctx.checksum);
+	state.SetItemsProcessed(ctx.fired - fired_before);
+}
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_Churn, ETimerQueueType::BINARY_HEAP)->Arg(1000)->Arg(100000);
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_Churn, ETimerQueueType::TIMING_WHEEL)->Arg(1000)->Arg(100000);
+
+/** Same churn on ScheduleTimerLite. */
+void BM_ScheduleTimerLite_Churn(bench::State& state)
+{
+	const size_t count = static_cast<size_t>(state.range(0));
+	ScheduleTimerLite timer_manager(kFrameMs);
+	ChurnContext ctx;
+	ctx.timer_manager_lite = &timer_manager;
+	for (size_t i = 0; i < count; ++i)
+	{
+		ArmChurnTimer(ctx, i);
+	}
+	for (int i = 0; i < 1000; ++i)
+	{
+		timer_manager.Tick(kFrameMs);
+	}
+
+	const int64_t fired_before = ctx.fired;
+	while (state.KeepRunning())
+	{
+		timer_manager.Tick(kFrameMs);
+	}
+	bench::DoNotOptimize(ctx.checksum);
+	state.SetItemsProcessed(ctx.fired - fired_before);
+}
+CETUS_BENCHMARK(BM_ScheduleTimerLite_Churn)->Arg(1000)->Arg(100000);
+
+namespace
+{
+	/**
+	* A zone holding range(1) long respawn timers (10s..60s), range(0) when not given, which repeatedly loads and
+	* unloads range(0) short buff expiries (16ms..5s). Every short timer is due before the existing ones, so a one by one push sifts it most of
+	* the way up the heap. The manager is reused across iterations so slot storage is warm and only queue work is timed.
+	*/
+	struct ZoneLoad
+	{
+		ScheduleTimer timer_manager;
+		std::vector<TimerHandle> existing;
+		std::vector<TimerHandle> handles;
+		std::vector<TimerParams> params;
+		std::mt19937 rng{ 999 };
+		std::uniform_int_distribution<int> rate{ kFrameMs, 5000 };
+		int64_t fired{ 0 };
+
+		explicit ZoneLoad(ETimerQueueType queue_type, const bench::State& state)
+			: timer_manager(queue_type)
+			, handles(static_cast<size_t>(state.range(0)))
+			, params(static_cast<size_t>(state.range(0)))
+		{
+			NextFrame(timer_manager, kFrameMs);
+			const int64_t existing_count = state.range(1) > 0 ? state.range(1) : state.range(0);
+			PopulateTimers(timer_manager, existing, existing_count, 10000, 60000, false, fired);
+		}
+
+		void MakeParams()
+		{
+			for (size_t i = 0; i < params.size(); ++i)
+			{
+				params[i].handle = &handles[i];
+				params[i].timer_cb = [this]() { ++fired; };
+				params[i].rate_ms = rate(rng);
+			}
+		}
+	};
+}
+
+/** Adds range(0) short timers to a manager holding range(0) long ones, one SetTimer call each. */
+template <ETimerQueueType kQueueType>
+void BM_ScheduleTimer_SetTimerLoop(bench::State& state)
+{
+	ZoneLoad zone(kQueueType, state);
+	while (state.KeepRunning())
+	{
+		state.PauseTiming();
+		zone.timer_manager.ClearTimers(zone.handles);
+		zone.MakeParams();
+		state.ResumeTiming();
+
+		for (auto& p : zone.params)
+		{
+			zone.timer_manager.SetTimer(*p.handle, std::move(p.timer_cb), p.rate_ms, p.loop, p.first_delay_ms);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_SetTimerLoop, ETimerQueueType::BINARY_HEAP)->Arg(10000)->Arg(100000)->Args({ 10000, 100000 });
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_SetTimerLoop, ETimerQueueType::TIMING_WHEEL)->Arg(10000)->Arg(100000);
+
+/** Same as SetTimerLoop with a single SetTimers call. */
+template <ETimerQueueType kQueueType>
+void BM_ScheduleTimer_SetTimers(bench::State& state)
+{
+	ZoneLoad zone(kQueueType, state);
+	while (state.KeepRunning())
+	{
+		state.PauseTiming();
+		zone.timer_manager.ClearTimers(zone.handles);
+		zone.MakeParams();
+		state.ResumeTiming();
+
+		zone.timer_manager.SetTimers(zone.params);
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_SetTimers, ETimerQueueType::BINARY_HEAP)->Arg(10000)->Arg(100000)->Args({ 10000, 100000 });
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_SetTimers, ETimerQueueType::TIMING_WHEEL)->Arg(10000)->Arg(100000);
+
+/** Unloads the range(0) short timers again, one ClearTimer call each. */
+template <ETimerQueueType kQueueType>
+void BM_ScheduleTimer_ClearTimerLoop(bench::State& state)
+{
+	ZoneLoad zone(kQueueType, state);
+	while (state.KeepRunning())
+	{
+		state.PauseTiming();
+		zone.MakeParams();
+		zone.timer_manager.SetTimers(zone.params);
+		state.ResumeTiming();
+
+		for (auto& handle : zone.handles)
+		{
+			zone.timer_manager.ClearTimer(handle);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_ClearTimerLoop, ETimerQueueType::BINARY_HEAP)->Arg(10000)->Arg(100000);
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_ClearTimerLoop, ETimerQueueType::TIMING_WHEEL)->Arg(10000)->Arg(100000);
+
+/** Same as ClearTimerLoop with a single ClearTimers call. */
+template <ETimerQueueType kQueueType>
+void BM_ScheduleTimer_ClearTimers(bench::State& state)
+{
+	ZoneLoad zone(kQueueType, state);
+	while (state.KeepRunning())
+	{
+		state.PauseTiming();
+		zone.MakeParams();
+		zone.timer_manager.SetTimers(zone.params);
+		state.ResumeTiming();
+
+		zone.timer_manager.ClearTimers(zone.handles);
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_ClearTimers, ETimerQueueType::BINARY_HEAP)->Arg(10000)->Arg(100000);
+CETUS_BENCHMARK_TEMPLATE(BM_ScheduleTimer_ClearTimers, ETimerQueueType::TIMING_WHEEL)->Arg(10000)->Arg(100000);
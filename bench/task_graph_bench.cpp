@@ -0,0 +1,99 @@
+#include "benchmark.h"
+#include "thread/task_graph.hpp"
+
+#include <cmath>
+
+using namespace terra;
+
+namespace
+{
+	/** Stand-in for one system's update, a few microseconds of math. */
+	void SystemWork(float& value)
+	{
+		for (int i = 0; i < 512; ++i)
+		{
+			value = std::sqrt(value * value + 1.0f) * 0.999f;
+		}
+	}
+
+	/**
+	* Frame shaped graph of range(0) systems: four chains of stages (like physics, AOI, network sync) with a few
+	* cross edges between neighbouring chains.
+	*/
+	void BuildFrameGraph(TaskGraph& graph, std::vector<float>& values, int64_t count)
+	{
+		values.assign(static_cast<size_t>(count), 1.0f);
+		for (int64_t i = 0; i < count; ++i)
+		{
+			float* value = &values[static_cast<size_t>(i)];
+			graph.addNode("system" + std::to_string(i), [value]() { SystemWork(*value); });
+		}
+		const int64_t chains = 4;
+		for (int64_t i = chains; i < count; ++i)
+		{
+			graph.addEdge(static_cast<TaskGraph::NodeId>(i - chains), static_cast<TaskGraph::NodeId>(i));
+			if (i % 3 == 0)
+			{
+				graph.addEdge(static_cast<TaskGraph::NodeId>(i - chains + 1), static_cast<TaskGraph::NodeId>(i));
+			}
+		}
+	}
+}
+
+/** Baseline for BM_TaskGraph_Run: the same systems called in order on one thread. */
+void BM_TaskGraph_Serial(bench::State& state)
+{
+	std::vector<float> values(static_cast<size_t>(state.range(0)), 1.0f);
+	while (state.KeepRunning())
+	{
+		for (auto& value : values)
+		{
+			SystemWork(value);
+		}
+	}
+	bench::DoNotOptimize(values[0]);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+CETUS_BENCHMARK(BM_TaskGraph_Serial)->Arg(16)->Arg(256);
+
+/** One frame per iteration, items are nodes. allocs/iter should stay 0. */
+void BM_TaskGraph_Run(bench::State& state)
+{
+	ThreadPool pool;
+	TaskGraph graph(pool);
+	std::vector<float> values;
+	BuildFrameGraph(graph, values, state.range(0));
+	graph.run();
+	while (state.KeepRunning())
+	{
+		graph.run();
+	}
+	bench::DoNotOptimize(values[0]);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+	state.SetLabel("critical path " + std::to_string(graph.criticalPath().size()) + " nodes, "
+		+ std::to_string(graph.criticalPathNs() / 1000) + "us of " + std::to_string(graph.frameNs() / 1000) + "us");
+}
+CETUS_BENCHMARK(BM_TaskGraph_Run)->Arg(16)->Arg(256);
+
+/** Scheduling overhead alone: a graph of empty nodes. */
+void BM_TaskGraph_EmptyNodes(bench::State& state)
+{
+	ThreadPool pool;
+	TaskGraph graph(pool);
+	const int64_t count = state.range(0);
+	for (int64_t i = 0; i < count; ++i)
+	{
+		graph.addNode("empty", []() {});
+		if (i >= 4)
+		{
+			graph.addEdge(static_cast<TaskGraph::NodeId>(i - 4), static_cast<TaskGraph::NodeId>(i));
+		}
+	}
+	graph.run();
+	while (state.KeepRunning())
+	{
+		graph.run();
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+CETUS_BENCHMARK(BM_TaskGraph_EmptyNodes)->Arg(16)->Arg(256);
@@ -0,0 +1,275 @@
+#include "benchmark.h"
+#include "thread/thread_pool.hpp"
+
+using namespace terra;
+
+/** submit() then get() of one empty task, the full round trip through the pool. */
+void BM_ThreadPool_SubmitGet(bench::State& state)
+{
+	ThreadPool pool(static_cast<uint32_t>(state.range(0)));
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		sum += pool.submit([]() { return 1; }).get();
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations());
+}
+CETUS_BENCHMARK(BM_ThreadPool_SubmitGet)->Arg(1)->Arg(4);
+
+/** Submits range(1) small tasks before waiting on any, items are tasks. */
+void BM_ThreadPool_SubmitBatch(bench::State& state)
+{
+	ThreadPool pool(static_cast<uint32_t>(state.range(0)));
+	const int64_t batch = state.range(1);
+	std::vector<ThreadPool::TaskFuture<int64_t>> futures;
+	futures.reserve(static_cast<size_t>(batch));
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		for (int64_t i = 0; i < batch; ++i)
+		{
+			futures.push_back(pool.submit([i]() { return i; }));
+		}
+		for (auto& future : futures)
+		{
+			sum += future.get();
+		}
+		futures.clear();
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations() * batch);
+}
+CETUS_BENCHMARK(BM_ThreadPool_SubmitBatch)->Args({ 1, 1000 })->Args({ 4, 1000 });
+
+/** submitPooled() then get(), the allocation free counterpart of BM_ThreadPool_SubmitGet. */
+void BM_ThreadPool_SubmitPooledGet(bench::State& state)
+{
+	ThreadPool pool(static_cast<uint32_t>(state.range(0)));
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		sum += pool.submitPooled([]() { return 1; }).get();
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations());
+}
+CETUS_BENCHMARK(BM_ThreadPool_SubmitPooledGet)->Arg(1)->Arg(4);
+
+void BM_ThreadPool_SubmitPooledBatch(bench::State& state)
+{
+	ThreadPool pool(static_cast<uint32_t>(state.range(0)));
+	const int64_t batch = state.range(1);
+	std::vector<ThreadPool::PooledTaskFuture<int64_t>> futures;
+	futures.reserve(static_cast<size_t>(batch));
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		for (int64_t i = 0; i < batch; ++i)
+		{
+			futures.push_back(pool.submitPooled([i]() { return i; }));
+		}
+		for (auto& future : futures)
+		{
+			sum += future.get();
+		}
+		futures.clear();
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations() * batch);
+}
+CETUS_BENCHMARK(BM_ThreadPool_SubmitPooledBatch)->Args({ 1, 1000 })->Args({ 4, 1000 });
+
+/** post() of range(1) jobs that count down a latch, allocs/iter stays 0 once the task slots are warm. */
+void BM_ThreadPool_PostBatch(bench::State& state)
+{
+	ThreadPool pool(static_cast<uint32_t>(state.range(0)));
+	const int64_t batch = state.range(1);
+	std::atomic<int64_t> remaining{ 0 };
+	while (state.KeepRunning())
+	{
+		remaining.store(batch, std::memory_order_relaxed);
+		for (int64_t i = 0; i < batch; ++i)
+		{
+			pool.post([&remaining]() { remaining.fetch_sub(1, std::memory_order_acq_rel); });
+		}
+		while (remaining.load(std::memory_order_acquire) > 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * batch);
+}
+CETUS_BENCHMARK(BM_ThreadPool_PostBatch)->Args({ 1, 1000 })->Args({ 4, 1000 });
+
+/** A chain of range(1) dependent jobs where the caller blocks on every step, the baseline for ThenChain. */
+void BM_ThreadPool_GetChain(bench::State& state)
+{
+	ThreadPool pool(static_cast<uint32_t>(state.range(0)));
+	const int64_t length = state.range(1);
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		int64_t value = 0;
+		for (int64_t i = 0; i < length; ++i)
+		{
+			value = pool.submit([value]() { return value + 1; }).get();
+		}
+		sum += value;
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations() * length);
+}
+CETUS_BENCHMARK(BM_ThreadPool_GetChain)->Args({ 1, 16 })->Args({ 4, 16 });
+
+/** The same chain built with then(), the caller only blocks on the last step. */
+void BM_ThreadPool_ThenChain(bench::State& state)
+{
+	ThreadPool pool(static_cast<uint32_t>(state.range(0)));
+	const int64_t length = state.range(1);
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		auto future = pool.submit([]() { return int64_t{ 1 }; });
+		for (int64_t i = 1; i < length; ++i)
+		{
+			future = future.then([](int64_t value) { return value + 1; });
+		}
+		sum += future.get();
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations() * length);
+}
+CETUS_BENCHMARK(BM_ThreadPool_ThenChain)->Args({ 1, 16 })->Args({ 4, 16 });
+
+/** range(1) jobs gathered with when_all(), compare with BM_ThreadPool_SubmitBatch which calls get() on each. */
+void BM_ThreadPool_WhenAll(bench::State& state)
+{
+	ThreadPool pool(static_cast<uint32_t>(state.range(0)));
+	const int64_t batch = state.range(1);
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		std::vector<ThreadPool::TaskFuture<int64_t>> futures;
+		futures.reserve(static_cast<size_t>(batch));
+		for (int64_t i = 0; i < batch; ++i)
+		{
+			futures.push_back(pool.submit([i]() { return i; }));
+		}
+		for (int64_t value : when_all(std::move(futures)).get())
+		{
+			sum += value;
+		}
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations() * batch);
+}
+CETUS_BENCHMARK(BM_ThreadPool_WhenAll)->Args({ 1, 1000 })->Args({ 4, 1000 });
+
+/**
+* Latency of one small job queued behind range(1) bulk jobs of 20us or more on a one worker pool, the backlog is
+* topped up before every probe. With range(0) 1 the bulk jobs are background and the probe high priority, with 0
+* both are normal, the single FIFO of before.
+*/
+void BM_ThreadPool_PriorityLatency(bench::State& state)
+{
+	ThreadPool pool(1);
+	const bool use_lanes = state.range(0) != 0;
+	const int64_t backlog = state.range(1);
+	std::atomic<int64_t> queued{ 0 };
+	// sleeps rather than spins, so the waiting caller gets a CPU on small machines
+	auto bulk_job = [&queued]() {
+		std::this_thread::sleep_for(std::chrono::microseconds(20));
+		queued.fetch_sub(1, std::memory_order_acq_rel);
+	};
+	while (state.KeepRunning())
+	{
+		for (int64_t i = queued.load(std::memory_order_acquire); i < backlog; ++i)
+		{
+			queued.fetch_add(1, std::memory_order_acq_rel);
+			pool.postWith({ use_lanes ? TaskPriority::Background : TaskPriority::Normal }, bulk_job);
+		}
+		pool.submitPooledWith({ use_lanes ? TaskPriority::High : TaskPriority::Normal }, []() {}).get();
+	}
+	while (queued.load(std::memory_order_acquire) > 0)
+	{
+		std::this_thread::yield();
+	}
+	state.SetLabel(use_lanes ? "high behind background" : "normal behind normal");
+}
+CETUS_BENCHMARK(BM_ThreadPool_PriorityLatency)->Args({ 0, 100 })->Args({ 1, 100 });
+
+namespace
+{
+	/** About 100ns of arithmetic the optimizer can't drop, the size of a small job. */
+	int64_t SmallJob(int64_t seed)
+	{
+		int64_t value = seed;
+		for (int i = 0; i < 64; ++i)
+		{
+			value = value * 6364136223846793005LL + 1442695040888963407LL;
+		}
+		return value;
+	}
+
+	/** Worker counts 1, 2, 4, ... up to hardware_concurrency, with the given extra args. */
+	void AddThreadCounts(bench::Benchmark* benchmark, std::vector<int64_t> extra_args)
+	{
+		const int64_t max_threads = std::max<int64_t>(std::thread::hardware_concurrency(), 1);
+		for (int64_t threads = 1;; threads = std::min(threads * 2, max_threads))
+		{
+			std::vector<int64_t> args{ threads };
+			args.insert(args.end(), extra_args.begin(), extra_args.end());
+			benchmark->Args(args);
+			if (threads == max_threads)
+			{
+				break;
+			}
+		}
+	}
+}
+
+/**
+* range(2) producer threads each submit range(1) small jobs to a pool of range(0) workers, then wait for them.
+* Items are jobs, a pool that scales keeps items/s growing with the worker count.
+*/
+void BM_ThreadPool_Scaling(bench::State& state)
+{
+	ThreadPool pool(static_cast<uint32_t>(state.range(0)));
+	const int64_t jobs = state.range(1);
+	const int64_t producer_count = state.range(2);
+	std::atomic<int64_t> sum{ 0 };
+	while (state.KeepRunning())
+	{
+		auto produce = [&pool, &sum, jobs]() {
+			std::vector<ThreadPool::TaskFuture<int64_t>> futures;
+			futures.reserve(static_cast<size_t>(jobs));
+			for (int64_t i = 0; i < jobs; ++i)
+			{
+				futures.push_back(pool.submit(SmallJob, i));
+			}
+			int64_t local = 0;
+			for (auto& future : futures)
+			{
+				local += future.get();
+			}
+			sum += local;
+		};
+		std::vector<std::thread> producers;
+		for (int64_t p = 1; p < producer_count; ++p)
+		{
+			producers.emplace_back(produce);
+		}
+		produce();
+		for (auto& producer : producers)
+		{
+			producer.join();
+		}
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations() * jobs * producer_count);
+}
+CETUS_BENCHMARK(BM_ThreadPool_Scaling)->Apply([](bench::Benchmark* benchmark) {
+	AddThreadCounts(benchmark, { 10000, 1 });
+	AddThreadCounts(benchmark, { 10000, 4 });
+});
@@ -0,0 +1,174 @@
+#include "benchmark.h"
+#include "thread/thread_safe_queue.hpp"
+
+#include <thread>
+#include <vector>
+
+using namespace terra;
+
+namespace
+{
+	/** range(0) of the benchmarks below picks one of these. */
+	QueueWaitPolicy GetPolicy(int64_t index, const char*& name)
+	{
+		switch (index)
+		{
+		case 0:
+			name = "blocking";
+			return QueueWaitPolicy::blocking();
+		case 1:
+			name = "yielding";
+			return QueueWaitPolicy::yielding();
+		case 2:
+			name = "spin-yield-park";
+			return QueueWaitPolicy{};
+		default:
+			name = "spinning";
+			return QueueWaitPolicy::spinning();
+		}
+	}
+
+	void AddPolicies(bench::Benchmark* benchmark)
+	{
+		for (int64_t policy = 0; policy < 4; ++policy)
+		{
+			benchmark->Arg(policy);
+		}
+	}
+}
+
+/**
+* One item to an echo thread and back through two queues, time is a round trip: two wake-ups when the waiters
+* park, none when they catch the item while spinning or yielding.
+*/
+void BM_ThreadSafeQueue_PingPong(bench::State& state)
+{
+	const char* name = nullptr;
+	const QueueWaitPolicy policy = GetPolicy(state.range(0), name);
+	ThreadSafeQueue<int64_t> requests(policy);
+	ThreadSafeQueue<int64_t> replies(policy);
+	std::thread echo([&requests, &replies]() {
+		int64_t value = 0;
+		while (requests.waitPop(value))
+		{
+			replies.push(value + 1);
+		}
+	});
+	int64_t value = 0;
+	while (state.KeepRunning())
+	{
+		requests.push(value);
+		replies.waitPop(value);
+	}
+	requests.invalidate();
+	echo.join();
+	bench::DoNotOptimize(value);
+	state.SetItemsProcessed(state.iterations());
+	state.SetLabel(name);
+}
+CETUS_BENCHMARK(BM_ThreadSafeQueue_PingPong)->Apply(AddPolicies);
+
+/** A producer thread streams range(1) items to the calling thread, items are items received. */
+void BM_ThreadSafeQueue_Stream(bench::State& state)
+{
+	const char* name = nullptr;
+	const QueueWaitPolicy policy = GetPolicy(state.range(0), name);
+	const int64_t count = state.range(1);
+	ThreadSafeQueue<int64_t> queue(policy);
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		std::thread producer([&queue, count]() {
+			for (int64_t i = 0; i < count; ++i)
+			{
+				queue.push(i);
+			}
+		});
+		int64_t value = 0;
+		for (int64_t i = 0; i < count; ++i)
+		{
+			queue.waitPop(value);
+			sum += value;
+		}
+		producer.join();
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations() * count);
+	state.SetLabel(name);
+}
+CETUS_BENCHMARK(BM_ThreadSafeQueue_Stream)->Args({ 0, 100000 })->Args({ 1, 100000 })->Args({ 2, 100000 })->Args({ 3, 100000 });
+
+/**
+* Push range(0) items and pop them again on one thread, with push/tryPop for a batch of 1 and pushBulk/tryPopBulk
+* otherwise. Shows the lock round trips a batch saves, without scheduling noise.
+*/
+void BM_ThreadSafeQueue_BatchSingleThread(bench::State& state)
+{
+	const std::size_t batch = static_cast<std::size_t>(state.range(0));
+	ThreadSafeQueue<int64_t> queue;
+	std::vector<int64_t> items(batch, 1);
+	std::vector<int64_t> popped(batch);
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		if (batch == 1)
+		{
+			queue.push(items[0]);
+			queue.tryPop(popped[0]);
+		}
+		else
+		{
+			queue.pushBulk(items.begin(), items.end());
+			queue.tryPopBulk(popped.begin(), batch);
+		}
+		sum += popped[0];
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+CETUS_BENCHMARK(BM_ThreadSafeQueue_BatchSingleThread)->Arg(1)->Arg(16)->Arg(256);
+
+/**
+* A producer thread pushes 64k items in batches of range(0), the calling thread waits for one and takes up to a
+* batch with it.
+*/
+void BM_ThreadSafeQueue_BatchStream(bench::State& state)
+{
+	const std::size_t batch = static_cast<std::size_t>(state.range(0));
+	const std::size_t count = 1 << 16;
+	ThreadSafeQueue<int64_t> queue;
+	std::vector<int64_t> popped(batch);
+	int64_t sum = 0;
+	while (state.KeepRunning())
+	{
+		std::thread producer([&queue, batch, count]() {
+			std::vector<int64_t> items(batch, 1);
+			for (std::size_t pushed = 0; pushed < count; pushed += batch)
+			{
+				if (batch == 1)
+				{
+					queue.push(items[0]);
+				}
+				else
+				{
+					queue.pushBulk(items.begin(), items.end());
+				}
+			}
+		});
+		std::size_t received = 0;
+		while (received < count)
+		{
+			queue.waitPop(popped[0]);
+			const std::size_t more = batch > 1 ? queue.tryPopBulk(popped.begin() + 1, batch - 1) : 0;
+			for (std::size_t i = 0; i <= more; ++i)
+			{
+				sum += popped[i];
+			}
+			received += 1 + more;
+		}
+		producer.join();
+	}
+	bench::DoNotOptimize(sum);
+	state.SetItemsProcessed(state.iterations() * count);
+}
+CETUS_BENCHMARK(BM_ThreadSafeQueue_BatchStream)->Arg(1)->Arg(16)->Arg(256);
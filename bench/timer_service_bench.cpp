@@ -0,0 +1,130 @@
+#include "benchmark.h"
+#include "timer/timer_service.h"
+
+#include <algorithm>
+
+using namespace terra;
+
+namespace
+{
+	void WaitFired(const std::atomic<int64_t>& fired, int64_t expected)
+	{
+		while (fired.load(std::memory_order_acquire) < expected)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	std::string MakeLatencyLabel(std::vector<int64_t>& lateness_us)
+	{
+		if (lateness_us.empty())
+		{
+			return std::string();
+		}
+		std::sort(lateness_us.begin(), lateness_us.end());
+		auto percentile = [&lateness_us](double p) { return lateness_us[static_cast<size_t>(p * (lateness_us.size() - 1))]; };
+		return "late p50 " + std::to_string(percentile(0.5)) + "us p99 " + std::to_string(percentile(0.99))
+			+ "us max " + std::to_string(lateness_us.back()) + "us";
+	}
+}
+
+/**
+* Throughput: every iteration range(1) producer threads schedule a burst of 1ms one shot timers into range(0) shards,
+* and the iteration ends once all of them fired. Items are fired timers.
+*/
+void BM_TimerService_Throughput(bench::State& state)
+{
+	constexpr int64_t kBurst = 20000;
+	const int shard_count = static_cast<int>(state.range(0));
+	const int producer_count = static_cast<int>(state.range(1));
+	const int64_t per_producer = kBurst / producer_count;
+	std::atomic<int64_t> fired{ 0 };
+	TimerService timer_service(shard_count);
+
+	int64_t scheduled = 0;
+	while (state.KeepRunning())
+	{
+		std::vector<std::thread> producers;
+		for (int p = 0; p < producer_count; ++p)
+		{
+			producers.emplace_back([&]() {
+				for (int64_t i = 0; i < per_producer; ++i)
+				{
+					timer_service.SetTimer([&fired]() { fired.fetch_add(1, std::memory_order_release); }, 1, false);
+				}
+			});
+		}
+		for (auto& producer : producers)
+		{
+			producer.join();
+		}
+		scheduled += per_producer * producer_count;
+		WaitFired(fired, scheduled);
+	}
+	state.SetItemsProcessed(scheduled);
+}
+CETUS_BENCHMARK(BM_TimerService_Throughput)->Args({ 1, 1 })->Args({ 2, 1 })->Args({ 4, 1 })->Args({ 8, 1 })
+	->Args({ 1, 4 })->Args({ 2, 4 })->Args({ 4, 4 })->Args({ 8, 4 });
+
+/**
+* Latency: the bench thread schedules a 5ms one shot timer every 100us into range(0) shards, the label shows how late
+* the callbacks ran compared to their due time. Callbacks run on the shard threads.
+*/
+void BM_TimerService_Latency(bench::State& state)
+{
+	using Clock = std::chrono::steady_clock;
+	const int shard_count = static_cast<int>(state.range(0));
+	constexpr int kDelayMs = 5;
+	std::atomic<int64_t> fired{ 0 };
+	std::vector<int64_t> lateness_us(static_cast<size_t>(state.iterations()));
+	TimerService timer_service(shard_count);
+
+	int64_t scheduled = 0;
+	while (state.KeepRunning())
+	{
+		const Clock::time_point due_time = Clock::now() + std::chrono::milliseconds(kDelayMs);
+		int64_t* out_lateness = &lateness_us[static_cast<size_t>(scheduled++)];
+		timer_service.SetTimer([&fired, out_lateness, due_time]() {
+			*out_lateness = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - due_time).count();
+			fired.fetch_add(1, std::memory_order_release);
+		}, kDelayMs, false);
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+	WaitFired(fired, scheduled);
+	state.SetLabel(MakeLatencyLabel(lateness_us));
+	state.SetItemsProcessed(scheduled);
+}
+CETUS_BENCHMARK(BM_TimerService_Latency)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
+
+/** Same as Latency with the callbacks posted to a TimerCallbackQueue which the bench thread drains. */
+void BM_TimerService_LatencyExecutor(bench::State& state)
+{
+	using Clock = std::chrono::steady_clock;
+	const int shard_count = static_cast<int>(state.range(0));
+	constexpr int kDelayMs = 5;
+	std::atomic<int64_t> fired{ 0 };
+	std::vector<int64_t> lateness_us(static_cast<size_t>(state.iterations()));
+	TimerCallbackQueue executor;
+	TimerService timer_service(shard_count);
+
+	int64_t scheduled = 0;
+	while (state.KeepRunning())
+	{
+		const Clock::time_point due_time = Clock::now() + std::chrono::milliseconds(kDelayMs);
+		int64_t* out_lateness = &lateness_us[static_cast<size_t>(scheduled++)];
+		timer_service.SetTimer([&fired, out_lateness, due_time]() {
+			*out_lateness = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - due_time).count();
+			fired.fetch_add(1, std::memory_order_release);
+		}, kDelayMs, false, -1, &executor);
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+		executor.Drain();
+	}
+	while (fired.load(std::memory_order_acquire) < scheduled)
+	{
+		executor.Drain();
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+	state.SetLabel(MakeLatencyLabel(lateness_us));
+	state.SetItemsProcessed(scheduled);
+}
+CETUS_BENCHMARK(BM_TimerService_LatencyExecutor)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <type_traits>
+
+namespace terra
+{
+	/**
+	* Non-owning view of a contiguous run of T, the C++14 stand-in for std::span.
+	* Use TArrayView<const T> for read-only input.
+	*/
+	template <typename T>
+	class TArrayView
+	{
+	private:
+		using NonConstType = typename std::remove_const<T>::type;
+
+		T* data_{ nullptr };
+		size_t size_{ 0 };
+
+	public:
+		TArrayView() = default;
+		TArrayView(T* data, size_t size) : data_(data), size_(size) {}
+
+		template <size_t N>
+		TArrayView(T(&data)[N]) : data_(data), size_(N) {}
+
+		TArrayView(std::vector<NonConstType>& data) : data_(data.data()), size_(data.size()) {}
+
+		template <typename U = T, typename = typename std::enable_if<std::is_const<U>::value>::type>
+		TArrayView(const std::vector<NonConstType>& data) : data_(data.data()), size_(data.size()) {}
+
+		T* data() const { return data_; }
+		size_t size() const { return size_; }
+		bool empty() const { return size_ == 0; }
+
+		T& operator[](size_t idx) const { return data_[idx]; }
+
+		T* begin() const { return data_; }
+		T* end() const { return data_ + size_; }
+	};
+}
@@ -0,0 +1,484 @@
+#pragma once
+
+#include "container/mpsc_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#endif
+
+namespace terra
+{
+	/**
+	* Template for bounded queues.
+	*
+	* This template implements a bounded queue on a power of two ring of slots, after Dmitry Vyukov's bounded MPMC
+	* queue: every slot carries a sequence number telling producers when it is free and consumers when it is
+	* filled, so producers and consumers only contend on their own position counter and never take a lock.
+	*
+	* Unlike TQueue it never allocates after construction and refuses items when full, which gives producers
+	* backpressure: TryEnqueue() fails, Enqueue() waits and EnqueueFor() gives up after a timeout. The Mode picks
+	* which side may have several threads, a single side claims its slots without compare-and-swap.
+	*
+	* Batch operations claim a run of slots with one position update.
+	*
+	* A claimed slot must be published or the queue stalls behind it, so nothing that may throw runs between the
+	* two: an item whose construction may throw is built before its slot is claimed and moved in, and an item
+	* whose hand-over to the caller may throw is moved out of its slot first. Batches of such items go one by one.
+	*
+	* @param ItemType The type of items stored in the queue, it needs not be default constructible but must be
+	*		nothrow move constructible.
+	* @param Mode The queue mode (multiple-producers, multiple-consumers by default).
+	*/
+	template <typename ItemType, EQueueMode Mode = EQueueMode::Mpmc>
+	class TBoundedQueue
+	{
+		static_assert(std::is_nothrow_move_constructible<ItemType>::value, "TBoundedQueue items must be nothrow move constructible");
+
+	public:
+		/**
+		* Constructor.
+		*
+		* @param capacity The most items the queue holds, rounded up to a power of two of at least 2.
+		*/
+		explicit TBoundedQueue(size_t capacity)
+		{
+			size_t size = 2;
+			while (size < capacity)
+			{
+				size *= 2;
+			}
+			mask_ = size - 1;
+			slots_.reset(new TSlot[size]);
+			for (size_t i = 0; i < size; ++i)
+			{
+				slots_[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		/** Destructor. */
+		~TBoundedQueue()
+		{
+			ItemType* item;
+			while ((item = PeekFilled()) != nullptr)
+			{
+				item->~ItemType();
+				ReleaseFilled();
+			}
+		}
+
+	public:
+		/**
+		* Adds an item to the queue unless it is full.
+		*
+		* @param item_data The item to add, left untouched when the queue is full.
+		* @return true if the item was added, false if the queue was full.
+		*/
+		bool TryEnqueue(const ItemType& item_data) { return TryEmplace(item_data); }
+		bool TryEnqueue(ItemType&& item_data) { return TryEmplace(std::move(item_data)); }
+
+		/**
+		* Constructs an item in the queue from args unless it is full.
+		*
+		* @return true if the item was added, false if the queue was full.
+		*/
+		template <typename... Args>
+		bool TryEmplace(Args&&... args)
+		{
+			return TryEmplaceImpl(std::is_nothrow_constructible<ItemType, Args&&...>(), std::forward<Args>(args)...);
+		}
+
+		/**
+		* Removes the oldest item unless the queue is empty.
+		*
+		* @param out_item Will hold the returned value.
+		* @return true if a value was returned, false if the queue was empty.
+		*/
+		bool TryDequeue(ItemType& out_item)
+		{
+			size_t pos;
+			if (!ClaimDequeue(1, pos))
+			{
+				return false;
+			}
+			TakeSlot(pos, out_item);
+			return true;
+		}
+
+		/**
+		* Adds up to count items from first, as many as there are free slots, keeping their order.
+		*
+		* @return The number of items added, they are moved from when the iterator dereferences to an rvalue.
+		*/
+		template <typename InputIt>
+		size_t TryEnqueueBatch(InputIt first, size_t count)
+		{
+			return TryEnqueueBatchImpl(std::is_nothrow_constructible<ItemType, decltype(*first)>(), first, count);
+		}
+
+		/**
+		* Removes up to max items, oldest first.
+		*
+		* @return The number of items written to out.
+		*/
+		template <typename OutputIt>
+		size_t TryDequeueBatch(OutputIt out, size_t max)
+		{
+			return TryDequeueBatchImpl(IsNothrowTake<decltype(*out)>(), out, max);
+		}
+
+		/** Adds an item, waiting for a free slot as long as it takes. */
+		void Enqueue(ItemType item_data)
+		{
+			TBackoff backoff;
+			while (!TryEnqueue(std::move(item_data)))
+			{
+				backoff.Pause();
+			}
+		}
+
+		/** Removes the oldest item, waiting for one as long as it takes. */
+		void Dequeue(ItemType& out_item)
+		{
+			TBackoff backoff;
+			while (!TryDequeue(out_item))
+			{
+				backoff.Pause();
+			}
+		}
+
+		/**
+		* Adds an item, waiting up to timeout for a free slot.
+		*
+		* @return true if the item was added, false if the queue stayed full.
+		*/
+		template <typename Rep, typename Period>
+		bool EnqueueFor(ItemType item_data, std::chrono::duration<Rep, Period> timeout)
+		{
+			const auto deadline = std::chrono::steady_clock::now() + timeout;
+			TBackoff backoff;
+			while (!TryEnqueue(std::move(item_data)))
+			{
+				if (std::chrono::steady_clock::now() >= deadline)
+				{
+					return false;
+				}
+				backoff.Pause();
+			}
+			return true;
+		}
+
+		/**
+		* Removes the oldest item, waiting up to timeout for one.
+		*
+		* @return true if a value was returned, false if the queue stayed empty.
+		*/
+		template <typename Rep, typename Period>
+		bool DequeueFor(ItemType& out_item, std::chrono::duration<Rep, Period> timeout)
+		{
+			const auto deadline = std::chrono::steady_clock::now() + timeout;
+			TBackoff backoff;
+			while (!TryDequeue(out_item))
+			{
+				if (std::chrono::steady_clock::now() >= deadline)
+				{
+					return false;
+				}
+				backoff.Pause();
+			}
+			return true;
+		}
+
+		/** The most items the queue holds. */
+		size_t Capacity() const { return mask_ + 1; }
+
+		/** Number of items, only a hint while other threads use the queue. */
+		size_t SizeApprox() const
+		{
+			const size_t dequeue_pos = dequeue_pos_.load(std::memory_order_relaxed);
+			const size_t enqueue_pos = enqueue_pos_.load(std::memory_order_relaxed);
+			return enqueue_pos > dequeue_pos ? std::min(enqueue_pos - dequeue_pos, Capacity()) : 0;
+		}
+
+		/** Checks whether the queue is empty, only a hint while other threads use the queue. */
+		bool IsEmpty() const { return SizeApprox() == 0; }
+
+	private:
+		static constexpr bool kMultiProducer = Mode != EQueueMode::Spsc;
+		static constexpr bool kMultiConsumer = Mode == EQueueMode::Mpmc;
+
+		/** Whether handing an item over to Out can't throw. */
+		template <typename Out>
+		using IsNothrowTake = std::integral_constant<bool, noexcept(std::declval<Out>() = std::declval<ItemType&&>())>;
+
+		/** Structure for the ring slots. */
+		struct TSlot
+		{
+			/**
+			* pos when free for the producer of position pos, pos + 1 once that producer filled it, pos + capacity
+			* once the consumer emptied it for the next lap.
+			*/
+			std::atomic<size_t> sequence;
+
+			typename std::aligned_storage<sizeof(ItemType), alignof(ItemType)>::type storage;
+
+			ItemType* Item() { return reinterpret_cast<ItemType*>(&storage); }
+		};
+
+		/** Waits spin, then yield, then sleep with growing naps, so a stalled peer costs little CPU. */
+		class TBackoff
+		{
+		public:
+			void Pause()
+			{
+				static const bool can_spin = std::thread::hardware_concurrency() > 1;
+				if (round_ < kSpinRounds && can_spin)
+				{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+					_mm_pause();
+#endif
+				}
+				else if (round_ < kSpinRounds + kYieldRounds)
+				{
+					std::this_thread::yield();
+				}
+				else
+				{
+					std::this_thread::sleep_for(std::chrono::microseconds(nap_us_));
+					nap_us_ = std::min<uint32_t>(nap_us_ * 2, 1000);
+				}
+				++round_;
+			}
+
+		private:
+			static constexpr uint32_t kSpinRounds = 64;
+			static constexpr uint32_t kYieldRounds = 64;
+
+			uint32_t round_{ 0 };
+			uint32_t nap_us_{ 10 };
+		};
+
+		/**
+		* Claims up to count consecutive free slots starting at out_pos.
+		* A run is claimable while every slot in it is free for this lap: no other producer writes them before the
+		* position moves past them, so checking them first and then moving the position is safe.
+		*/
+		size_t ClaimEnqueue(size_t count, size_t& out_pos)
+		{
+			size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				size_t ready = 0;
+				while (ready < count && slots_[(pos + ready) & mask_].sequence.load(std::memory_order_acquire) == pos + ready)
+				{
+					++ready;
+				}
+				if (ready == 0)
+				{
+					const size_t sequence = slots_[pos & mask_].sequence.load(std::memory_order_acquire);
+					// behind pos: the slot still holds last lap's item, the queue is full
+					if (static_cast<std::ptrdiff_t>(sequence - pos) < 0 || !kMultiProducer)
+					{
+						return 0;
+					}
+					// ahead of pos: another producer took it, catch up
+					pos = enqueue_pos_.load(std::memory_order_relaxed);
+					continue;
+				}
+				if (!kMultiProducer)
+				{
+					enqueue_pos_.store(pos + ready, std::memory_order_relaxed);
+				}
+				else if (!enqueue_pos_.compare_exchange_weak(pos, pos + ready, std::memory_order_relaxed))
+				{
+					continue;
+				}
+				out_pos = pos;
+				return ready;
+			}
+		}
+
+		/** Claims up to count consecutive filled slots starting at out_pos, the mirror of ClaimEnqueue(). */
+		size_t ClaimDequeue(size_t count, size_t& out_pos)
+		{
+			size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				size_t ready = 0;
+				while (ready < count && slots_[(pos + ready) & mask_].sequence.load(std::memory_order_acquire) == pos + ready + 1)
+				{
+					++ready;
+				}
+				if (ready == 0)
+				{
+					const size_t sequence = slots_[pos & mask_].sequence.load(std::memory_order_acquire);
+					// not filled for this lap yet, the queue is empty
+					if (static_cast<std::ptrdiff_t>(sequence - (pos + 1)) < 0 || !kMultiConsumer)
+					{
+						return 0;
+					}
+					pos = dequeue_pos_.load(std::memory_order_relaxed);
+					continue;
+				}
+				if (!kMultiConsumer)
+				{
+					dequeue_pos_.store(pos + ready, std::memory_order_relaxed);
+				}
+				else if (!dequeue_pos_.compare_exchange_weak(pos, pos + ready, std::memory_order_relaxed))
+				{
+					continue;
+				}
+				out_pos = pos;
+				return ready;
+			}
+		}
+
+		template <typename... Args>
+		bool TryEmplaceImpl(std::true_type, Args&&... args)
+		{
+			size_t pos;
+			if (!ClaimEnqueue(1, pos))
+			{
+				return false;
+			}
+			TSlot& slot = slots_[pos & mask_];
+			new (slot.Item()) ItemType(std::forward<Args>(args)...);
+			slot.sequence.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		/** Builds the item before claiming its slot, a throwing constructor then leaves the queue as it was. */
+		template <typename... Args>
+		bool TryEmplaceImpl(std::false_type, Args&&... args)
+		{
+			ItemType item(std::forward<Args>(args)...);
+			return TryEmplaceImpl(std::true_type(), std::move(item));
+		}
+
+		template <typename InputIt>
+		size_t TryEnqueueBatchImpl(std::true_type, InputIt first, size_t count)
+		{
+			size_t pos;
+			const size_t claimed = ClaimEnqueue(count, pos);
+			for (size_t i = 0; i < claimed; ++i, ++first)
+			{
+				TSlot& slot = slots_[(pos + i) & mask_];
+				new (slot.Item()) ItemType(*first);
+				slot.sequence.store(pos + i + 1, std::memory_order_release);
+			}
+			return claimed;
+		}
+
+		/** The items could only be built ahead for the whole run by allocating, so they go one by one. */
+		template <typename InputIt>
+		size_t TryEnqueueBatchImpl(std::false_type, InputIt first, size_t count)
+		{
+			size_t added = 0;
+			for (; added < count && TryEmplace(*first); ++added, ++first)
+			{
+			}
+			return added;
+		}
+
+		template <typename OutputIt>
+		size_t TryDequeueBatchImpl(std::true_type, OutputIt out, size_t max)
+		{
+			size_t pos;
+			const size_t claimed = ClaimDequeue(max, pos);
+			for (size_t i = 0; i < claimed; ++i, ++out)
+			{
+				TakeSlot(pos + i, *out);
+			}
+			return claimed;
+		}
+
+		/** A throw while handing over an item would strand the rest of a claimed run, so they go one by one. */
+		template <typename OutputIt>
+		size_t TryDequeueBatchImpl(std::false_type, OutputIt out, size_t max)
+		{
+			size_t taken = 0;
+			size_t pos;
+			for (; taken < max && ClaimDequeue(1, pos); ++taken, ++out)
+			{
+				TakeSlot(pos, *out);
+			}
+			return taken;
+		}
+
+		/** Moves the item of a claimed filled slot out and frees the slot for the next lap. */
+		template <typename Out>
+		void TakeSlot(size_t pos, Out&& out_item)
+		{
+			TakeSlotImpl(IsNothrowTake<Out&&>(), pos, std::forward<Out>(out_item));
+		}
+
+		template <typename Out>
+		void TakeSlotImpl(std::true_type, size_t pos, Out&& out_item)
+		{
+			TSlot& slot = slots_[pos & mask_];
+			ItemType* item = slot.Item();
+			out_item = std::move(*item);
+			item->~ItemType();
+			slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+		}
+
+		/** Frees the slot before the hand-over, if that throws the item is lost but the queue keeps going. */
+		template <typename Out>
+		void TakeSlotImpl(std::false_type, size_t pos, Out&& out_item)
+		{
+			TSlot& slot = slots_[pos & mask_];
+			ItemType* slot_item = slot.Item();
+			ItemType item(std::move(*slot_item));
+			slot_item->~ItemType();
+			slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+			out_item = std::move(item);
+		}
+
+		/** Destructor helpers, single-threaded. */
+		ItemType* PeekFilled()
+		{
+			const size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+			TSlot& slot = slots_[pos & mask_];
+			return slot.sequence.load(std::memory_order_relaxed) == pos + 1 ? slot.Item() : nullptr;
+		}
+
+		void ReleaseFilled()
+		{
+			const size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+			slots_[pos & mask_].sequence.store(pos + mask_ + 1, std::memory_order_relaxed);
+			dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+		}
+
+		std::unique_ptr<TSlot[]> slots_;
+		size_t mask_{ 0 };
+
+		char pad_before_enqueue_pos_[kQueueCacheLineSize];
+
+		/** Next position to fill, shared by the producers. */
+		std::atomic<size_t> enqueue_pos_{ 0 };
+
+		char pad_before_dequeue_pos_[kQueueCacheLineSize];
+
+		/** Next position to empty, shared by the consumers. */
+		std::atomic<size_t> dequeue_pos_{ 0 };
+
+		char pad_after_dequeue_pos_[kQueueCacheLineSize];
+
+	private:
+		/** Hidden copy constructor. */
+		TBoundedQueue(const TBoundedQueue&) = delete;
+
+		/** Hidden assignment operator. */
+		TBoundedQueue& operator=(const TBoundedQueue&) = delete;
+	};
+}
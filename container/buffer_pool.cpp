@@ -0,0 +1,231 @@
+#include "buffer_pool.h"
+using namespace terra;
+
+static_assert((BufferPool::kMinBlockSize << (BufferPool::kClassCount - 1)) == BufferPool::kMaxBlockSize, "size classes must end at kMaxBlockSize");
+
+BufferPool::BufferPool(const BufferPoolOptions& options)
+	: options_(options)
+	, last_trim_time_(std::chrono::steady_clock::now())
+{
+}
+
+BufferPool::~BufferPool()
+{
+	for (SizeClass& size_class : classes_)
+	{
+		DeleteBlocks(size_class.free);
+		size_class.free = nullptr;
+	}
+}
+
+BufferPool& BufferPool::Default()
+{
+	static BufferPool* pool = new BufferPool();
+	return *pool;
+}
+
+int BufferPool::ClassIndex(uint32_t size)
+{
+	if (size > kMaxBlockSize)
+	{
+		return -1;
+	}
+	if (size <= kMinBlockSize)
+	{
+		return 0;
+	}
+	return static_cast<int>(FloorLog2_64(RoundUpExp2(size)) - FloorLog2_64(kMinBlockSize));
+}
+
+uint32_t BufferPool::BlockSizeFor(uint32_t size)
+{
+	const int index = ClassIndex(size);
+	return index >= 0 ? ClassBlockSize(index) : size;
+}
+
+char* BufferPool::Alloc(uint32_t size)
+{
+	Expects(size > 0);
+	const int index = ClassIndex(size);
+	const uint32_t block_size = index >= 0 ? ClassBlockSize(index) : size;
+	char* data = nullptr;
+	FreeBlock* released = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		++alloc_count_;
+		bytes_in_use_ += block_size;
+		bytes_requested_ += size;
+		if (index >= 0)
+		{
+			SizeClass& size_class = classes_[index];
+			size_class.peak_in_use = std::max(size_class.peak_in_use, ++size_class.in_use);
+			if (size_class.free)
+			{
+				FreeBlock* block = size_class.free;
+				size_class.free = block->next;
+				--size_class.cached;
+				bytes_cached_ -= block_size;
+				data = reinterpret_cast<char*>(block);
+			}
+		}
+		if (!data)
+		{
+			++heap_alloc_count_;
+			peak_bytes_reserved_ = std::max(peak_bytes_reserved_, bytes_in_use_ + bytes_cached_);
+		}
+		released = MaybeTrimLocked();
+	}
+	DeleteBlocks(released);
+	if (data)
+	{
+		return data;
+	}
+	try
+	{
+		return new char[block_size];
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		bytes_in_use_ -= block_size;
+		bytes_requested_ -= size;
+		if (index >= 0)
+		{
+			--classes_[index].in_use;
+		}
+		throw;
+	}
+}
+
+void BufferPool::Free(char* data, uint32_t size)
+{
+	if (!data)
+	{
+		return;
+	}
+	const int index = ClassIndex(size);
+	const uint32_t block_size = index >= 0 ? ClassBlockSize(index) : size;
+	FreeBlock* released = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		bytes_in_use_ -= block_size;
+		bytes_requested_ -= size;
+		if (index >= 0)
+		{
+			SizeClass& size_class = classes_[index];
+			--size_class.in_use;
+			if (bytes_cached_ + block_size <= options_.max_cached_bytes)
+			{
+				// blocks are at least kMinBlockSize bytes from new char[], room and alignment enough for the link
+				size_class.free = new (data) FreeBlock{ size_class.free };
+				++size_class.cached;
+				bytes_cached_ += block_size;
+				data = nullptr;
+			}
+		}
+		released = MaybeTrimLocked();
+	}
+	delete[] data;
+	DeleteBlocks(released);
+}
+
+size_t BufferPool::Trim()
+{
+	size_t bytes = 0;
+	FreeBlock* released = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		released = TrimLocked(false, bytes);
+	}
+	DeleteBlocks(released);
+	return bytes;
+}
+
+size_t BufferPool::ReleaseCached()
+{
+	size_t bytes = 0;
+	FreeBlock* released = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		released = TrimLocked(true, bytes);
+	}
+	DeleteBlocks(released);
+	return bytes;
+}
+
+void BufferPool::GetStats(BufferPoolStats& out_stats)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	out_stats.bytes_reserved = bytes_in_use_ + bytes_cached_;
+	out_stats.bytes_in_use = bytes_in_use_;
+	out_stats.bytes_requested = bytes_requested_;
+	out_stats.bytes_cached = bytes_cached_;
+	out_stats.peak_bytes_reserved = peak_bytes_reserved_;
+	out_stats.alloc_count = alloc_count_;
+	out_stats.heap_alloc_count = heap_alloc_count_;
+	out_stats.classes.resize(kClassCount);
+	for (int i = 0; i < kClassCount; ++i)
+	{
+		BufferPoolClassStats& class_stats = out_stats.classes[i];
+		class_stats.block_size = ClassBlockSize(i);
+		class_stats.blocks_in_use = classes_[i].in_use;
+		class_stats.blocks_cached = classes_[i].cached;
+		class_stats.peak_blocks_in_use = classes_[i].peak_in_use;
+	}
+}
+
+BufferPool::FreeBlock* BufferPool::MaybeTrimLocked()
+{
+	if (options_.trim_interval.count() <= 0 || ++calls_since_check_ < kTrimCheckInterval)
+	{
+		return nullptr;
+	}
+	calls_since_check_ = 0;
+	if (std::chrono::steady_clock::now() - last_trim_time_ < options_.trim_interval)
+	{
+		return nullptr;
+	}
+	size_t bytes = 0;
+	return TrimLocked(false, bytes);
+}
+
+BufferPool::FreeBlock* BufferPool::TrimLocked(bool release_all, size_t& out_bytes)
+{
+	FreeBlock* released = nullptr;
+	out_bytes = 0;
+	for (int i = 0; i < kClassCount; ++i)
+	{
+		SizeClass& size_class = classes_[i];
+		// enough to get back to the peak without the heap, peak_in_use never drops below in_use
+		const size_t keep = release_all ? 0 : size_class.peak_in_use - size_class.in_use;
+		while (size_class.cached > keep)
+		{
+			FreeBlock* block = size_class.free;
+			size_class.free = block->next;
+			block->next = released;
+			released = block;
+			--size_class.cached;
+			out_bytes += ClassBlockSize(i);
+		}
+		if (!release_all)
+		{
+			size_class.peak_in_use = size_class.in_use;
+		}
+	}
+	bytes_cached_ -= out_bytes;
+	if (!release_all)
+	{
+		last_trim_time_ = std::chrono::steady_clock::now();
+	}
+	return released;
+}
+
+void BufferPool::DeleteBlocks(FreeBlock* blocks)
+{
+	while (blocks)
+	{
+		FreeBlock* next = blocks->next;
+		delete[] reinterpret_cast<char*>(blocks);
+		blocks = next;
+	}
+}
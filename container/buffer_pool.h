@@ -0,0 +1,130 @@
+#pragma once
+
+#include "core.h"
+
+namespace terra
+{
+	struct BufferPoolOptions
+	{
+		/** Free bytes kept across all size classes, above it Free() hands blocks straight back to the heap */
+		size_t max_cached_bytes{ 64 << 20 };
+		/** How often Alloc() and Free() run Trim() by themselves, zero leaves trimming to the owner */
+		std::chrono::milliseconds trim_interval{ 10000 };
+	};
+
+	struct BufferPoolClassStats
+	{
+		uint32_t block_size{ 0 };
+		size_t blocks_in_use{ 0 };
+		size_t blocks_cached{ 0 };
+		/** Most blocks in use at once since the last Trim() */
+		size_t peak_blocks_in_use{ 0 };
+	};
+
+	struct BufferPoolStats
+	{
+		/** Bytes held from the heap, in use plus cached */
+		size_t bytes_reserved{ 0 };
+		/** Bytes of the blocks handed out */
+		size_t bytes_in_use{ 0 };
+		/** Bytes callers asked for, the rest of bytes_in_use is rounding up to the size class */
+		size_t bytes_requested{ 0 };
+		size_t bytes_cached{ 0 };
+		/** Largest bytes_reserved seen */
+		size_t peak_bytes_reserved{ 0 };
+		uint64_t alloc_count{ 0 };
+		/** Allocations the cache could not serve */
+		uint64_t heap_alloc_count{ 0 };
+		/** One entry per size class, smallest first */
+		std::vector<BufferPoolClassStats> classes;
+
+		/** Share of the reserved bytes nobody asked for, rounding and cached blocks. */
+		double GetFragmentation() const { return bytes_reserved > 0 ? 1.0 - static_cast<double>(bytes_requested) / bytes_reserved : 0.0; }
+	};
+
+	/**
+	* Byte buffers in power of two size classes, shared by SocketBuffer, SocketBlockPool and ring_buffer. Thread-safe.
+	*
+	* Freed blocks are cached per class and handed out again, so buffers that grow and shrink with the traffic
+	* don't go to the heap each time. The cache follows the load: Trim() keeps what it takes to serve the peak
+	* since the previous trim once more and releases the rest, so the memory of a spike goes back to the heap
+	* on the second trim after it. Sizes above kMaxBlockSize bypass the cache.
+	*
+	* Alloc() and Free() run Trim() once trim_interval has passed, looking at the clock every kTrimCheckInterval
+	* calls, so a pool still in use trims itself. A pool that sees no calls at all doesn't: its owner calls Trim()
+	* from a timer, e.g. a ScheduleTimer loop at trim_interval, or sets trim_interval to zero and trims only there.
+	*/
+	class BufferPool
+	{
+	public:
+		static constexpr uint32_t kMinBlockSize = 64;
+		static constexpr uint32_t kMaxBlockSize = 1 << 20;
+		static constexpr int kClassCount = 15;
+
+	private:
+		/** Alloc() and Free() calls between two looks at the clock for the automatic trim */
+		static constexpr uint32_t kTrimCheckInterval = 64;
+
+		struct FreeBlock
+		{
+			FreeBlock* next;
+		};
+
+		struct SizeClass
+		{
+			FreeBlock* free{ nullptr };
+			size_t cached{ 0 };
+			size_t in_use{ 0 };
+			size_t peak_in_use{ 0 };
+		};
+
+		const BufferPoolOptions options_;
+		std::mutex mutex_;
+		SizeClass classes_[kClassCount];
+		size_t bytes_in_use_{ 0 };
+		size_t bytes_requested_{ 0 };
+		size_t bytes_cached_{ 0 };
+		size_t peak_bytes_reserved_{ 0 };
+		uint64_t alloc_count_{ 0 };
+		uint64_t heap_alloc_count_{ 0 };
+		uint32_t calls_since_check_{ 0 };
+		std::chrono::steady_clock::time_point last_trim_time_;
+
+	public:
+		explicit BufferPool(const BufferPoolOptions& options = BufferPoolOptions());
+		/** Blocks still held by buffers must not outlive the pool. */
+		~BufferPool();
+		BufferPool(const BufferPool&) = delete;
+		BufferPool& operator=(const BufferPool&) = delete;
+
+		/** Pool with the default options. Never destroyed. */
+		static BufferPool& Default();
+
+		/** Size of the block Alloc(size) returns, all of it may be used. */
+		static uint32_t BlockSizeFor(uint32_t size);
+
+		char* Alloc(uint32_t size);
+		/** size must be the size passed to Alloc(). */
+		void Free(char* data, uint32_t size);
+
+		/**
+		* Releases the cached blocks each class won't need to get back to its peak since the previous trim, then
+		* starts a new peak. Returns the number of bytes released.
+		*/
+		size_t Trim();
+		/** Releases every cached block, returns the number of bytes released. */
+		size_t ReleaseCached();
+
+		void GetStats(BufferPoolStats& out_stats);
+
+	private:
+		static int ClassIndex(uint32_t size);
+		static uint32_t ClassBlockSize(int index) { return kMinBlockSize << index; }
+
+		/** The automatic trim, returns what TrimLocked() unlinked or nullptr when it isn't due. */
+		FreeBlock* MaybeTrimLocked();
+		/** Unlinks the blocks to release, the caller deletes them once the lock is gone. */
+		FreeBlock* TrimLocked(bool release_all, size_t& out_bytes);
+		static void DeleteBlocks(FreeBlock* blocks);
+	};
+}
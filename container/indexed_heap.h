@@ -0,0 +1,299 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <vector>
+#include "global_macro.h"
+#include "gsl_assert.h"
+#include "make_heap.h"
+
+namespace terra
+{
+	/**
+	* Binary heap of (key, id) pairs which tracks the position of every id, not thread-safe.
+	*
+	* Ids are small dense integers (slot indices) owned by the caller, so lookup, removal and
+	* re-keying by id are O(1) + O(log n) instead of a linear search.
+	* Top() is the entry no other entry compares less than with Comp, i.e. a min heap with std::less.
+	*
+	* @param KeyType The priority stored with each id.
+	* @param Comp Strict weak ordering on KeyType.
+	*/
+	template <typename KeyType, typename Comp = std::less<KeyType>>
+	class TIndexedHeap
+	{
+	public:
+		using IdType = uint32_t;
+
+	private:
+		struct TNode
+		{
+			KeyType key;
+			IdType id;
+		};
+
+		std::vector<TNode> nodes_;
+		/** Position of each id in nodes_, INDEX_NONE when the id is not in the heap */
+		std::vector<int32_t> positions_;
+		Comp comp_;
+
+	public:
+		TIndexedHeap() = default;
+		explicit TIndexedHeap(const Comp& comp) : comp_(comp) {}
+
+		void Push(IdType id, const KeyType& key)
+		{
+			Expects(!Contains(id));
+			if (id >= positions_.size())
+			{
+				positions_.resize(static_cast<size_t>(id) + 1, INDEX_NONE);
+			}
+			nodes_.push_back(TNode{ key, id });
+			SiftUp(nodes_.size() - 1);
+		}
+
+		/**
+		* Pushes every id in [first, last), key_of(id) gives its key.
+		* Large batches are appended and the heap is rebuilt in one O(n) pass instead of n sift ups.
+		*/
+		template <typename Iter, typename KeyFn>
+		void PushBatch(Iter first, Iter last, KeyFn&& key_of)
+		{
+			const size_t count = static_cast<size_t>(std::distance(first, last));
+			if (!IsWorthRebuild(count))
+			{
+				for (; first != last; ++first)
+				{
+					Push(*first, key_of(*first));
+				}
+				return;
+			}
+
+			const size_t first_appended = nodes_.size();
+			nodes_.reserve(nodes_.size() + count);
+			for (; first != last; ++first)
+			{
+				AppendUnordered(*first, key_of(*first));
+			}
+			Rebuild(first_appended);
+		}
+
+		/**
+		* Appends an id without restoring the heap order, for callers which build a batch themselves and know the
+		* keys as they go. Only more AppendUnordered() calls may come before the closing Rebuild().
+		*/
+		void AppendUnordered(IdType id, const KeyType& key)
+		{
+			Expects(!Contains(id));
+			if (id >= positions_.size())
+			{
+				positions_.resize(static_cast<size_t>(id) + 1, INDEX_NONE);
+			}
+			positions_[id] = static_cast<int32_t>(nodes_.size());
+			nodes_.push_back(TNode{ key, id });
+		}
+
+		/**
+		* Restores the heap order after the nodes from position first_appended on were appended unordered.
+		* Floyd's bottom-up heapify limited to the ancestors of the appended range: about 2 * appended + log2(n)^2
+		* steps, the rest of the heap is left alone. 0 rebuilds the whole heap.
+		*/
+		void Rebuild(size_t first_appended = 0)
+		{
+			if (nodes_.size() < 2 || first_appended >= nodes_.size())
+			{
+				return;
+			}
+			size_t low = first_appended;
+			size_t high = nodes_.size() - 1;
+			do
+			{
+				low = low > 0 ? (low - 1) / 2 : 0;
+				high = (high - 1) / 2;
+				for (size_t pos = high + 1; pos-- > low;)
+				{
+					SiftDown(pos);
+				}
+			} while (low > 0);
+		}
+
+		/** Whether appending count ids and one Rebuild() beats count Push() calls, which cost up to log2(n) each. */
+		bool IsWorthRebuild(size_t count) const
+		{
+			size_t log_size = 1;
+			for (size_t n = nodes_.size() + count; n > 1; n >>= 1)
+			{
+				++log_size;
+			}
+			return count * log_size > 2 * count + log_size * log_size;
+		}
+
+		/** Removes every id in [first, last) which is in the heap, rebuilding once for large batches. */
+		template <typename Iter>
+		void RemoveBatch(Iter first, Iter last)
+		{
+			const size_t count = static_cast<size_t>(std::distance(first, last));
+			if (!IsWorthRebuildAll(count))
+			{
+				for (; first != last; ++first)
+				{
+					Remove(*first);
+				}
+				return;
+			}
+
+			for (; first != last; ++first)
+			{
+				if (Contains(*first))
+				{
+					positions_[*first] = INDEX_NONE;
+				}
+			}
+			nodes_.erase(std::remove_if(nodes_.begin(), nodes_.end(),
+				[this](const TNode& node) { return positions_[node.id] == INDEX_NONE; }), nodes_.end());
+			RebuildAll();
+		}
+
+		IdType Top() const { return nodes_.front().id; }
+		const KeyType& TopKey() const { return nodes_.front().key; }
+
+		/** Removes the top entry and returns its id. */
+		IdType Pop()
+		{
+			const IdType id = nodes_.front().id;
+			RemoveAt(0);
+			return id;
+		}
+
+		bool Remove(IdType id)
+		{
+			if (!Contains(id))
+			{
+				return false;
+			}
+			RemoveAt(static_cast<size_t>(positions_[id]));
+			return true;
+		}
+
+		/** Changes the key of an id already in the heap. */
+		void Update(IdType id, const KeyType& key)
+		{
+			Expects(Contains(id));
+			const size_t pos = static_cast<size_t>(positions_[id]);
+			nodes_[pos].key = key;
+			SiftDown(SiftUp(pos));
+		}
+
+		bool Contains(IdType id) const { return id < positions_.size() && positions_[id] != INDEX_NONE; }
+		const KeyType& GetKey(IdType id) const { return nodes_[positions_[id]].key; }
+
+		size_t Size() const { return nodes_.size(); }
+		bool IsEmpty() const { return nodes_.empty(); }
+		void Reserve(size_t count) { nodes_.reserve(count); }
+
+		void Clear()
+		{
+			for (const auto& node : nodes_)
+			{
+				positions_[node.id] = INDEX_NONE;
+			}
+			nodes_.clear();
+		}
+
+		/** Visits every (id, key) in heap order, not sorted. */
+		template <typename Fn>
+		void ForEach(Fn&& fn) const
+		{
+			for (const auto& node : nodes_)
+			{
+				fn(node.id, node.key);
+			}
+		}
+
+	private:
+		/** A full rebuild touches every node once, removing each of count nodes costs about log2(n) */
+		bool IsWorthRebuildAll(size_t count) const
+		{
+			size_t log_size = 1;
+			for (size_t n = nodes_.size() + count; n > 1; n >>= 1)
+			{
+				++log_size;
+			}
+			return count * log_size > nodes_.size() + count;
+		}
+
+		void RebuildAll()
+		{
+			// heap::MakeHeap puts the greatest element on top, flip Comp to get ours
+			heap::MakeHeap(nodes_.begin(), nodes_.end(),
+				[this](const TNode& lhs, const TNode& rhs) { return comp_(rhs.key, lhs.key); });
+			for (size_t pos = 0; pos < nodes_.size(); ++pos)
+			{
+				positions_[nodes_[pos].id] = static_cast<int32_t>(pos);
+			}
+		}
+
+		void RemoveAt(size_t pos)
+		{
+			positions_[nodes_[pos].id] = INDEX_NONE;
+			TNode last = std::move(nodes_.back());
+			nodes_.pop_back();
+			if (pos < nodes_.size())
+			{
+				Place(pos, std::move(last));
+				SiftDown(SiftUp(pos));
+			}
+		}
+
+		void Place(size_t pos, TNode&& node)
+		{
+			positions_[node.id] = static_cast<int32_t>(pos);
+			nodes_[pos] = std::move(node);
+		}
+
+		size_t SiftUp(size_t pos)
+		{
+			TNode node = std::move(nodes_[pos]);
+			while (pos > 0)
+			{
+				const size_t parent = (pos - 1) / 2;
+				if (!comp_(node.key, nodes_[parent].key))
+				{
+					break;
+				}
+				Place(pos, std::move(nodes_[parent]));
+				pos = parent;
+			}
+			Place(pos, std::move(node));
+			return pos;
+		}
+
+		size_t SiftDown(size_t pos)
+		{
+			const size_t count = nodes_.size();
+			TNode node = std::move(nodes_[pos]);
+			while (true)
+			{
+				size_t child = 2 * pos + 1;
+				if (child >= count)
+				{
+					break;
+				}
+				if (child + 1 < count && comp_(nodes_[child + 1].key, nodes_[child].key))
+				{
+					++child;
+				}
+				if (!comp_(nodes_[child].key, node.key))
+				{
+					break;
+				}
+				Place(pos, std::move(nodes_[child]));
+				pos = child;
+			}
+			Place(pos, std::move(node));
+			return pos;
+		}
+	};
+}
@@ -1,6 +1,15 @@
 #pragma once
 
+#include "math/math_ex.h"
+
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace terra
 {
@@ -12,9 +21,19 @@ namespace terra
 		Mpsc,
 
 		/** Single-producer, single-consumer queue. */
-		Spsc
+		Spsc,
+
+		/** Multiple-producers, multiple-consumers queue, TBoundedQueue only. */
+		Mpmc
 	};
 
+	/**
+	* Spacing between queue fields written by different threads, so they never share a cache line. The queues pad
+	* with char arrays instead of alignas: an over-aligned type only gets its alignment from C++17 aligned new, and
+	* queues live on the heap inside their owners.
+	*/
+	constexpr size_t kQueueCacheLineSize = 64;
+
 	/**
 	* Template for queues.
 	*
@@ -26,23 +45,38 @@ namespace terra
 	* writing it in a way that does not depend on possible instruction reordering on the CPU.
 	* The Enqueue() method uses an atomic compare-and-swap in multiple-producers scenarios.
 	*
+	* Nodes are pooled: they are allocated in chunks of doubling size and dequeued nodes go back on a lock-free
+	* freelist, so once the queue has seen its peak length Enqueue() and Dequeue() no longer touch the heap. The
+	* pool keeps up to twice the peak length and is released by the destructor.
+	*
+	* Items are constructed in place when enqueued and destroyed when dequeued, an item type only needs to be
+	* copy or move constructible. Dequeue() and Peek() assign to their out parameter, DequeueBatch() and Drain()
+	* don't and work with any such type.
+	*
 	* @param ItemType The type of items stored in the queue.
 	* @param Mode The queue mode (single-producer, single-consumer by default).
-	* @todo gmp: Implement node pooling.
 	*/
 	template <typename ItemType, EQueueMode Mode = EQueueMode::Spsc>
 	class TQueue
 	{
+		static_assert(Mode != EQueueMode::Mpmc, "TQueue has a single consumer, use TBoundedQueue for Mpmc");
+
 	public:
 		/** Default constructor. */
-		TQueue() : head_(new TNode()), tail_(head_.load()) {}
+		TQueue() : head_(nullptr), tail_(nullptr)
+		{
+			TNode* const stub = AllocateNode();
+			head_.store(stub);
+			tail_.store(stub);
+		}
 
-		/** Destructor. */
+		/** Destructor. Nodes are owned by the chunks, whether queued or free, only the items need destroying. */
 		~TQueue()
 		{
-			while (TNode* const node = tail_.load()) {
-				tail_.store(node->next_node);
-				delete node;
+			TNode* node = tail_.load(std::memory_order_relaxed)->next_node.load(std::memory_order_relaxed);
+			for (; node != nullptr; node = node->next_node.load(std::memory_order_relaxed))
+			{
+				node->Item().~ItemType();
 			}
 		}
 
@@ -57,28 +91,58 @@ namespace terra
 		bool Dequeue(ItemType& out_item)
 		{
 			TNode* tail = tail_.load();
-			TNode* popped = tail->next_node;
+			TNode* popped = tail->next_node.load(std::memory_order_acquire);
 
 			if (popped == nullptr)
 			{
 				return false;
 			}
 
-			out_item = std::move(popped->item_data);
+			out_item = std::move(popped->Item());
 
 			TNode* old_tail = tail;
-			popped->item_data = ItemType();
+			popped->Item().~ItemType();
 			tail_.store(popped);
-			delete old_tail;
+			FreeNode(old_tail);
 
 			return true;
 		}
 
+		/**
+		* Removes up to max items from the tail of the queue in one walk of the list.
+		*
+		* @param out Output iterator the items are moved to, oldest first.
+		* @param max The most items to remove.
+		* @return The number of items removed.
+		* @see Dequeue, Drain
+		*/
+		template <typename OutputIt>
+		size_t DequeueBatch(OutputIt out, size_t max)
+		{
+			return ConsumeItems(max, [&out](ItemType&& item) {
+				*out = std::move(item);
+				++out;
+			});
+		}
+
+		/**
+		* Removes every item in the queue, calling fn(ItemType&&) on each, oldest first. Items enqueued while it
+		* runs may be included. If fn throws, the item it threw on counts as removed. fn must not dequeue from this
+		* queue.
+		*
+		* @return The number of items removed.
+		* @see Dequeue, DequeueBatch
+		*/
+		template <typename Func>
+		size_t Drain(Func&& fn)
+		{
+			return ConsumeItems(static_cast<size_t>(-1), fn);
+		}
+
 		/** Empty the queue, discarding all items. */
 		void Empty()
 		{
-			ItemType dummy_item;
-			while (Dequeue(dummy_item));
+			Drain([](ItemType&&) {});
 		}
 
 		/**
@@ -90,22 +154,7 @@ namespace terra
 		*/
 		bool Enqueue(const ItemType& item_data)
 		{
-			TNode* new_node = new TNode(item_data);
-			TNode* old_head;
-
-			if (Mode == EQueueMode::Mpsc)
-			{
-				old_head = std::atomic_exchange(&head_, new_node);
-			}
-			else
-			{
-				old_head = head_.load();
-				head_.store(new_node);
-			}
-
-			old_head->next_node = new_node;
-
-			return true;
+			return Emplace(item_data);
 		}
 
 		/**
@@ -117,19 +166,29 @@ namespace terra
 		*/
 		bool Enqueue(ItemType&& item_data)
 		{
-			TNode* new_node = new TNode(std::move(item_data));
-			TNode* old_head;
-			if (Mode == EQueueMode::Mpsc)
+			return Emplace(std::move(item_data));
+		}
+
+		/**
+		* Constructs an item from args at the head of the queue.
+		*
+		* @return true if the item was added, false otherwise.
+		* @see Dequeue, Enqueue
+		*/
+		template <typename... Args>
+		bool Emplace(Args&&... args)
+		{
+			TNode* new_node = AllocateNode();
+			try
 			{
-				old_head = std::atomic_exchange(&head_, new_node);
+				new (&new_node->item_storage) ItemType(std::forward<Args>(args)...);
 			}
-			else
+			catch (...)
 			{
-				old_head = head_.load();
-				head_.store(new_node);
+				PushFree(new_node, new_node);
+				throw;
 			}
-
-			old_head->next_node = new_node;
+			LinkNode(new_node);
 			return true;
 		}
 
@@ -139,7 +198,7 @@ namespace terra
 		* @return true if the queue is empty, false otherwise.
 		* @see Dequeue, Enqueue, Peek
 		*/
-		bool IsEmpty() const { return (tail_.load()->next_node == nullptr); }
+		bool IsEmpty() const { return (tail_.load()->next_node.load(std::memory_order_acquire) == nullptr); }
 
 		/**
 		* Peeks at the queue's tail item without removing it.
@@ -150,39 +209,262 @@ namespace terra
 		*/
 		bool Peek(ItemType& out_item) const
 		{
-			TNode* tail = tail_.load();
-			if (tail->next_node == nullptr) {
+			TNode* next = tail_.load()->next_node.load(std::memory_order_acquire);
+			if (next == nullptr) {
 				return false;
 			}
-			out_item = tail->next_node->item_data;
+			out_item = next->Item();
 			return true;
 		}
 
 	private:
 		/** Structure for the internal linked list. */
 		struct TNode {
-			/** Holds a pointer to the next node in the list. */
-			TNode* next_node;
+			/** Holds a pointer to the next node in the list, written by the producer which linked the following node. */
+			std::atomic<TNode*> next_node;
 
-			/** Holds the node's item. */
-			ItemType item_data;
+			/** Holds the node's item, constructed while the node is queued past the tail. */
+			typename std::aligned_storage<sizeof(ItemType), alignof(ItemType)>::type item_storage;
 
-			/** Default constructor. */
-			TNode() : next_node(nullptr), item_data() {}
+			/** Index of the node in the pool. */
+			uint32_t index;
+
+			/** Index + 1 of the next free node while the node is on the freelist, 0 ends the list. */
+			std::atomic<uint32_t> next_free;
 
-			/** Creates and initializes a new node. */
-			explicit TNode(const ItemType& item) : next_node(nullptr), item_data(item) {}
+			/** Default constructor. */
+			TNode() : next_node(nullptr), index(0), next_free(0) {}
 
-			/** Creates and initializes a new node. */
-			explicit TNode(ItemType&& item) : next_node(nullptr), item_data(std::move(item)) {}
+			ItemType& Item() { return *reinterpret_cast<ItemType*>(&item_storage); }
 		};
 
-		/** Holds a pointer to the head of the list. */
+		/** Nodes in the first chunk, chunk c holds kFirstChunkSize << c nodes. */
+		static constexpr uint32_t kFirstChunkSize = 32;
+
+		/** Enough chunks for 2^32 nodes. */
+		static constexpr uint32_t kMaxChunks = 27;
+
+		/** Nodes the consumer collects before returning them with one compare-exchange. */
+		static constexpr uint32_t kFreeBatch = 16;
+
+		static uint64_t PackFree(uint32_t tag, uint32_t index_plus_one)
+		{
+			return (static_cast<uint64_t>(tag) << 32) | index_plus_one;
+		}
+
+		TNode* NodeAt(uint32_t index) const
+		{
+			const uint32_t chunk = FloorLog2_64(index / kFirstChunkSize + 1);
+			const uint32_t first = kFirstChunkSize * ((1u << chunk) - 1);
+			return &chunks_[chunk].load(std::memory_order_acquire)[index - first];
+		}
+
+		/**
+		* Walks from the tail handing up to max items to fn, freeing each passed node as it goes. The item is
+		* destroyed even if fn throws. fn may enqueue but not dequeue, its item lives in the current tail node.
+		*/
+		template <typename Func>
+		size_t ConsumeItems(size_t max, Func&& fn)
+		{
+			struct TItemGuard
+			{
+				ItemType* item;
+				~TItemGuard() { item->~ItemType(); }
+			};
+
+			TNode* tail = tail_.load(std::memory_order_relaxed);
+			size_t count = 0;
+			while (count < max)
+			{
+				TNode* const popped = tail->next_node.load(std::memory_order_acquire);
+				if (popped == nullptr)
+				{
+					break;
+				}
+				tail_.store(popped, std::memory_order_relaxed);
+				FreeNode(tail);
+				tail = popped;
+				++count;
+				TItemGuard guard{ &popped->Item() };
+				fn(std::move(popped->Item()));
+			}
+			return count;
+		}
+
+		/** Publishes a filled node at the head of the list. */
+		void LinkNode(TNode* new_node)
+		{
+			TNode* old_head;
+			if (Mode == EQueueMode::Mpsc)
+			{
+				old_head = std::atomic_exchange(&head_, new_node);
+			}
+			else
+			{
+				old_head = head_.load();
+				head_.store(new_node);
+			}
+
+			old_head->next_node.store(new_node, std::memory_order_release);
+		}
+
+		/**
+		* Pops a node from the freelist, adding a chunk when it is empty. Any producer.
+		*
+		* The freelist links nodes by index and its top carries a tag bumped by every pop, so a producer whose
+		* top node was popped and pushed back by others in the meantime fails its compare-exchange instead of
+		* linking in a stale next. Nodes are never freed before the queue, reading the next of a node that was
+		* just taken is harmless.
+		*/
+		TNode* AllocateNode()
+		{
+			if (Mode == EQueueMode::Spsc)
+			{
+				return AllocateNodeSpsc();
+			}
+			uint64_t top = free_top_.load(std::memory_order_acquire);
+			for (;;)
+			{
+				const uint32_t index_plus_one = static_cast<uint32_t>(top);
+				if (index_plus_one == 0)
+				{
+					if (TNode* const node = AddChunk())
+					{
+						return node;
+					}
+					top = free_top_.load(std::memory_order_acquire);
+					continue;
+				}
+				TNode* const node = NodeAt(index_plus_one - 1);
+				const uint64_t next = PackFree(static_cast<uint32_t>(top >> 32) + 1, node->next_free.load(std::memory_order_relaxed));
+				if (free_top_.compare_exchange_weak(top, next, std::memory_order_acquire, std::memory_order_acquire))
+				{
+					node->next_node.store(nullptr, std::memory_order_relaxed);
+					return node;
+				}
+			}
+		}
+
+		/**
+		* The single producer takes the whole freelist at once and pops from its private copy without atomics, with
+		* one popper there is no ABA to guard against.
+		*/
+		TNode* AllocateNodeSpsc()
+		{
+			while (producer_free_ == 0)
+			{
+				producer_free_ = static_cast<uint32_t>(free_top_.exchange(0, std::memory_order_acquire));
+				if (producer_free_ == 0)
+				{
+					if (TNode* const node = AddChunk())
+					{
+						return node;
+					}
+				}
+			}
+			TNode* const node = NodeAt(producer_free_ - 1);
+			producer_free_ = node->next_free.load(std::memory_order_relaxed);
+			node->next_node.store(nullptr, std::memory_order_relaxed);
+			return node;
+		}
+
+		/** Pushes the chain of free nodes [first, last] linked through next_free, last's link is overwritten. */
+		void PushFree(TNode* first, TNode* last)
+		{
+			uint64_t top = free_top_.load(std::memory_order_relaxed);
+			do
+			{
+				last->next_free.store(static_cast<uint32_t>(top), std::memory_order_relaxed);
+			} while (!free_top_.compare_exchange_weak(top, PackFree(static_cast<uint32_t>(top >> 32), first->index + 1),
+				std::memory_order_release, std::memory_order_relaxed));
+		}
+
+		/** Returns a node the consumer is done with, the nodes go back to the producers kFreeBatch at a time. */
+		void FreeNode(TNode* node)
+		{
+			node->next_free.store(consumer_free_ != nullptr ? consumer_free_->index + 1 : 0, std::memory_order_relaxed);
+			if (consumer_free_ == nullptr)
+			{
+				consumer_free_last_ = node;
+			}
+			consumer_free_ = node;
+			if (++consumer_free_count_ == kFreeBatch)
+			{
+				PushFree(consumer_free_, consumer_free_last_);
+				consumer_free_ = nullptr;
+				consumer_free_last_ = nullptr;
+				consumer_free_count_ = 0;
+			}
+		}
+
+		/**
+		* Allocates the next chunk, returns its first node and frees the others. Returns nullptr when another
+		* producer added a chunk while this one waited for the lock.
+		*/
+		TNode* AddChunk()
+		{
+			std::lock_guard<std::mutex> lock(chunk_mutex_);
+			if (static_cast<uint32_t>(free_top_.load(std::memory_order_acquire)) != 0)
+			{
+				return nullptr;
+			}
+			const uint32_t chunk = chunk_count_;
+			if (chunk == kMaxChunks)
+			{
+				throw std::bad_alloc();
+			}
+			const uint32_t size = kFirstChunkSize << chunk;
+			const uint32_t first = kFirstChunkSize * ((1u << chunk) - 1);
+			std::unique_ptr<TNode[]> nodes(new TNode[size]);
+			for (uint32_t i = 0; i < size; ++i)
+			{
+				nodes[i].index = first + i;
+				nodes[i].next_free.store(first + i + 2, std::memory_order_relaxed);
+			}
+			TNode* const raw = nodes.get();
+			chunks_[chunk].store(raw, std::memory_order_release);
+			owned_chunks_[chunk] = std::move(nodes);
+			++chunk_count_;
+			if (size > 1)
+			{
+				PushFree(&raw[1], &raw[size - 1]);
+			}
+			return &raw[0];
+		}
+
+		char pad_before_head_[kQueueCacheLineSize];
+
+		/** Holds a pointer to the head of the list, written by the producers. */
 		std::atomic<TNode*> head_;
 
-		/** Holds a pointer to the tail of the list. */
+		/** Index + 1 of the producer's private free chain, SPSC mode only. */
+		uint32_t producer_free_{ 0 };
+
+		char pad_before_tail_[kQueueCacheLineSize];
+
+		/** Holds a pointer to the tail of the list, written by the consumer. */
 		std::atomic<TNode*> tail_;
 
+		/** Freed nodes the consumer has yet to return, newest first. */
+		TNode* consumer_free_{ nullptr };
+		TNode* consumer_free_last_{ nullptr };
+		uint32_t consumer_free_count_{ 0 };
+
+		char pad_before_free_top_[kQueueCacheLineSize];
+
+		/** Tag in the high half, index + 1 of the top free node in the low half, pushed by the consumer and popped by the producers. */
+		std::atomic<uint64_t> free_top_{ 0 };
+
+		char pad_after_free_top_[kQueueCacheLineSize];
+
+		/** Node chunks, published for index lookups before their nodes reach the freelist. */
+		std::atomic<TNode*> chunks_[kMaxChunks]{};
+
+		/** Guards chunk growth and owns the chunks. */
+		std::mutex chunk_mutex_;
+		uint32_t chunk_count_{ 0 };
+		std::unique_ptr<TNode[]> owned_chunks_[kMaxChunks];
+
 	private:
 		/** Hidden copy constructor. */
 		TQueue(const TQueue&) = delete;
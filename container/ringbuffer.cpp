@@ -2,13 +2,13 @@
 
 using namespace terra;
 
-ring_buffer::ring_buffer(int size) : size_(size)
+ring_buffer::ring_buffer(int size, BufferPool& pool) : size_(size), pool_(pool)
 {
 	Expects(size > 0);
 	size_ = RoundUpExp2(size);
-	buffer_ = new char[size_];
+	buffer_ = pool_.Alloc(size_);
 }
-ring_buffer::~ring_buffer() { delete[] buffer_; }
+ring_buffer::~ring_buffer() { pool_.Free(buffer_, size_); }
 
 void ring_buffer::write(const char* data, int len)
 {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core.h"
+#include "buffer_pool.h"
 
 namespace terra
 {
@@ -12,9 +13,12 @@ namespace terra
 		int out_{ 0 };
 		int size_{ 0 };
 		char* buffer_{ nullptr };
+		BufferPool& pool_;
 	public:
-		ring_buffer(int size);
+		ring_buffer(int size, BufferPool& pool = BufferPool::Default());
 		~ring_buffer();
+		ring_buffer(const ring_buffer&) = delete;
+		ring_buffer& operator=(const ring_buffer&) = delete;
 
 		void write(const char* data, int len);
 		void read(char* data, int len);
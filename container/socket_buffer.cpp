@@ -1,22 +1,71 @@
 #include "socket_buffer.h"
 using namespace terra;
 
-SocketBuffer::SocketBuffer(uint32_t size)
+SocketBlockPool::SocketBlockPool(uint32_t block_size, BufferPool& buffer_pool)
+	: block_size_(block_size)
+	, buffer_pool_(buffer_pool)
+{
+	Expects(block_size > 0);
+}
+
+SocketBlockPool& SocketBlockPool::Default()
+{
+	static SocketBlockPool* pool = new SocketBlockPool();
+	return *pool;
+}
+
+SocketBlock* SocketBlockPool::Alloc()
+{
+	// SocketBlock is a few pointers and ints, pool blocks come from new char[] and are aligned enough for it
+	return new (buffer_pool_.Alloc(sizeof(SocketBlock) + block_size_)) SocketBlock();
+}
+
+void SocketBlockPool::Free(SocketBlock* block)
+{
+	block->~SocketBlock();
+	buffer_pool_.Free(reinterpret_cast<char*>(block), sizeof(SocketBlock) + block_size_);
+}
+
+SocketBuffer::SocketBuffer(uint32_t size, BufferPool& buffer_pool)
+	: buffer_pool_(&buffer_pool)
 {
 	Expects(size > 0);
 
-	capacity_ = RoundUpExp2(size);
-	buffer_ = new char[capacity_];
+	// the whole pool block is ours, use it
+	capacity_ = BufferPool::BlockSizeFor(RoundUpExp2(size));
+	initial_capacity_ = capacity_;
+	buffer_ = buffer_pool_->Alloc(capacity_);
 	front_ = back_ = 0;
 }
 
+SocketBuffer::SocketBuffer(SocketBlockPool& pool)
+	: capacity_(0)
+	, initial_capacity_(0)
+	, pool_(&pool)
+{
+}
+
 SocketBuffer::~SocketBuffer()
 {
-	delete[] buffer_;
+	if (buffer_)
+	{
+		buffer_pool_->Free(buffer_, capacity_);
+	}
+	while (head_)
+	{
+		SocketBlock* block = head_;
+		head_ = block->next;
+		pool_->Free(block);
+	}
 }
 
 void SocketBuffer::Append(const char* data, uint32_t len)
 {
+	if (IsChained())
+	{
+		AppendChained(data, len);
+		return;
+	}
 	AllocBuffer(len);
 	memcpy(buffer_ + back_, data, len);
 	PushBack(len);
@@ -24,6 +73,7 @@ void SocketBuffer::Append(const char* data, uint32_t len)
 
 void SocketBuffer::AllocBuffer(uint32_t size)
 {
+	Expects(!IsChained());
 	Expects(static_cast<int>(size) > 0);
 	int free = capacity_ - back_;
 	if (free >= static_cast<int>(size))
@@ -46,20 +96,74 @@ void SocketBuffer::AllocBuffer(uint32_t size)
 
 void SocketBuffer::PushBack(uint32_t size)
 {
+	if (IsChained())
+	{
+		PushBackChained(size);
+		return;
+	}
 	back_ += size;
 	Ensures(back_ <= capacity_);
 }
 
 void SocketBuffer::PopFront(uint32_t size)
 {
+	if (IsChained())
+	{
+		PopFrontChained(size);
+		return;
+	}
 	front_ += size;
 	Ensures(front_ <= back_);
 	if (front_ == back_)
 	{
 		front_ = back_ = 0;
+		if (capacity_ > kAutoShrinkCapacity)
+		{
+			Shrink();
+		}
 	}
 }
 
+void SocketBuffer::Shrink()
+{
+	if (IsChained())
+	{
+		SocketBlock* block = nullptr;
+		if (size_ == 0)
+		{
+			block = head_;
+			head_ = tail_ = write_block_ = nullptr;
+		}
+		else if (write_block_)
+		{
+			block = write_block_->next;
+			write_block_->next = nullptr;
+			tail_ = write_block_;
+		}
+		while (block)
+		{
+			SocketBlock* next = block->next;
+			pool_->Free(block);
+			--block_count_;
+			block = next;
+		}
+		return;
+	}
+	const uint32_t len = back_ - front_;
+	const uint32_t alloc_size = BufferPool::BlockSizeFor(RoundUpExp2(std::max(len, initial_capacity_)));
+	if (alloc_size >= capacity_)
+	{
+		return;
+	}
+	char* temp = buffer_pool_->Alloc(alloc_size);
+	memcpy(temp, buffer_ + front_, len);
+	buffer_pool_->Free(buffer_, capacity_);
+	buffer_ = temp;
+	capacity_ = alloc_size;
+	front_ = 0;
+	back_ = len;
+}
+
 void SocketBuffer::ExpandBuffer(uint32_t size)
 {
 	Expects(size <= std::numeric_limits<uint32_t>::max()/2);
@@ -68,9 +172,157 @@ void SocketBuffer::ExpandBuffer(uint32_t size)
 	{
 		alloc_size *= 2;
 	}
-	char* temp = new char[alloc_size];
-	memcpy(temp, buffer_ + front_, back_ - front_);
-	delete[] buffer_;
+	const uint32_t len = back_ - front_;
+	char* temp = buffer_pool_->Alloc(alloc_size);
+	memcpy(temp, buffer_ + front_, len);
+	buffer_pool_->Free(buffer_, capacity_);
 	buffer_ = temp;
 	capacity_ = alloc_size;
+	front_ = 0;
+	back_ = len;
+}
+
+int SocketBuffer::GetReadableIoVecs(IoVec* iov, int max_count)
+{
+	Expects(IsChained());
+	int count = 0;
+	for (SocketBlock* block = head_; block && count < max_count && block->end > block->begin; block = block->next)
+	{
+		iov[count++] = MakeIoVec(block->Data() + block->begin, block->end - block->begin);
+	}
+	return count;
+}
+
+int SocketBuffer::GetWritableIoVecs(IoVec* iov, int max_count, uint32_t min_size)
+{
+	Expects(IsChained());
+	const uint32_t block_size = pool_->BlockSize();
+	uint32_t free = 0;
+	for (SocketBlock* block = write_block_; block; block = block->next)
+	{
+		free += block_size - block->end;
+	}
+	while (free < min_size)
+	{
+		AddBlock();
+		free += block_size;
+	}
+	int count = 0;
+	for (SocketBlock* block = write_block_; block && count < max_count; block = block->next)
+	{
+		iov[count++] = MakeIoVec(block->Data() + block->end, block_size - block->end);
+	}
+	return count;
+}
+
+uint32_t SocketBuffer::Peek(char* out, uint32_t len) const
+{
+	if (!IsChained())
+	{
+		const uint32_t copied = std::min(len, Size());
+		memcpy(out, buffer_ + front_, copied);
+		return copied;
+	}
+	uint32_t copied = 0;
+	for (SocketBlock* block = head_; block && copied < len; block = block->next)
+	{
+		const uint32_t chunk = std::min(len - copied, block->end - block->begin);
+		memcpy(out + copied, block->Data() + block->begin, chunk);
+		copied += chunk;
+	}
+	return copied;
+}
+
+uint32_t SocketBuffer::Read(char* out, uint32_t len)
+{
+	const uint32_t copied = Peek(out, len);
+	PopFront(copied);
+	return copied;
+}
+
+SocketBlock* SocketBuffer::AddBlock()
+{
+	SocketBlock* block = pool_->Alloc();
+	if (tail_)
+	{
+		tail_->next = block;
+	}
+	else
+	{
+		head_ = block;
+	}
+	tail_ = block;
+	if (!write_block_)
+	{
+		write_block_ = block;
+	}
+	++block_count_;
+	return block;
+}
+
+void SocketBuffer::AppendChained(const char* data, uint32_t len)
+{
+	const uint32_t block_size = pool_->BlockSize();
+	while (len > 0)
+	{
+		if (!write_block_)
+		{
+			AddBlock();
+		}
+		SocketBlock* block = write_block_;
+		const uint32_t chunk = std::min(len, block_size - block->end);
+		memcpy(block->Data() + block->end, data, chunk);
+		data += chunk;
+		len -= chunk;
+		PushBackChained(chunk);
+	}
+}
+
+void SocketBuffer::PushBackChained(uint32_t size)
+{
+	const uint32_t block_size = pool_->BlockSize();
+	size_ += size;
+	while (size > 0)
+	{
+		Expects(write_block_);
+		const uint32_t chunk = std::min(size, block_size - write_block_->end);
+		write_block_->end += chunk;
+		size -= chunk;
+		if (write_block_->end == block_size)
+		{
+			write_block_ = write_block_->next;
+		}
+	}
+}
+
+void SocketBuffer::PopFrontChained(uint32_t size)
+{
+	Expects(size <= size_);
+	size_ -= size;
+	while (size > 0)
+	{
+		SocketBlock* block = head_;
+		const uint32_t chunk = std::min(size, block->end - block->begin);
+		block->begin += chunk;
+		size -= chunk;
+		if (block->begin == block->end && block != write_block_)
+		{
+			// a full block that has been read entirely, blocks past write_block_ are empty and stay reserved
+			head_ = block->next;
+			if (tail_ == block)
+			{
+				tail_ = nullptr;
+			}
+			pool_->Free(block);
+			--block_count_;
+		}
+	}
+	if (head_ && head_ == write_block_ && head_->begin == head_->end)
+	{
+		head_->begin = head_->end = 0;
+	}
+	if (size_ == 0 && Capacity() > kAutoShrinkCapacity)
+	{
+		Shrink();
+	}
 }
@@ -1,35 +1,150 @@
 #pragma once
 
 #include "core.h"
+#include "buffer_pool.h"
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
 
 namespace terra
 {
+#ifdef _WIN32
+	/** Scatter/gather element for WSASend/WSARecv. */
+	using IoVec = WSABUF;
+	inline IoVec MakeIoVec(char* base, uint32_t len) { IoVec v; v.buf = base; v.len = len; return v; }
+	inline uint32_t IoVecSize(const IoVec& v) { return v.len; }
+#else
+	/** Scatter/gather element for readv/writev. */
+	using IoVec = iovec;
+	inline IoVec MakeIoVec(char* base, uint32_t len) { IoVec v; v.iov_base = base; v.iov_len = len; return v; }
+	inline uint32_t IoVecSize(const IoVec& v) { return static_cast<uint32_t>(v.iov_len); }
+#endif
+
+	/** Block of a chained SocketBuffer, the data follows the header. */
+	struct SocketBlock
+	{
+		SocketBlock* next{ nullptr };
+		/** Readable data is [begin, end) */
+		uint32_t begin{ 0 };
+		uint32_t end{ 0 };
+
+		char* Data() { return reinterpret_cast<char*>(this + 1); }
+	};
+
+	/** Hands out the fixed-size blocks of chained SocketBuffers, a header and its data make one BufferPool block. */
+	class SocketBlockPool
+	{
+	public:
+		static constexpr uint32_t kDefaultBlockSize = 4096 - sizeof(SocketBlock);
+
+	private:
+		const uint32_t block_size_;
+		BufferPool& buffer_pool_;
+
+	public:
+		explicit SocketBlockPool(uint32_t block_size = kDefaultBlockSize, BufferPool& buffer_pool = BufferPool::Default());
+		SocketBlockPool(const SocketBlockPool&) = delete;
+		SocketBlockPool& operator=(const SocketBlockPool&) = delete;
+
+		/** Pool of kDefaultBlockSize blocks on the default BufferPool, a header and its data fill a 4KB page. Never destroyed. */
+		static SocketBlockPool& Default();
+
+		SocketBlock* Alloc();
+		void Free(SocketBlock* block);
+
+		uint32_t BlockSize() const { return block_size_; }
+	};
+
+	/**
+	* Byte queue between a socket and the protocol code, in one of two modes.
+	*
+	* Contiguous (the default): one growing buffer from a BufferPool, GetBuffer() and Back() are plain pointers.
+	* Making room may move the unread bytes to the front or copy them to a bigger buffer.
+	*
+	* Chained (constructed with a SocketBlockPool): a list of fixed-size pooled blocks. Appending takes a new block
+	* when the last is full and consuming hands emptied blocks back, bytes never move once written, whatever the
+	* backlog. The data is reached through IoVec arrays that go straight to readv/writev (WSARecv/WSASend), or
+	* copied out with Peek() and Read(). GetBuffer(), Back() and AllocBuffer() are contiguous mode only.
+	*/
 	class SocketBuffer
 	{
 	private:
 		static const uint32_t kInitialBufferSize = 8;
+		/** Capacity above which a buffer gives its storage back once it has been read empty */
+		static const uint32_t kAutoShrinkCapacity = 64 << 10;
+		BufferPool* buffer_pool_{ nullptr };
 		char* buffer_{ nullptr };
-		uint32_t capacity_{ kInitialBufferSize };   
+		uint32_t capacity_{ kInitialBufferSize };
+		uint32_t initial_capacity_{ kInitialBufferSize };
 		uint32_t front_{ 0 };
 		uint32_t back_{ 0 };
+
+		/** Chained mode: blocks from head_ to tail_, write_block_ is the first with free space */
+		SocketBlockPool* pool_{ nullptr };
+		SocketBlock* head_{ nullptr };
+		SocketBlock* tail_{ nullptr };
+		SocketBlock* write_block_{ nullptr };
+		uint32_t block_count_{ 0 };
+		uint32_t size_{ 0 };
 	public:
-		SocketBuffer(uint32_t capacity = kInitialBufferSize);
+		SocketBuffer(uint32_t capacity = kInitialBufferSize, BufferPool& buffer_pool = BufferPool::Default());
+		/** Chained mode on blocks from pool. */
+		explicit SocketBuffer(SocketBlockPool& pool);
 		~SocketBuffer();
+		SocketBuffer(const SocketBuffer&) = delete;
+		SocketBuffer& operator=(const SocketBuffer&) = delete;
 
 		void Append(const char* data, uint32_t len);
 
 		void AllocBuffer(uint32_t size);
 
-		bool IsEmpty() { return back_ == front_; }
-		char* Back() { return buffer_ + back_; }
-		const char* GetBuffer() const { return buffer_ + front_; }
-		uint32_t Size() const { return back_ - front_; }
-		uint32_t Capacity() const { return capacity_; }
+		bool IsChained() const { return pool_ != nullptr; }
+		bool IsEmpty() { return Size() == 0; }
+		char* Back() { Expects(!IsChained()); return buffer_ + back_; }
+		const char* GetBuffer() const { Expects(!IsChained()); return buffer_ + front_; }
+		uint32_t Size() const { return IsChained() ? size_ : back_ - front_; }
+		uint32_t Capacity() const { return IsChained() ? block_count_ * pool_->BlockSize() : capacity_; }
+		/** Marks size bytes written at Back(), or into the IoVecs of GetWritableIoVecs() in chained mode. */
 		void PushBack(uint32_t size);
+		/**
+		* Consumes size bytes from the front. A buffer read empty with more than kAutoShrinkCapacity bytes reserved
+		* shrinks, pointers and IoVecs taken before are invalid then.
+		*/
 		void PopFront(uint32_t size);
 
+		/**
+		* Gives reserved memory back to the pools: a contiguous buffer moves to the smallest block that holds its
+		* bytes and the initial capacity, a chained buffer drops the empty blocks past the write position, or all
+		* of them when empty. Invalidates pointers and IoVecs taken before.
+		*/
+		void Shrink();
+
+		/**
+		* Chained mode: fills iov with the readable bytes from the front, one entry per block, for writev.
+		* Returns the number of entries used, at most max_count.
+		*/
+		int GetReadableIoVecs(IoVec* iov, int max_count);
+
+		/**
+		* Chained mode: makes room for at least min_size more bytes and fills iov with the free space, for readv.
+		* Call PushBack() with the number of bytes read. Returns the number of entries used, at most max_count.
+		*/
+		int GetWritableIoVecs(IoVec* iov, int max_count, uint32_t min_size);
+
+		/** Copies up to len bytes from the front without consuming them, returns the number copied. */
+		uint32_t Peek(char* out, uint32_t len) const;
+		/** Copies up to len bytes from the front and consumes them, returns the number copied. */
+		uint32_t Read(char* out, uint32_t len);
+
 	private:
 		void ExpandBuffer(uint32_t size);
+
+		/** Appends an empty block at the tail. */
+		SocketBlock* AddBlock();
+		void AppendChained(const char* data, uint32_t len);
+		void PushBackChained(uint32_t size);
+		void PopFrontChained(uint32_t size);
 	};
 
-}
\ No newline at end of file
+}
@@ -2,5 +2,5 @@
 
 namespace terra
 {
-	int64_t GTLFrameCounter = 0;
+	thread_local int64_t GTLFrameCounter = 0;
 }
@@ -4,5 +4,6 @@
 
 namespace terra
 {
-	extern int64_t GTLFrameCounter;
+	/** Frame number of the calling thread, each thread driving its own ScheduleTimer advances its own counter */
+	extern thread_local int64_t GTLFrameCounter;
 }
\ No newline at end of file
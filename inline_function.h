@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+
+namespace terra
+{
+	template <typename Signature, size_t InlineSize = 48>
+	class TInlineFunction;
+
+	/**
+	* Move-only replacement for std::function with a fixed inline buffer.
+	*
+	* Callables up to InlineSize bytes (lambdas capturing a handful of pointers or values) are stored in place,
+	* so constructing, moving and destroying one never touches the heap. Bigger callables still work but are
+	* boxed on the heap, the same way std::function stores them.
+	*
+	* Being move-only, it also accepts callables which can't be copied, e.g. lambdas capturing a unique_ptr.
+	*/
+	template <typename ReturnType, typename... ArgTypes, size_t InlineSize>
+	class TInlineFunction<ReturnType(ArgTypes...), InlineSize>
+	{
+	private:
+		static constexpr size_t kAlignment = alignof(std::max_align_t);
+		using Storage = typename std::aligned_storage<InlineSize, kAlignment>::type;
+
+		struct VTable
+		{
+			ReturnType(*invoke)(void* storage, ArgTypes&&... args);
+			/** Move constructs into dst from src, then destroys src */
+			void(*relocate)(void* dst, void* src);
+			void(*destroy)(void* storage);
+			const std::type_info&(*target_type)();
+		};
+
+		template <typename F>
+		struct IsInline : std::integral_constant<bool,
+			sizeof(F) <= InlineSize && kAlignment % alignof(F) == 0 && std::is_nothrow_move_constructible<F>::value> {};
+
+		template <typename F>
+		struct InlineOps
+		{
+			static F* Get(void* storage) { return static_cast<F*>(storage); }
+			static ReturnType Invoke(void* storage, ArgTypes&&... args) { return (*Get(storage))(std::forward<ArgTypes>(args)...); }
+			static void Relocate(void* dst, void* src)
+			{
+				::new (dst) F(std::move(*Get(src)));
+				Get(src)->~F();
+			}
+			static void Destroy(void* storage) { Get(storage)->~F(); }
+			static const std::type_info& TargetType() { return typeid(F); }
+			static const VTable* GetVTable()
+			{
+				static const VTable vtable{ &Invoke, &Relocate, &Destroy, &TargetType };
+				return &vtable;
+			}
+		};
+
+		template <typename F>
+		struct HeapOps
+		{
+			static F*& Get(void* storage) { return *static_cast<F**>(storage); }
+			static ReturnType Invoke(void* storage, ArgTypes&&... args) { return (*Get(storage))(std::forward<ArgTypes>(args)...); }
+			static void Relocate(void* dst, void* src)
+			{
+				::new (dst) F*(Get(src));
+				Get(src) = nullptr;
+			}
+			static void Destroy(void* storage) { delete Get(storage); }
+			static const std::type_info& TargetType() { return typeid(F); }
+			static const VTable* GetVTable()
+			{
+				static const VTable vtable{ &Invoke, &Relocate, &Destroy, &TargetType };
+				return &vtable;
+			}
+		};
+
+		template <typename F>
+		using EnableIfCallable = typename std::enable_if<
+			!std::is_same<typename std::decay<F>::type, TInlineFunction>::value &&
+			!std::is_same<typename std::decay<F>::type, std::nullptr_t>::value &&
+			std::is_convertible<decltype(std::declval<typename std::decay<F>::type&>()(std::declval<ArgTypes>()...)), ReturnType>::value>::type;
+
+		mutable Storage storage_;
+		const VTable* vtable_{ nullptr };
+
+	public:
+		TInlineFunction() noexcept = default;
+		TInlineFunction(std::nullptr_t) noexcept {}
+
+		template <typename F, typename = EnableIfCallable<F>>
+		TInlineFunction(F&& f)
+		{
+			Assign(std::forward<F>(f));
+		}
+
+		TInlineFunction(TInlineFunction&& other) noexcept
+		{
+			MoveFrom(other);
+		}
+
+		TInlineFunction& operator=(TInlineFunction&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Reset();
+				MoveFrom(other);
+			}
+			return *this;
+		}
+
+		TInlineFunction& operator=(std::nullptr_t) noexcept
+		{
+			Reset();
+			return *this;
+		}
+
+		template <typename F, typename = EnableIfCallable<F>>
+		TInlineFunction& operator=(F&& f)
+		{
+			Reset();
+			Assign(std::forward<F>(f));
+			return *this;
+		}
+
+		TInlineFunction(const TInlineFunction&) = delete;
+		TInlineFunction& operator=(const TInlineFunction&) = delete;
+
+		~TInlineFunction()
+		{
+			Reset();
+		}
+
+		/** Throws std::bad_function_call when empty, as std::function does. */
+		ReturnType operator()(ArgTypes... args) const
+		{
+			if (!vtable_)
+			{
+				throw std::bad_function_call();
+			}
+			return vtable_->invoke(&storage_, std::forward<ArgTypes>(args)...);
+		}
+
+		explicit operator bool() const noexcept { return vtable_ != nullptr; }
+
+		/** typeid of the stored callable, typeid(void) when empty. Mirrors std::function::target_type. */
+		const std::type_info& target_type() const noexcept
+		{
+			return vtable_ ? vtable_->target_type() : typeid(void);
+		}
+
+		/** Whether a callable of type F is stored without a heap allocation. */
+		template <typename F>
+		static constexpr bool IsStoredInline() { return IsInline<typename std::decay<F>::type>::value; }
+
+	private:
+		/** Null function and member pointers and empty std::functions make an empty TInlineFunction, as with std::function. */
+		template <typename F>
+		static bool IsNull(const F&) { return false; }
+		template <typename T>
+		static bool IsNull(T* f) { return f == nullptr; }
+		template <typename T, typename C>
+		static bool IsNull(T C::* f) { return f == nullptr; }
+		template <typename S>
+		static bool IsNull(const std::function<S>& f) { return !f; }
+		template <typename S, size_t N>
+		static bool IsNull(const TInlineFunction<S, N>& f) { return !f; }
+
+		template <typename F>
+		void Assign(F&& f)
+		{
+			using FunctorType = typename std::decay<F>::type;
+			if (IsNull(f))
+			{
+				return;
+			}
+			Construct<FunctorType>(std::forward<F>(f), IsInline<FunctorType>());
+		}
+
+		template <typename FunctorType, typename F>
+		void Construct(F&& f, std::true_type)
+		{
+			::new (static_cast<void*>(&storage_)) FunctorType(std::forward<F>(f));
+			vtable_ = InlineOps<FunctorType>::GetVTable();
+		}
+
+		template <typename FunctorType, typename F>
+		void Construct(F&& f, std::false_type)
+		{
+			::new (static_cast<void*>(&storage_)) FunctorType*(new FunctorType(std::forward<F>(f)));
+			vtable_ = HeapOps<FunctorType>::GetVTable();
+		}
+
+		void MoveFrom(TInlineFunction& other) noexcept
+		{
+			if (other.vtable_)
+			{
+				other.vtable_->relocate(&storage_, &other.storage_);
+				vtable_ = other.vtable_;
+				other.vtable_ = nullptr;
+			}
+		}
+
+		void Reset() noexcept
+		{
+			if (vtable_)
+			{
+				// clear first, the callable's destructor may reenter and reassign this object
+				const VTable* vtable = vtable_;
+				vtable_ = nullptr;
+				vtable->destroy(&storage_);
+			}
+		}
+	};
+}
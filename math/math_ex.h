@@ -1,6 +1,9 @@
 #pragma once
 
 #include <cstdint>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace terra
 {
@@ -14,4 +17,15 @@ namespace terra
 		v++;
 		return v;
 	}
-}
\ No newline at end of file
+
+	/** Index of the highest set bit, 0 for both 0 and 1. */
+	inline uint32_t FloorLog2_64(uint64_t v)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		return _BitScanReverse64(&index, v) ? static_cast<uint32_t>(index) : 0;
+#else
+		return v ? 63 - static_cast<uint32_t>(__builtin_clzll(v)) : 0;
+#endif
+	}
+}
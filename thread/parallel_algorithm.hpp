@@ -0,0 +1,292 @@
+/**
+* Parallel loops on top of ThreadPool: parallel_for, parallel_reduce and parallel_sort.
+*/
+#pragma once
+
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace terra
+{
+	namespace detail
+	{
+		/**
+		* Index range shared by the participants of one parallel loop, it lives on the calling thread's stack.
+		*
+		* Chunks are handed out guided: a participant takes 1/(2 * participants) of what is left, never less than the
+		* grain. Early chunks are big and cheap to hand out, the small ones at the end even out uneven work and
+		* participants that joined late.
+		*/
+		class ParallelRange
+		{
+		public:
+			ParallelRange(std::size_t first, std::size_t last, std::size_t grain, std::size_t participants)
+				:m_next{ first },
+				m_last{ last },
+				m_grain{ grain },
+				m_participants{ participants }
+			{
+			}
+
+			ParallelRange(const ParallelRange& rhs) = delete;
+			ParallelRange& operator=(const ParallelRange& rhs) = delete;
+
+			/**
+			* Claims the next chunk. Returns false when the range is used up or a participant failed.
+			*/
+			bool nextChunk(std::size_t& begin, std::size_t& end)
+			{
+				std::size_t next = m_next.load(std::memory_order_relaxed);
+				while (next < m_last && !m_failed.load(std::memory_order_relaxed))
+				{
+					const std::size_t remaining = m_last - next;
+					const std::size_t size = std::min(remaining, std::max(m_grain, remaining / (2 * m_participants)));
+					if (m_next.compare_exchange_weak(next, next + size, std::memory_order_relaxed))
+					{
+						begin = next;
+						end = next + size;
+						return true;
+					}
+				}
+				return false;
+			}
+
+			/** Keeps the first exception and stops handing out chunks. */
+			void fail(std::exception_ptr exception)
+			{
+				std::lock_guard<std::mutex> lock{ m_mutex };
+				if (!m_exception)
+				{
+					m_exception = exception;
+				}
+				m_failed.store(true, std::memory_order_relaxed);
+			}
+
+			void rethrowIfFailed(void)
+			{
+				if (m_exception)
+				{
+					std::rethrow_exception(m_exception);
+				}
+			}
+
+			std::mutex& mutex(void)
+			{
+				return m_mutex;
+			}
+
+		private:
+			std::atomic<std::size_t> m_next;
+			const std::size_t m_last;
+			const std::size_t m_grain;
+			const std::size_t m_participants;
+			std::atomic<bool> m_failed{ false };
+			std::exception_ptr m_exception;
+			/** Guards m_exception, and the result of a parallel_reduce */
+			std::mutex m_mutex;
+		};
+
+		/** Chunks per participant the automatic grain aims for, enough slack for uneven work. */
+		constexpr std::size_t kAutoChunksPerParticipant = 16;
+
+		inline std::size_t resolveGrain(ThreadPool& pool, std::size_t count, std::size_t grain)
+		{
+			if (grain > 0)
+			{
+				return grain;
+			}
+			return std::max<std::size_t>(count / ((pool.size() + 1) * kAutoChunksPerParticipant), 1);
+		}
+
+		/**
+		* Runs participant(range) on the calling thread and on up to pool.size() helpers posted to the pool, then
+		* waits for the helpers. While waiting the caller runs queued pool tasks, so a loop started from inside a
+		* worker can't deadlock on helpers stuck in that worker's own deque.
+		*/
+		template <typename Participant>
+		void runParallel(ThreadPool& pool, std::size_t first, std::size_t last, std::size_t grain, Participant& participant)
+		{
+			if (first >= last)
+			{
+				return;
+			}
+			const std::size_t count = last - first;
+			grain = resolveGrain(pool, count, grain);
+			const std::size_t chunks = (count + grain - 1) / grain;
+			const std::size_t participants = std::min<std::size_t>(pool.size() + 1, chunks);
+
+			ParallelRange range{ first, last, grain, participants };
+			auto participate = [&range, &participant]()
+			{
+				try
+				{
+					participant(range);
+				}
+				catch (...)
+				{
+					range.fail(std::current_exception());
+				}
+			};
+
+			std::atomic<std::size_t> activeHelpers{ participants - 1 };
+			for (std::size_t i = 1; i < participants; ++i)
+			{
+				pool.post([&participate, &activeHelpers]()
+				{
+					participate();
+					// last touch of the caller's stack
+					activeHelpers.fetch_sub(1, std::memory_order_release);
+				});
+			}
+			participate();
+			while (activeHelpers.load(std::memory_order_acquire) > 0)
+			{
+				if (!pool.tryRunPendingTask())
+				{
+					std::this_thread::yield();
+				}
+			}
+			range.rethrowIfFailed();
+		}
+	}
+
+	/**
+	* Calls fn(i) for every i in [first, last), spread over the pool and the calling thread.
+	*
+	* @param grain Fewest indices handed out at once, 0 picks one from the range size and pool size. Raise it when
+	*	fn is so cheap that claiming a chunk shows up.
+	*
+	* Returns once every call returned. The first exception thrown by fn stops the loop and is rethrown here.
+	*/
+	template <typename Func>
+	void parallel_for(ThreadPool& pool, std::size_t first, std::size_t last, std::size_t grain, Func&& fn)
+	{
+		auto participant = [&fn](detail::ParallelRange& range)
+		{
+			std::size_t begin = 0;
+			std::size_t end = 0;
+			while (range.nextChunk(begin, end))
+			{
+				for (std::size_t i = begin; i < end; ++i)
+				{
+					fn(i);
+				}
+			}
+		};
+		detail::runParallel(pool, first, last, grain, participant);
+	}
+
+	template <typename Func>
+	void parallel_for(std::size_t first, std::size_t last, std::size_t grain, Func&& fn)
+	{
+		parallel_for(DefaultThreadPool::getThreadPool(), first, last, grain, std::forward<Func>(fn));
+	}
+
+	/**
+	* Folds map(i) for every i in [first, last) with combine, starting from identity. Each participant folds its
+	* chunks into its own accumulator, the accumulators are combined at the end.
+	*
+	* combine must be associative and commutative: the order in which chunks and accumulators are combined changes
+	* from run to run, so floating point sums may differ in the last bits.
+	*/
+	template <typename T, typename MapFunc, typename CombineFunc>
+	T parallel_reduce(ThreadPool& pool, std::size_t first, std::size_t last, std::size_t grain, T identity, MapFunc&& map, CombineFunc&& combine)
+	{
+		T result = identity;
+		auto participant = [&identity, &result, &map, &combine](detail::ParallelRange& range)
+		{
+			T local = identity;
+			std::size_t begin = 0;
+			std::size_t end = 0;
+			while (range.nextChunk(begin, end))
+			{
+				for (std::size_t i = begin; i < end; ++i)
+				{
+					local = combine(std::move(local), map(i));
+				}
+			}
+			std::lock_guard<std::mutex> lock{ range.mutex() };
+			result = combine(std::move(result), std::move(local));
+		};
+		detail::runParallel(pool, first, last, grain, participant);
+		return result;
+	}
+
+	template <typename T, typename MapFunc, typename CombineFunc>
+	T parallel_reduce(std::size_t first, std::size_t last, std::size_t grain, T identity, MapFunc&& map, CombineFunc&& combine)
+	{
+		return parallel_reduce(DefaultThreadPool::getThreadPool(), first, last, grain, std::move(identity),
+			std::forward<MapFunc>(map), std::forward<CombineFunc>(combine));
+	}
+
+	/** Fewest elements per block of parallel_sort, smaller ranges are sorted on the calling thread. */
+	constexpr std::size_t kParallelSortCutoff = 1 << 14;
+
+	/**
+	* Sorts [first, last) with comp, not stable. The range is cut into a power of two number of blocks that are
+	* sorted in parallel with std::sort, then merged pairwise, each round of merges in parallel.
+	*/
+	template <typename RandomIt, typename Compare>
+	void parallel_sort(ThreadPool& pool, RandomIt first, RandomIt last, Compare comp)
+	{
+		static_assert(std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<RandomIt>::iterator_category>::value,
+			"parallel_sort needs random access iterators");
+
+		const std::size_t count = static_cast<std::size_t>(last - first);
+		std::size_t blocks = 1;
+		while (blocks < 2 * (pool.size() + 1) && count / (blocks * 2) >= kParallelSortCutoff)
+		{
+			blocks *= 2;
+		}
+		if (blocks == 1)
+		{
+			std::sort(first, last, comp);
+			return;
+		}
+
+		auto blockStart = [first, count, blocks](std::size_t block)
+		{
+			return first + static_cast<std::ptrdiff_t>(count * block / blocks);
+		};
+		parallel_for(pool, 0, blocks, 1, [&blockStart, &comp](std::size_t block)
+		{
+			std::sort(blockStart(block), blockStart(block + 1), comp);
+		});
+		for (std::size_t width = 1; width < blocks; width *= 2)
+		{
+			parallel_for(pool, 0, blocks / (2 * width), 1, [&blockStart, &comp, width](std::size_t merge)
+			{
+				const std::size_t low = 2 * merge * width;
+				std::inplace_merge(blockStart(low), blockStart(low + width), blockStart(low + 2 * width), comp);
+			});
+		}
+	}
+
+	template <typename RandomIt>
+	void parallel_sort(ThreadPool& pool, RandomIt first, RandomIt last)
+	{
+		parallel_sort(pool, first, last, std::less<typename std::iterator_traits<RandomIt>::value_type>());
+	}
+
+	template <typename RandomIt, typename Compare>
+	void parallel_sort(RandomIt first, RandomIt last, Compare comp)
+	{
+		parallel_sort(DefaultThreadPool::getThreadPool(), first, last, comp);
+	}
+
+	template <typename RandomIt>
+	void parallel_sort(RandomIt first, RandomIt last)
+	{
+		parallel_sort(DefaultThreadPool::getThreadPool(), first, last);
+	}
+}
@@ -4,6 +4,8 @@
 
 namespace terra
 {
+	class ThreadRecord;
+
 	/**
 	* Interface for ticking runnables when there's only one thread available and
 	* multithreading is disabled.
@@ -32,6 +34,11 @@ namespace terra
 	*/
 	class Runnable
 	{
+	private:
+		friend class RunnableThread;
+
+		ThreadRecord* thread_record_{ nullptr };
+
 	public:
 		virtual bool Init() { return true; }
 		virtual uint32_t Run() = 0;
@@ -46,5 +53,12 @@ namespace terra
 		*/
 		virtual class SingleThreadRunnable* GetSingleThreadInterface() { return nullptr; }
 		virtual ~Runnable() = default;
+
+	protected:
+		/**
+		* ThreadManager record of the RunnableThread running this, set before Init() and valid until Exit()
+		* returns. Run() marks itself idle while it waits and counts its work there. nullptr on any other thread.
+		*/
+		ThreadRecord* GetThreadRecord() const { return thread_record_; }
 	};
 }
\ No newline at end of file
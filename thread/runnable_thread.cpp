@@ -1,13 +1,14 @@
 #include "runnable_thread.h"
+#include "thread_manager.h"
 
 using namespace terra;
 
-std::unique_ptr<RunnableThread> RunnableThread::CreateThread(Runnable* runnable, const char* thread_name)
+std::unique_ptr<RunnableThread> RunnableThread::CreateThread(Runnable* runnable, const char* thread_name, const ThreadAffinity& affinity)
 {
 	std::unique_ptr<RunnableThread>  new_thread = std::make_unique<RunnableThread>();
 	if (new_thread)
 	{
-		if (!new_thread->CreateInternal(runnable, thread_name))
+		if (!new_thread->CreateInternal(runnable, thread_name, affinity))
 		{
 			new_thread.reset(nullptr);
 		}
@@ -15,15 +16,23 @@ std::unique_ptr<RunnableThread> RunnableThread::CreateThread(Runnable* runnable,
 	return new_thread;
 }
 
-bool RunnableThread::CreateInternal(Runnable* runnable, const char* thread_name)
+bool RunnableThread::CreateInternal(Runnable* runnable, const char* thread_name, const ThreadAffinity& affinity)
 {
 	runnable_ = runnable;
 	thread_name_ = thread_name;
+	affinity_ = affinity;
 	t_ = std::thread([this]() {
-		//FThreadManager::Get().AddThread(ThisThread->ThreadID, ThisThread);
+		// best effort, a thread the OS won't name or pin still runs
+		ThreadPlatform::SetCurrentThreadName(thread_name_.c_str());
+		ThreadPlatform::SetCurrentThreadAffinity(affinity_);
+		ScopedThreadRegistration registration(thread_name_.c_str());
+		record_.store(registration.GetRecord(), std::memory_order_release);
+		runnable_->thread_record_ = registration.GetRecord();
 		this->PreRun();
 		this->Run();
 		this->PostRun();
+		runnable_->thread_record_ = nullptr;
+		record_.store(nullptr, std::memory_order_release);
 	});
 	return true;
 }
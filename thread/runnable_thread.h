@@ -2,6 +2,7 @@
 
 #include "core.h"
 #include "runnable.h"
+#include "thread_affinity.h"
 
 namespace terra
 {
@@ -9,19 +10,28 @@ namespace terra
 	{
 	private:
 		std::string thread_name_;
+		ThreadAffinity affinity_;
 		Runnable* runnable_{ nullptr };
+		std::atomic<ThreadRecord*> record_{ nullptr };
 		std::thread t_;
 	public:
 		~RunnableThread()
 		{
 			Kill();
-			//if (!GIsRequestingExit)
-			//{
-			//	FThreadManager::Get().RemoveThread(this);
-			//}
 		}
 
-		static std::unique_ptr<RunnableThread> CreateThread(Runnable* runnable, const char* thread_name);
+		/**
+		* Starts a thread running runnable. The thread names itself thread_name and restricts itself to the CPUs of
+		* affinity before PreRun(), so a network, logic or DB thread stays on its cores. It is registered with the
+		* ThreadManager while it runs. The runnable gets the record through Runnable::GetThreadRecord() and should
+		* mark itself idle while it waits and count its work, otherwise the thread is left out of stall detection.
+		*/
+		static std::unique_ptr<RunnableThread> CreateThread(Runnable* runnable, const char* thread_name, const ThreadAffinity& affinity = ThreadAffinity());
+
+		const std::string& GetThreadName() const { return thread_name_; }
+		const ThreadAffinity& GetAffinity() const { return affinity_; }
+		/** ThreadManager record of the thread, nullptr before it started and after it finished. */
+		ThreadRecord* GetThreadRecord() const { return record_.load(std::memory_order_acquire); }
 
 		virtual void PreRun() { }
 		virtual void PostRun() { }
@@ -65,6 +75,6 @@ namespace terra
 			}
 		}
 	protected:
-		bool CreateInternal(Runnable* runnable, const char* thread_name);
+		bool CreateInternal(Runnable* runnable, const char* thread_name, const ThreadAffinity& affinity);
 	};
 }
\ No newline at end of file
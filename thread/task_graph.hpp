@@ -0,0 +1,425 @@
+/**
+* The TaskGraph class.
+* Frame jobs with dependencies, declared once and run on a ThreadPool every frame.
+*/
+#pragma once
+
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace terra
+{
+	/**
+	* Directed acyclic graph of jobs. Nodes and edges are declared once, run() then executes the whole graph:
+	* a node is dispatched to the pool as soon as its last predecessor finishes, and the thread that finished it
+	* runs one ready successor itself, so a chain of nodes stays on one thread.
+	*
+	* run() doesn't allocate once the pool's task slots are warm. It records when each node started and ended and
+	* derives the critical path, the chain of dependent nodes with the longest total run time, which bounds the
+	* frame no matter how many workers there are.
+	*
+	* Not thread-safe: declare the graph and call run() from one thread at a time.
+	*/
+	class TaskGraph
+	{
+	public:
+		using NodeId = std::size_t;
+
+		static constexpr NodeId kInvalidNode = static_cast<NodeId>(-1);
+
+		/** What the last run() measured for one node, times in nanoseconds since the start of run(). */
+		struct NodeTiming
+		{
+			std::int64_t startNs{ 0 };
+			std::int64_t endNs{ 0 };
+			/** How much longer the node could have run without lengthening the critical path */
+			std::int64_t slackNs{ 0 };
+
+			std::int64_t durationNs(void) const { return endNs - startNs; }
+		};
+
+	private:
+		struct Node
+		{
+			std::string name;
+			std::function<void(void)> func;
+			/** Declared edges, flattened into m_successors by compile() */
+			std::vector<NodeId> successors;
+			std::uint32_t predecessorCount{ 0 };
+			std::atomic<std::uint32_t> pending{ 0 };
+			NodeTiming timing;
+			/** Longest chain of node run times ending with this node */
+			std::int64_t pathNs{ 0 };
+			NodeId pathPredecessor{ kInvalidNode };
+		};
+
+	public:
+		/**
+		* Constructor.
+		* @param pool Pool the nodes run on, it must outlive the graph.
+		*/
+		explicit TaskGraph(ThreadPool& pool)
+			:m_pool{ pool }
+		{
+		}
+
+		/**
+		* Constructor, the nodes run on the default pool.
+		*/
+		TaskGraph(void)
+			:TaskGraph{ DefaultThreadPool::getThreadPool() }
+		{
+		}
+
+		/**
+		* Non-copyable.
+		*/
+		TaskGraph(const TaskGraph& rhs) = delete;
+
+		/**
+		* Non-assignable.
+		*/
+		TaskGraph& operator=(const TaskGraph& rhs) = delete;
+
+		/**
+		* Adds a node running func every frame.
+		* @param name Shows up in reports only, e.g. the name of the system the node updates.
+		*/
+		NodeId addNode(std::string name, std::function<void(void)> func)
+		{
+			m_nodes.emplace_back(std::make_unique<Node>());
+			Node& node = *m_nodes.back();
+			node.name = std::move(name);
+			node.func = std::move(func);
+			m_compiled = false;
+			return m_nodes.size() - 1;
+		}
+
+		/**
+		* Makes after wait for before every frame.
+		*/
+		void addEdge(NodeId before, NodeId after)
+		{
+			if (before >= m_nodes.size() || after >= m_nodes.size() || before == after)
+			{
+				throw std::invalid_argument("TaskGraph::addEdge: bad node id");
+			}
+			m_nodes[before]->successors.push_back(after);
+			++m_nodes[after]->predecessorCount;
+			m_compiled = false;
+		}
+
+		/**
+		* Runs every node once and returns when all finished, the calling thread runs nodes too.
+		* The first exception thrown by a node is rethrown here, nodes that haven't started by then are skipped.
+		* Throws std::logic_error if the edges form a cycle.
+		*/
+		void run(void)
+		{
+			if (!m_compiled)
+			{
+				compile();
+			}
+			if (m_nodes.empty())
+			{
+				return;
+			}
+
+			for (const auto& node : m_nodes)
+			{
+				node->pending.store(node->predecessorCount, std::memory_order_relaxed);
+			}
+			m_remaining.store(m_nodes.size(), std::memory_order_relaxed);
+			m_failed.store(false, std::memory_order_relaxed);
+			m_exception = nullptr;
+			m_startTime = std::chrono::steady_clock::now();
+
+			// roots other than the first go to the pool, the first runs here
+			for (std::size_t i = 1; i < m_roots.size(); ++i)
+			{
+				dispatch(m_roots[i]);
+			}
+			runFrom(m_roots[0]);
+			while (m_remaining.load(std::memory_order_acquire) > 0)
+			{
+				if (!m_pool.tryRunPendingTask())
+				{
+					std::this_thread::yield();
+				}
+			}
+			m_frameNs = elapsedNs();
+
+			updateCriticalPath();
+			if (m_exception)
+			{
+				std::rethrow_exception(m_exception);
+			}
+		}
+
+		/**
+		* Number of nodes.
+		*/
+		std::size_t size(void) const
+		{
+			return m_nodes.size();
+		}
+
+		const std::string& name(NodeId node) const
+		{
+			return m_nodes[node]->name;
+		}
+
+		/**
+		* Timing of a node in the last run().
+		*/
+		const NodeTiming& timing(NodeId node) const
+		{
+			return m_nodes[node]->timing;
+		}
+
+		/**
+		* Wall time of the last run() in nanoseconds.
+		*/
+		std::int64_t frameNs(void) const
+		{
+			return m_frameNs;
+		}
+
+		/**
+		* Nodes of the critical path of the last run(), first to last. Shortening any other node doesn't shorten
+		* the frame.
+		*/
+		const std::vector<NodeId>& criticalPath(void) const
+		{
+			return m_criticalPath;
+		}
+
+		/**
+		* Sum of the run times of the critical path nodes in the last run(). When the frame takes much longer than
+		* this, the pool was short of workers rather than the dependencies serializing the frame.
+		*/
+		std::int64_t criticalPathNs(void) const
+		{
+			return m_criticalPathNs;
+		}
+
+	private:
+		/**
+		* Flattens the edges, finds the roots and a topological order, rejects cycles.
+		*/
+		void compile(void)
+		{
+			const std::size_t count = m_nodes.size();
+			m_successorOffsets.assign(count + 1, 0);
+			m_successors.clear();
+			m_predecessorOffsets.assign(count + 1, 0);
+			m_roots.clear();
+
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				const Node& node = *m_nodes[i];
+				m_successors.insert(m_successors.end(), node.successors.begin(), node.successors.end());
+				m_successorOffsets[i + 1] = m_successors.size();
+				m_predecessorOffsets[i + 1] = m_predecessorOffsets[i] + node.predecessorCount;
+				if (node.predecessorCount == 0)
+				{
+					m_roots.push_back(i);
+				}
+			}
+			m_predecessors.assign(m_successors.size(), 0);
+			std::vector<std::size_t> filled(m_predecessorOffsets.begin(), m_predecessorOffsets.end() - 1);
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				for (const NodeId successor : m_nodes[i]->successors)
+				{
+					m_predecessors[filled[successor]++] = i;
+				}
+			}
+
+			// Kahn's algorithm, the order is reused to walk the critical path after every run
+			m_order.clear();
+			m_order.reserve(count);
+			std::vector<std::uint32_t> pending(count);
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				pending[i] = m_nodes[i]->predecessorCount;
+			}
+			m_order.insert(m_order.end(), m_roots.begin(), m_roots.end());
+			for (std::size_t i = 0; i < m_order.size(); ++i)
+			{
+				const NodeId node = m_order[i];
+				for (std::size_t edge = m_successorOffsets[node]; edge < m_successorOffsets[node + 1]; ++edge)
+				{
+					if (--pending[m_successors[edge]] == 0)
+					{
+						m_order.push_back(m_successors[edge]);
+					}
+				}
+			}
+			if (m_order.size() != count)
+			{
+				throw std::logic_error("TaskGraph: the edges form a cycle");
+			}
+
+			m_criticalPath.clear();
+			m_criticalPath.reserve(count);
+			m_compiled = true;
+		}
+
+		void dispatch(NodeId node)
+		{
+			m_pool.post([this, node]()
+			{
+				runFrom(node);
+			});
+		}
+
+		/**
+		* Runs node, then keeps running the first successor it made ready, the others go to the pool.
+		*/
+		void runFrom(NodeId node)
+		{
+			while (node != kInvalidNode)
+			{
+				execute(*m_nodes[node]);
+
+				NodeId next = kInvalidNode;
+				for (std::size_t edge = m_successorOffsets[node]; edge < m_successorOffsets[node + 1]; ++edge)
+				{
+					const NodeId successor = m_successors[edge];
+					if (m_nodes[successor]->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					{
+						if (next == kInvalidNode)
+						{
+							next = successor;
+						}
+						else
+						{
+							dispatch(successor);
+						}
+					}
+				}
+				// last touch of the graph when this was the last node, run() may return right after
+				m_remaining.fetch_sub(1, std::memory_order_acq_rel);
+				node = next;
+			}
+		}
+
+		void execute(Node& node)
+		{
+			node.timing.startNs = elapsedNs();
+			if (!m_failed.load(std::memory_order_relaxed))
+			{
+				try
+				{
+					node.func();
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock{ m_exceptionMutex };
+					if (!m_exception)
+					{
+						m_exception = std::current_exception();
+					}
+					m_failed.store(true, std::memory_order_relaxed);
+				}
+			}
+			node.timing.endNs = elapsedNs();
+		}
+
+		std::int64_t elapsedNs(void) const
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_startTime).count();
+		}
+
+		/**
+		* Longest path through the graph weighted by the measured node run times, plus each node's slack against it.
+		*/
+		void updateCriticalPath(void)
+		{
+			NodeId last = kInvalidNode;
+			m_criticalPathNs = 0;
+			for (const NodeId id : m_order)
+			{
+				Node& node = *m_nodes[id];
+				node.pathNs = 0;
+				node.pathPredecessor = kInvalidNode;
+				for (std::size_t edge = m_predecessorOffsets[id]; edge < m_predecessorOffsets[id + 1]; ++edge)
+				{
+					const Node& predecessor = *m_nodes[m_predecessors[edge]];
+					if (node.pathPredecessor == kInvalidNode || predecessor.pathNs > node.pathNs)
+					{
+						node.pathNs = predecessor.pathNs;
+						node.pathPredecessor = m_predecessors[edge];
+					}
+				}
+				node.pathNs += node.timing.durationNs();
+				if (last == kInvalidNode || node.pathNs > m_criticalPathNs)
+				{
+					last = id;
+					m_criticalPathNs = node.pathNs;
+				}
+			}
+
+			// latest finish of a node that keeps the critical path length, walked backwards; the slack is how far
+			// it is from the earliest finish, pathNs
+			for (auto it = m_order.rbegin(); it != m_order.rend(); ++it)
+			{
+				Node& node = *m_nodes[*it];
+				std::int64_t latestEndNs = m_criticalPathNs;
+				for (std::size_t edge = m_successorOffsets[*it]; edge < m_successorOffsets[*it + 1]; ++edge)
+				{
+					const Node& successor = *m_nodes[m_successors[edge]];
+					latestEndNs = std::min(latestEndNs, successor.pathNs - successor.timing.durationNs() + successor.timing.slackNs);
+				}
+				node.timing.slackNs = latestEndNs - node.pathNs;
+			}
+
+			m_criticalPath.clear();
+			for (NodeId id = last; id != kInvalidNode; id = m_nodes[id]->pathPredecessor)
+			{
+				m_criticalPath.push_back(id);
+			}
+			std::reverse(m_criticalPath.begin(), m_criticalPath.end());
+		}
+
+	private:
+		ThreadPool& m_pool;
+		std::vector<std::unique_ptr<Node>> m_nodes;
+		bool m_compiled{ false };
+
+		/** Successors of node i are m_successors[m_successorOffsets[i], m_successorOffsets[i + 1]) */
+		std::vector<std::size_t> m_successorOffsets;
+		std::vector<NodeId> m_successors;
+		/** Same layout as the successors */
+		std::vector<std::size_t> m_predecessorOffsets;
+		std::vector<NodeId> m_predecessors;
+		std::vector<NodeId> m_roots;
+		/** Topological order */
+		std::vector<NodeId> m_order;
+
+		std::atomic<std::size_t> m_remaining{ 0 };
+		std::atomic<bool> m_failed{ false };
+		std::mutex m_exceptionMutex;
+		std::exception_ptr m_exception;
+		std::chrono::steady_clock::time_point m_startTime;
+
+		std::int64_t m_frameNs{ 0 };
+		std::int64_t m_criticalPathNs{ 0 };
+		std::vector<NodeId> m_criticalPath;
+	};
+}
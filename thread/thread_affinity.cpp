@@ -0,0 +1,190 @@
+#include "thread_affinity.h"
+#include "core.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace terra;
+
+namespace
+{
+	/** Parses a sysfs CPU or node list such as "0-3,8-11". */
+	std::vector<uint32_t> ParseCpuList(const char* text)
+	{
+		std::vector<uint32_t> cpus;
+		const char* p = text;
+		while (*p >= '0' && *p <= '9')
+		{
+			char* end = nullptr;
+			const unsigned long first = std::strtoul(p, &end, 10);
+			unsigned long last = first;
+			p = end;
+			if (*p == '-')
+			{
+				last = std::strtoul(p + 1, &end, 10);
+				p = end;
+			}
+			for (unsigned long cpu = first; cpu <= last; ++cpu)
+			{
+				cpus.push_back(static_cast<uint32_t>(cpu));
+			}
+			if (*p == ',')
+			{
+				++p;
+			}
+		}
+		return cpus;
+	}
+}
+
+std::vector<uint32_t> ThreadAffinity::Resolve() const
+{
+	if (!cpus.empty() || numa_node < 0)
+	{
+		return cpus;
+	}
+	return ThreadPlatform::GetNumaNodeCpus(numa_node);
+}
+
+bool ThreadPlatform::SetCurrentThreadName(const char* name)
+{
+#if defined(__linux__)
+	// the kernel keeps 16 bytes including the terminator and rejects longer names
+	char truncated[16];
+	strncpy(truncated, name, sizeof(truncated) - 1);
+	truncated[sizeof(truncated) - 1] = '\0';
+	return pthread_setname_np(pthread_self(), truncated) == 0;
+#elif defined(_WIN32)
+	wchar_t wide[256];
+	if (MultiByteToWideChar(CP_UTF8, 0, name, -1, wide, 256) == 0)
+	{
+		return false;
+	}
+	return SUCCEEDED(SetThreadDescription(GetCurrentThread(), wide));
+#else
+	return false;
+#endif
+}
+
+bool ThreadPlatform::SetCurrentThreadAffinity(const ThreadAffinity& affinity)
+{
+	if (affinity.IsDefault())
+	{
+		return true;
+	}
+	const std::vector<uint32_t> cpus = affinity.Resolve();
+	if (cpus.empty())
+	{
+		return false;
+	}
+#if defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (uint32_t cpu : cpus)
+	{
+		if (cpu < CPU_SETSIZE)
+		{
+			CPU_SET(cpu, &set);
+		}
+	}
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+	// one processor group only, which is every CPU on machines with up to 64
+	DWORD_PTR mask = 0;
+	for (uint32_t cpu : cpus)
+	{
+		if (cpu < sizeof(DWORD_PTR) * 8)
+		{
+			mask |= DWORD_PTR{ 1 } << cpu;
+		}
+	}
+	return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+	return false;
+#endif
+}
+
+int32_t ThreadPlatform::GetNumaNodeCount()
+{
+#if defined(__linux__)
+	int32_t count = 1;
+	if (FILE* fp = std::fopen("/sys/devices/system/node/online", "r"))
+	{
+		char text[256] = {};
+		if (std::fgets(text, sizeof(text), fp))
+		{
+			const std::vector<uint32_t> nodes = ParseCpuList(text);
+			if (!nodes.empty())
+			{
+				count = static_cast<int32_t>(nodes.back()) + 1;
+			}
+		}
+		std::fclose(fp);
+	}
+	return count;
+#elif defined(_WIN32)
+	ULONG highest = 0;
+	if (!GetNumaHighestNodeNumber(&highest))
+	{
+		return 1;
+	}
+	return static_cast<int32_t>(highest) + 1;
+#else
+	return 1;
+#endif
+}
+
+std::vector<uint32_t> ThreadPlatform::GetNumaNodeCpus(int32_t node)
+{
+	std::vector<uint32_t> cpus;
+	if (node < 0)
+	{
+		return cpus;
+	}
+#if defined(__linux__)
+	char path[64];
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+	if (FILE* fp = std::fopen(path, "r"))
+	{
+		char text[1024] = {};
+		if (std::fgets(text, sizeof(text), fp))
+		{
+			cpus = ParseCpuList(text);
+		}
+		std::fclose(fp);
+	}
+	else if (node == 0)
+	{
+		// no sysfs NUMA info, e.g. in some containers: one node with every CPU
+		const uint32_t count = std::thread::hardware_concurrency();
+		for (uint32_t cpu = 0; cpu < count; ++cpu)
+		{
+			cpus.push_back(cpu);
+		}
+	}
+#elif defined(_WIN32)
+	ULONGLONG mask = 0;
+	if (node <= 0xFF && GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask))
+	{
+		for (uint32_t cpu = 0; cpu < 64; ++cpu)
+		{
+			if (mask & (ULONGLONG{ 1 } << cpu))
+			{
+				cpus.push_back(cpu);
+			}
+		}
+	}
+#else
+	if (node == 0)
+	{
+		const uint32_t count = std::thread::hardware_concurrency();
+		for (uint32_t cpu = 0; cpu < count; ++cpu)
+		{
+			cpus.push_back(cpu);
+		}
+	}
+#endif
+	return cpus;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace terra
+{
+	/**
+	* Where a thread may run. Default constructed it leaves placement to the OS.
+	*/
+	struct ThreadAffinity
+	{
+		/** CPUs the thread may run on, empty for any */
+		std::vector<uint32_t> cpus;
+		/** NUMA node whose CPUs the thread runs on when cpus is empty, -1 for none */
+		int32_t numa_node{ -1 };
+
+		static ThreadAffinity Cpu(uint32_t cpu)
+		{
+			ThreadAffinity affinity;
+			affinity.cpus.push_back(cpu);
+			return affinity;
+		}
+
+		static ThreadAffinity NumaNode(int32_t node)
+		{
+			ThreadAffinity affinity;
+			affinity.numa_node = node;
+			return affinity;
+		}
+
+		bool IsDefault() const { return cpus.empty() && numa_node < 0; }
+
+		/** The CPUs this affinity allows, empty when any CPU will do or the NUMA node is unknown. */
+		std::vector<uint32_t> Resolve() const;
+	};
+
+	/**
+	* Thread naming and placement of the calling thread. Linux and Windows, elsewhere the setters return false and
+	* the queries report one NUMA node holding every CPU.
+	*/
+	class ThreadPlatform
+	{
+	public:
+		/**
+		* Names the calling thread for debuggers, profilers and top -H. Linux cuts names to 15 characters.
+		* Returns false if the OS refused or doesn't support it.
+		*/
+		static bool SetCurrentThreadName(const char* name);
+
+		/**
+		* Restricts the calling thread to the CPUs of affinity. A default affinity is a no-op that returns true.
+		* Returns false if the OS refused, e.g. none of the CPUs is available to the process.
+		*/
+		static bool SetCurrentThreadAffinity(const ThreadAffinity& affinity);
+
+		/** Number of NUMA nodes, at least 1. */
+		static int32_t GetNumaNodeCount();
+
+		/** CPUs of a NUMA node, empty when the node doesn't exist. */
+		static std::vector<uint32_t> GetNumaNodeCpus(int32_t node);
+	};
+}
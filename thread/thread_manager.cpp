@@ -0,0 +1,149 @@
+#include "thread_manager.h"
+#include "core.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+using namespace terra;
+
+namespace
+{
+	thread_local ThreadRecord* t_current_thread = nullptr;
+}
+
+ThreadRecord::ThreadRecord(uint64_t id, const char* name)
+	: id_(id)
+	, name_(name)
+	, state_since_ns_(NowNs())
+{
+}
+
+ThreadManager& ThreadManager::Get()
+{
+	static ThreadManager* manager = new ThreadManager();
+	return *manager;
+}
+
+ThreadRecord* ThreadManager::AddThread(const char* name)
+{
+	Expects(t_current_thread == nullptr);
+	std::lock_guard<std::mutex> lock(mutex_);
+	threads_.emplace_back(std::make_unique<ThreadRecord>(next_id_++, name));
+	ThreadRecord* record = threads_.back().get();
+#if defined(__linux__)
+	record->os_thread_id_ = static_cast<uint64_t>(syscall(SYS_gettid));
+	// a CPU clock other threads can read, CLOCK_THREAD_CPUTIME_ID would only measure the reader
+	clockid_t clock;
+	if (pthread_getcpuclockid(pthread_self(), &clock) == 0)
+	{
+		record->cpu_clock_ = static_cast<intptr_t>(clock);
+		record->has_cpu_clock_ = true;
+	}
+#elif defined(_WIN32)
+	record->os_thread_id_ = GetCurrentThreadId();
+	if (HANDLE handle = OpenThread(THREAD_QUERY_LIMITED_INFORMATION, FALSE, GetCurrentThreadId()))
+	{
+		record->cpu_clock_ = reinterpret_cast<intptr_t>(handle);
+		record->has_cpu_clock_ = true;
+	}
+#endif
+	t_current_thread = record;
+	return record;
+}
+
+void ThreadManager::RemoveThread(ThreadRecord* record)
+{
+	Expects(record == t_current_thread);
+	t_current_thread = nullptr;
+	std::lock_guard<std::mutex> lock(mutex_);
+#if defined(_WIN32)
+	if (record->has_cpu_clock_)
+	{
+		CloseHandle(reinterpret_cast<HANDLE>(record->cpu_clock_));
+	}
+#endif
+	threads_.erase(std::remove_if(threads_.begin(), threads_.end(), [record](const std::unique_ptr<ThreadRecord>& r) {
+		return r.get() == record;
+	}), threads_.end());
+}
+
+ThreadRecord* ThreadManager::GetCurrentThread()
+{
+	return t_current_thread;
+}
+
+void ThreadManager::GetSnapshot(ThreadManagerSnapshot& out_snapshot) const
+{
+	out_snapshot.threads.clear();
+	std::lock_guard<std::mutex> lock(mutex_);
+	// a thread leaves under mutex_, so every CPU clock read below belongs to a live thread
+	const int64_t now = ThreadRecord::NowNs();
+	out_snapshot.taken_ns = now;
+	out_snapshot.threads.reserve(threads_.size());
+	for (const std::unique_ptr<ThreadRecord>& record : threads_)
+	{
+		ThreadSnapshot thread;
+		thread.id = record->id_;
+		thread.name = record->name_;
+		thread.os_thread_id = record->os_thread_id_;
+		thread.idle = record->idle_.load(std::memory_order_relaxed);
+		thread.reporting = record->reporting_.load(std::memory_order_relaxed);
+		const int64_t since = record->state_since_ns_.load(std::memory_order_relaxed);
+		thread.state_ns = std::max<int64_t>(now - since, 0);
+		thread.busy_ns = record->busy_ns_.load(std::memory_order_relaxed) + (thread.idle ? 0 : thread.state_ns);
+		thread.idle_ns = record->idle_ns_.load(std::memory_order_relaxed) + (thread.idle ? thread.state_ns : 0);
+		thread.tasks_executed = record->tasks_.load(std::memory_order_relaxed);
+		if (record->has_cpu_clock_)
+		{
+#if defined(__linux__)
+			timespec ts;
+			if (clock_gettime(static_cast<clockid_t>(record->cpu_clock_), &ts) == 0)
+			{
+				thread.cpu_time_ns = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+			}
+#elif defined(_WIN32)
+			FILETIME creation, exit, kernel, user;
+			if (GetThreadTimes(reinterpret_cast<HANDLE>(record->cpu_clock_), &creation, &exit, &kernel, &user))
+			{
+				const uint64_t kernel_100ns = (static_cast<uint64_t>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+				const uint64_t user_100ns = (static_cast<uint64_t>(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+				thread.cpu_time_ns = static_cast<int64_t>((kernel_100ns + user_100ns) * 100);
+			}
+#endif
+		}
+		out_snapshot.threads.push_back(std::move(thread));
+	}
+}
+
+size_t ThreadManager::GetThreadCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return threads_.size();
+}
+
+std::vector<uint64_t> ThreadManager::FindStalledThreads(const ThreadManagerSnapshot& before, const ThreadManagerSnapshot& after)
+{
+	std::vector<uint64_t> stalled;
+	for (const ThreadSnapshot& thread : after.threads)
+	{
+		// a thread that never reports looks busy forever
+		if (thread.idle || !thread.reporting)
+		{
+			continue;
+		}
+		for (const ThreadSnapshot& earlier : before.threads)
+		{
+			// busy in both and never switched state in between
+			if (earlier.id == thread.id && !earlier.idle && thread.tasks_executed == earlier.tasks_executed
+				&& thread.state_ns >= after.taken_ns - before.taken_ns)
+			{
+				stalled.push_back(thread.id);
+				break;
+			}
+		}
+	}
+	return stalled;
+}
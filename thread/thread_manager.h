@@ -0,0 +1,180 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace terra
+{
+	/**
+	* Activity accounting of one registered thread. Only its own thread updates it, any thread may read it through
+	* ThreadManager::GetSnapshot().
+	*
+	* A thread is busy until it calls MarkIdle() and idle until it calls MarkBusy(). The clock is only read when the
+	* state changes, so a thread that stays busy under load pays nothing but AddTasks() per task. A thread that never
+	* calls MarkIdle() or AddTasks() is not reporting, its busy time says nothing about its load.
+	*/
+	class ThreadRecord
+	{
+	private:
+		friend class ThreadManager;
+
+		const uint64_t id_;
+		const std::string name_;
+		uint64_t os_thread_id_{ 0 };
+		/** clockid_t of the thread's CPU clock on Linux, a thread HANDLE on Windows */
+		intptr_t cpu_clock_{ 0 };
+		bool has_cpu_clock_{ false };
+
+		std::atomic<bool> idle_{ false };
+		std::atomic<bool> reporting_{ false };
+		std::atomic<int64_t> state_since_ns_;
+		std::atomic<int64_t> busy_ns_{ 0 };
+		std::atomic<int64_t> idle_ns_{ 0 };
+		std::atomic<uint64_t> tasks_{ 0 };
+
+	public:
+		ThreadRecord(uint64_t id, const char* name);
+		ThreadRecord(const ThreadRecord&) = delete;
+		ThreadRecord& operator=(const ThreadRecord&) = delete;
+
+		static int64_t NowNs()
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		/** Own thread only. */
+		void MarkIdle() { SetIdle(true); }
+		/** Own thread only. */
+		void MarkBusy() { SetIdle(false); }
+
+		/** Own thread only. */
+		void AddTasks(uint64_t count)
+		{
+			SetReporting();
+			tasks_.store(tasks_.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+		}
+
+		uint64_t GetId() const { return id_; }
+		const std::string& GetName() const { return name_; }
+
+	private:
+		void SetReporting()
+		{
+			if (!reporting_.load(std::memory_order_relaxed))
+			{
+				reporting_.store(true, std::memory_order_relaxed);
+			}
+		}
+
+		void SetIdle(bool idle)
+		{
+			if (idle_.load(std::memory_order_relaxed) == idle)
+			{
+				return;
+			}
+			if (idle)
+			{
+				SetReporting();
+			}
+			const int64_t now = NowNs();
+			std::atomic<int64_t>& elapsed = idle ? busy_ns_ : idle_ns_;
+			elapsed.store(elapsed.load(std::memory_order_relaxed) + now - state_since_ns_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			state_since_ns_.store(now, std::memory_order_relaxed);
+			idle_.store(idle, std::memory_order_relaxed);
+		}
+	};
+
+	/** One thread at the time of a snapshot. Times are in nanoseconds since the thread registered. */
+	struct ThreadSnapshot
+	{
+		uint64_t id{ 0 };
+		std::string name;
+		/** gettid() on Linux, GetCurrentThreadId() on Windows */
+		uint64_t os_thread_id{ 0 };
+		/** CPU time the thread used, user plus system, -1 when the OS can't tell */
+		int64_t cpu_time_ns{ -1 };
+		int64_t busy_ns{ 0 };
+		int64_t idle_ns{ 0 };
+		bool idle{ false };
+		/** Whether the thread ever marked itself idle or counted a task, busy_ns only means something if it did */
+		bool reporting{ false };
+		/** Time since the thread last switched between busy and idle */
+		int64_t state_ns{ 0 };
+		uint64_t tasks_executed{ 0 };
+
+		/** Share of its lifetime the thread was busy. */
+		double GetUtilization() const
+		{
+			const int64_t total = busy_ns + idle_ns;
+			return total > 0 ? static_cast<double>(busy_ns) / total : 0.0;
+		}
+	};
+
+	struct ThreadManagerSnapshot
+	{
+		/** steady_clock time of the snapshot */
+		int64_t taken_ns{ 0 };
+		/** In registration order */
+		std::vector<ThreadSnapshot> threads;
+	};
+
+	/**
+	* Registry of the running RunnableThreads and ThreadPool workers, for sizing pools and finding stuck threads.
+	* Threads register themselves when they start and leave when they exit.
+	*/
+	class ThreadManager
+	{
+	private:
+		mutable std::mutex mutex_;
+		std::vector<std::unique_ptr<ThreadRecord>> threads_;
+		uint64_t next_id_{ 1 };
+
+	public:
+		/** Never destroyed, threads of static pools may still leave it during exit. */
+		static ThreadManager& Get();
+
+		/** Registers the calling thread, which must not be registered already. */
+		ThreadRecord* AddThread(const char* name);
+		/** Unregisters the calling thread. */
+		void RemoveThread(ThreadRecord* record);
+
+		/** Record of the calling thread, nullptr if it isn't registered. */
+		static ThreadRecord* GetCurrentThread();
+
+		void GetSnapshot(ThreadManagerSnapshot& out_snapshot) const;
+		size_t GetThreadCount() const;
+
+		/**
+		* Ids of threads that were busy in both snapshots and finished no task in between: a stuck task, or a
+		* thread that doesn't count its tasks. Threads that are not reporting are left out. Take the snapshots a few
+		* seconds apart.
+		*/
+		static std::vector<uint64_t> FindStalledThreads(const ThreadManagerSnapshot& before, const ThreadManagerSnapshot& after);
+	};
+
+	/** Registers the calling thread for the lifetime of the scope. */
+	class ScopedThreadRegistration
+	{
+	private:
+		ThreadRecord* const record_;
+
+	public:
+		explicit ScopedThreadRegistration(const char* name)
+			: record_(ThreadManager::Get().AddThread(name))
+		{
+		}
+		~ScopedThreadRegistration()
+		{
+			ThreadManager::Get().RemoveThread(record_);
+		}
+		ScopedThreadRegistration(const ScopedThreadRegistration&) = delete;
+		ScopedThreadRegistration& operator=(const ScopedThreadRegistration&) = delete;
+
+		ThreadRecord* GetRecord() const { return record_; }
+	};
+}
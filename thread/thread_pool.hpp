@@ -4,14 +4,26 @@
 */
 #pragma once
 
-#include "thread_safe_queue.hpp"
+#include "work_stealing_deque.hpp"
+#include "inline_function.h"
+#include "math/math_ex.h"
+#include "thread_affinity.h"
+#include "thread_manager.h"
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
+#include <exception>
 #include <functional>
 #include <future>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
 #include <thread>
 #include <type_traits>
 #include <utility>
@@ -19,9 +31,80 @@
 
 namespace terra
 {
+	/**
+	* Scheduling class of a pool job.
+	*/
+	enum class TaskPriority : std::uint8_t
+	{
+		/** Latency critical, e.g. a login handshake: taken before any other queued job */
+		High,
+		Normal,
+		/** Bulk work, e.g. save-game serialization: taken when nothing else is queued, or once it waited too long */
+		Background,
+	};
+
+	struct TaskOptions
+	{
+		TaskPriority priority{ TaskPriority::Normal };
+		/**
+		* Latest time the job should start, none when left default. A job starting later is counted as a deadline
+		* miss and reported, a queued job whose deadline has come is taken ahead of the higher lanes.
+		*/
+		std::chrono::steady_clock::time_point deadline{};
+	};
+
+	/**
+	* How ThreadPool places its workers on CPUs.
+	*/
+	enum class WorkerPlacement : std::uint8_t
+	{
+		/** Every worker gets ThreadPoolOptions::affinity, by default free to float over all CPUs */
+		Shared,
+		/** Worker i is pinned to the i-th CPU of ThreadPoolOptions::affinity (all CPUs when default), round robin */
+		PinEach,
+		/** Worker i is kept on the CPUs of NUMA node i % node count, so the workers spread evenly over the nodes */
+		SpreadNumaNodes,
+	};
+
+	struct ThreadPoolOptions
+	{
+		/** Number of workers, 0 for hardware_concurrency() - 1 and at least 1 */
+		std::uint32_t threadCount{ 0 };
+		/** Workers are named "<name>-<index>", keep it short: Linux cuts thread names to 15 characters */
+		std::string name{ "pool" };
+		ThreadAffinity affinity{};
+		WorkerPlacement placement{ WorkerPlacement::Shared };
+	};
+
+	/**
+	* Work stealing pool. Every worker owns a lock-free deque: tasks submitted from inside a task go to the
+	* submitting worker's deque and are popped LIFO, idle workers steal FIFO from the others. Tasks submitted from
+	* outside the pool go to one of three shared FIFO lanes by priority, workers drain the normal lane in small
+	* batches. Workers that find nothing spin briefly, then park until new work is submitted.
+	*
+	* Workers look for work in this order: a normal or background job that waited past the starvation limit or
+	* reached its deadline, the high lane, their own deque, the normal lane, the other workers' deques, the
+	* background lane. Jobs going through a lane are timestamped for the per-lane stats of laneStats(); normal jobs a
+	* worker submits stay in its own deque and are left out of them, unless they have a deadline.
+	*
+	* submit() allocates a std::packaged_task and the task object per job. post() and submitPooled() keep small
+	* callables inline in task slots recycled through per-worker and per-pool freelists, so once the slots are warm
+	* they submit without touching the heap.
+	*
+	* Workers register with the ThreadManager as "<name>-<index>": they count as idle from the first time they
+	* find no task until they find one, and count the tasks they run.
+	*
+	* Futures of submit() can be chained with then() and combined with whenAll() and whenAny(): the follow-up work
+	* is scheduled by the job that completes last (or first), no thread blocks in get() in the meantime.
+	*/
 	class ThreadPool
 	{
 	private:
+		/** Callables up to this size are stored inline in a pooled task slot, bigger ones are boxed on the heap. */
+		static constexpr std::size_t kTaskInlineSize = 48;
+		/** Biggest result a pooled future can carry. */
+		static constexpr std::size_t kResultSize = 32;
+
 		class IThreadTask
 		{
 		public:
@@ -36,69 +119,551 @@ namespace terra
 			* Run the task.
 			*/
 			virtual void execute() = 0;
+
+			/**
+			* Called by the pool after execute(), or instead of it when the pool is destroyed before the task ran.
+			* Heap tasks delete themselves, pooled tasks go back to a freelist.
+			*/
+			virtual void finish(void)
+			{
+				delete this;
+			}
+
+			/** Link of the lanes and the slot freelists, a task is in at most one of them at a time. */
+			IThreadTask* m_next{ nullptr };
+			/** Time the task entered a lane, 0 for tasks that went straight to a worker's deque */
+			std::int64_t m_enqueueNs{ 0 };
+			/** Time the task is taken ahead of higher lanes: it waited too long or its deadline came */
+			std::int64_t m_promoteNs{ 0 };
+			/** 0 for none */
+			std::int64_t m_deadlineNs{ 0 };
+			std::uint8_t m_lane{ 0 };
 		};
 
-		template <typename Func>
-		class ThreadTask : public IThreadTask
+		/**
+		* Task of submit(), shared by the worker running it and the TaskFuture of its result, the last one to let go
+		* deletes it. Keeps the continuations registered by TaskFuture::then() and whenAll()/whenAny() and runs them
+		* on the thread that completes the task.
+		*/
+		class ContinuableTask : public IThreadTask
 		{
 		public:
-			ThreadTask(Func&& func)
-				:m_func{ std::move(func) }
+			explicit ContinuableTask(ThreadPool* pool)
+				:m_pool{ pool }
+			{
+			}
+
+			void execute() override
 			{
+				run();
+				m_executed = true;
+				complete();
 			}
 
-			~ThreadTask(void) override = default;
-			ThreadTask(const ThreadTask& rhs) = delete;
-			ThreadTask& operator=(const ThreadTask& rhs) = delete;
-			ThreadTask(ThreadTask&& other) = default;
-			ThreadTask& operator=(ThreadTask&& other) = default;
+			void finish() override
+			{
+				if (!m_executed)
+				{
+					// dropped by a pool shutting down, the future gets a broken_promise
+					abandon();
+					complete();
+				}
+				release();
+			}
 
 			/**
-			* Run the task.
+			* Calls continuation once the task completed, right away if it already has. Continuations should be
+			* short, they hold up the thread completing the task.
 			*/
+			void onComplete(std::function<void(void)> continuation)
+			{
+				{
+					std::lock_guard<std::mutex> lock{ m_mutex };
+					if (!m_completed)
+					{
+						m_continuations.push_back(std::move(continuation));
+						return;
+					}
+				}
+				continuation();
+			}
+
+			void release(void)
+			{
+				if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				{
+					delete this;
+				}
+			}
+
+			ThreadPool* pool(void) const
+			{
+				return m_pool;
+			}
+
+		protected:
+			virtual void run(void) = 0;
+			/** Gives up the result without running, so that waiters don't hang. */
+			virtual void abandon(void) = 0;
+
+		private:
+			void complete(void)
+			{
+				std::vector<std::function<void(void)>> continuations;
+				{
+					std::lock_guard<std::mutex> lock{ m_mutex };
+					m_completed = true;
+					continuations.swap(m_continuations);
+				}
+				for (auto& continuation : continuations)
+				{
+					continuation();
+				}
+			}
+
+			ThreadPool* const m_pool;
+			std::atomic<int> m_refs{ 2 };
+			bool m_executed{ false };
+			std::mutex m_mutex;
+			bool m_completed{ false };
+			std::vector<std::function<void(void)>> m_continuations;
+		};
+
+		template <typename PackagedTask>
+		class FutureTask final : public ContinuableTask
+		{
+		public:
+			FutureTask(ThreadPool* pool, PackagedTask&& task)
+				:ContinuableTask{ pool },
+				m_task{ std::move(task) }
+			{
+			}
+
+		protected:
+			void run(void) override
+			{
+				m_task();
+			}
+
+			void abandon(void) override
+			{
+				m_task = PackagedTask{};
+			}
+
+		private:
+			PackagedTask m_task;
+		};
+
+		/**
+		* Task slot of post() and submitPooled(). Slots are allocated in chunks, recycled through the freelists and
+		* only freed with the pool. A slot is shared by the worker running it and the PooledTaskFuture waiting on it,
+		* the last one to let go recycles it.
+		*/
+		class PooledTask final : public IThreadTask
+		{
+		public:
+			using Function = TInlineFunction<void(void*), kTaskInlineSize>;
+
 			void execute() override
 			{
-				m_func();
+				try
+				{
+					m_func(m_result);
+					m_hasResult = true;
+				}
+				catch (...)
+				{
+					m_exception = std::current_exception();
+				}
+				m_func = nullptr;
+				complete();
+			}
+
+			void finish() override
+			{
+				if (m_state.load(std::memory_order_acquire) != kReady)
+				{
+					// dropped by a pool shutting down
+					m_func = nullptr;
+					m_exception = std::make_exception_ptr(std::future_error(std::future_errc::broken_promise));
+					complete();
+				}
+				release();
+			}
+
+			void wait(void)
+			{
+				// most jobs are short, give the worker a few time slices before paying for a sleep and a wake-up
+				for (int i = 0; i < kWaitYieldRounds; ++i)
+				{
+					if (m_state.load(std::memory_order_acquire) == kReady)
+					{
+						return;
+					}
+					std::this_thread::yield();
+				}
+				std::unique_lock<std::mutex> lock{ m_mutex };
+				int expected = kPending;
+				m_state.compare_exchange_strong(expected, kWaiting, std::memory_order_acq_rel, std::memory_order_acquire);
+				m_condition.wait(lock, [this]()
+				{
+					return m_state.load(std::memory_order_acquire) == kReady;
+				});
+			}
+
+			bool isReady(void) const
+			{
+				return m_state.load(std::memory_order_acquire) == kReady;
+			}
+
+			void release(void)
+			{
+				if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				{
+					if (m_hasResult && m_destroyResult)
+					{
+						// nobody took the result, its future was detached or dropped without get()
+						m_destroyResult(m_result);
+					}
+					m_pool->recycleSlot(this);
+				}
 			}
 
 		private:
-			Func m_func;
+			friend class ThreadPool;
+
+			using ResultDestructor = void (*)(void*);
+
+			enum : int { kPending, kWaiting, kReady };
+			static constexpr int kWaitYieldRounds = 16;
+
+			void reset(ThreadPool* pool, int refs)
+			{
+				m_pool = pool;
+				m_next = nullptr;
+				m_enqueueNs = 0;
+				m_deadlineNs = 0;
+				m_refs.store(refs, std::memory_order_relaxed);
+				m_state.store(kPending, std::memory_order_relaxed);
+				m_hasResult = false;
+				m_destroyResult = nullptr;
+				m_exception = nullptr;
+			}
+
+			/** Only locks when a future is already waiting. */
+			void complete(void)
+			{
+				if (m_state.exchange(kReady, std::memory_order_acq_rel) == kWaiting)
+				{
+					std::lock_guard<std::mutex> lock{ m_mutex };
+					m_condition.notify_all();
+				}
+			}
+
+			Function m_func;
+			ThreadPool* m_pool{ nullptr };
+			std::atomic<int> m_refs{ 0 };
+			std::atomic<int> m_state{ kPending };
+			bool m_hasResult{ false };
+			/** Set by submitPooled() for results that aren't trivially destructible */
+			ResultDestructor m_destroyResult{ nullptr };
+			std::exception_ptr m_exception;
+			std::mutex m_mutex;
+			std::condition_variable m_condition;
+			alignas(std::max_align_t) unsigned char m_result[kResultSize];
 		};
 
 	public:
 		/**
 		* A wrapper around a std::future that adds the behavior of futures returned from std::async.
-		* Specifically, this object will block and wait for execution to finish before going out of scope.
+		* Specifically, this object will block and wait for execution to finish before going out of scope,
+		* unless it was detached, consumed by then() or handed to whenAll()/whenAny().
 		*/
 		template <typename T>
 		class TaskFuture
 		{
 		public:
-			TaskFuture(std::future<T>&& future)
-				:m_future{ std::move(future) }
-			{
-			}
+			TaskFuture(void) = default;
 
 			TaskFuture(const TaskFuture& rhs) = delete;
 			TaskFuture& operator=(const TaskFuture& rhs) = delete;
-			TaskFuture(TaskFuture&& other) = default;
-			TaskFuture& operator=(TaskFuture&& other) = default;
+			TaskFuture(TaskFuture&& other)
+				:m_future{ std::move(other.m_future) },
+				m_task{ other.m_task }
+			{
+				other.m_task = nullptr;
+			}
+			TaskFuture& operator=(TaskFuture&& other)
+			{
+				if (this != &other)
+				{
+					reset();
+					m_future = std::move(other.m_future);
+					m_task = other.m_task;
+					other.m_task = nullptr;
+				}
+				return *this;
+			}
 			~TaskFuture(void)
+			{
+				reset();
+			}
+
+			bool valid(void) const
+			{
+				return m_future.valid();
+			}
+
+			bool isReady(void) const
+			{
+				return m_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+			}
+
+			void wait(void) const
+			{
+				m_future.wait();
+			}
+
+			/**
+			* Waits for the job and returns its result or rethrows its exception. The future is invalid afterwards.
+			*/
+			T get(void)
+			{
+				std::future<T> future = std::move(m_future);
+				releaseTask();
+				return future.get();
+			}
+
+			/**
+			* Lets the job finish on its own: the future becomes invalid without waiting, the result or exception of
+			* the job is dropped.
+			*/
+			void detach(void)
+			{
+				m_future = std::future<T>{};
+				releaseTask();
+			}
+
+			/**
+			* Schedules func on the pool once this job completes, without blocking any thread in the meantime.
+			* func gets the result of the job, or no argument if the job returns void. If the job threw, func isn't
+			* called and the returned future rethrows the job's exception. The future is invalid afterwards.
+			*/
+			template <typename Func>
+			auto then(Func&& func)
+			{
+				if (!valid())
+				{
+					throw std::future_error(std::future_errc::no_state);
+				}
+				ContinuableTask* antecedent = m_task;
+				m_task = nullptr;
+				return antecedent->pool()->continueWith(antecedent, std::move(m_future), std::forward<Func>(func));
+			}
+
+		private:
+			friend class ThreadPool;
+
+			TaskFuture(std::future<T>&& future, ContinuableTask* task)
+				:m_future{ std::move(future) },
+				m_task{ task }
+			{
+			}
+
+			void releaseTask(void)
+			{
+				if (m_task)
+				{
+					m_task->release();
+					m_task = nullptr;
+				}
+			}
+
+			void reset(void)
 			{
 				if (m_future.valid())
 				{
-					m_future.get();
+					// wait() rather than get(), a job's exception must not escape a destructor
+					m_future.wait();
+				}
+				releaseTask();
+			}
+
+			std::future<T> m_future;
+			ContinuableTask* m_task{ nullptr };
+		};
+
+		/**
+		* Result of whenAny(): the index of the first future to complete and all the futures, in the order given.
+		*/
+		template <typename T>
+		struct WhenAnyResult
+		{
+			std::size_t index;
+			std::vector<TaskFuture<T>> futures;
+		};
+
+		/** Power of two buckets of LaneStats::waitHistogram, bucket i counts waits in [2^(i-1), 2^i) ns. */
+		static constexpr std::size_t kWaitBuckets = 40;
+
+		/**
+		* Counters of one priority lane since the pool started, see laneStats().
+		*/
+		struct LaneStats
+		{
+			/** Jobs queued in the lane */
+			std::uint64_t submitted{ 0 };
+			/**
+			* Jobs whose wait was measured, the wait stats cover these: every high and background job and every job
+			* with a deadline, but only a sample of the normal ones.
+			*/
+			std::uint64_t sampled{ 0 };
+			/** Jobs queued right now */
+			std::size_t depth{ 0 };
+			std::size_t maxDepth{ 0 };
+			/** Jobs taken ahead of the higher lanes because they waited too long or reached their deadline */
+			std::uint64_t promoted{ 0 };
+			std::uint64_t deadlineMisses{ 0 };
+			/** Time from queueing to start */
+			std::int64_t totalWaitNs{ 0 };
+			std::int64_t maxWaitNs{ 0 };
+			std::uint64_t waitHistogram[kWaitBuckets]{};
+
+			double meanWaitNs(void) const
+			{
+				return sampled > 0 ? static_cast<double>(totalWaitNs) / sampled : 0.0;
+			}
+
+			/** Upper bound of the histogram bucket holding the p-th fraction of the waits, clamped to maxWaitNs. */
+			std::int64_t waitPercentileNs(double p) const
+			{
+				const double target = p * sampled;
+				std::uint64_t seen = 0;
+				for (std::size_t bucket = 0; bucket < kWaitBuckets; ++bucket)
+				{
+					seen += waitHistogram[bucket];
+					if (seen > 0 && seen >= target)
+					{
+						return std::min(bucket == 0 ? std::int64_t{ 0 } : std::int64_t{ 1 } << bucket, maxWaitNs);
+					}
+				}
+				return maxWaitNs;
+			}
+		};
+
+		using DeadlineMissHandler = std::function<void(TaskPriority priority, std::chrono::nanoseconds lateness)>;
+
+		/**
+		* Future of submitPooled(), lives in the job's task slot instead of a std::future's shared state.
+		* Like TaskFuture it waits for the job when it goes out of scope, unless detached. It must not outlive its
+		* pool.
+		*/
+		template <typename T>
+		class PooledTaskFuture
+		{
+		public:
+			PooledTaskFuture(void) = default;
+
+			PooledTaskFuture(const PooledTaskFuture& rhs) = delete;
+			PooledTaskFuture& operator=(const PooledTaskFuture& rhs) = delete;
+			PooledTaskFuture(PooledTaskFuture&& other)
+				:m_task{ other.m_task }
+			{
+				other.m_task = nullptr;
+			}
+			PooledTaskFuture& operator=(PooledTaskFuture&& other)
+			{
+				if (this != &other)
+				{
+					reset();
+					m_task = other.m_task;
+					other.m_task = nullptr;
 				}
+				return *this;
+			}
+			~PooledTaskFuture(void)
+			{
+				reset();
+			}
+
+			bool valid(void) const
+			{
+				return m_task != nullptr;
 			}
 
-			auto get(void)
+			bool isReady(void) const
+			{
+				return m_task->isReady();
+			}
+
+			void wait(void) const
+			{
+				m_task->wait();
+			}
+
+			/**
+			* Waits for the job and returns its result or rethrows its exception. The future is invalid afterwards.
+			*/
+			T get(void)
 			{
-				return m_future.get();
+				PooledTask* task = m_task;
+				m_task = nullptr;
+				task->wait();
+				if (task->m_exception)
+				{
+					std::exception_ptr exception = task->m_exception;
+					task->release();
+					std::rethrow_exception(exception);
+				}
+				return takeResult(*task, std::is_void<T>{});
 			}
 
+			/**
+			* Lets the job finish on its own: the future becomes invalid without waiting, the slot is recycled and
+			* the result destroyed by whichever side lets go last.
+			*/
+			void detach(void)
+			{
+				if (m_task)
+				{
+					m_task->release();
+					m_task = nullptr;
+				}
+			}
 
 		private:
-			std::future<T> m_future;
+			friend class ThreadPool;
+
+			explicit PooledTaskFuture(PooledTask* task)
+				:m_task{ task }
+			{
+			}
+
+			static T takeResult(PooledTask& task, std::false_type)
+			{
+				T* result = reinterpret_cast<T*>(task.m_result);
+				T value = std::move(*result);
+				result->~T();
+				task.m_hasResult = false;
+				task.release();
+				return value;
+			}
+			static void takeResult(PooledTask& task, std::true_type)
+			{
+				task.release();
+			}
+
+			void reset(void)
+			{
+				if (m_task)
+				{
+					m_task->wait();
+					m_task->release();
+					m_task = nullptr;
+				}
+			}
+
+			PooledTask* m_task{ nullptr };
 		};
 
 	public:
@@ -119,15 +684,33 @@ namespace terra
 		* Constructor.
 		*/
 		explicit ThreadPool(const std::uint32_t numThreads)
+			:ThreadPool{ ThreadPoolOptions{ std::max(numThreads, 1u) } }
+		{
+		}
+
+		/**
+		* Constructor with worker names and CPU placement. Workers name and place themselves when they start, an OS
+		* refusing either is ignored.
+		*/
+		explicit ThreadPool(const ThreadPoolOptions& options)
 			:m_done{ false },
-			m_workQueue{},
 			m_threads{}
 		{
+			const std::uint32_t threadCount = options.threadCount > 0
+				? options.threadCount
+				: std::max(std::thread::hardware_concurrency(), 2u) - 1u;
+			for (std::uint32_t i = 0u; i < threadCount; ++i)
+			{
+				m_workers.emplace_back(std::make_unique<Worker>());
+			}
 			try
 			{
-				for (std::uint32_t i = 0u; i < numThreads; ++i)
+				const std::vector<std::uint32_t> cpus = placementCpus(options);
+				const std::int32_t numaNodes = options.placement == WorkerPlacement::SpreadNumaNodes ? ThreadPlatform::GetNumaNodeCount() : 1;
+				for (std::uint32_t i = 0u; i < threadCount; ++i)
 				{
-					m_threads.emplace_back(&ThreadPool::worker, this);
+					m_threads.emplace_back(&ThreadPool::worker, this, i, options.name + "-" + std::to_string(i),
+						workerAffinity(options, cpus, numaNodes, i));
 				}
 			}
 			catch (...)
@@ -157,44 +740,917 @@ namespace terra
 
 		/**
 		* Submit a job to be run by the thread pool.
+		* From a worker of this pool the job goes to that worker's own deque, otherwise to the normal lane.
 		*/
 		template <typename Func, typename... Args>
 		auto submit(Func&& func, Args&&... args)
 		{
-			auto boundTask = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
-			using ResultType = std::result_of_t<decltype(boundTask)()>;
-			using PackagedTask = std::packaged_task<ResultType()>;
-			using TaskType = ThreadTask<PackagedTask>;
+			return submitWith(TaskOptions{}, std::forward<Func>(func), std::forward<Args>(args)...);
+		}
 
-			PackagedTask task{ std::move(boundTask) };
-			TaskFuture<ResultType> result{ task.get_future() };
-			m_workQueue.push(std::make_unique<TaskType>(std::move(task)));
+		/**
+		* submit() with a priority and a deadline.
+		*/
+		template <typename Func, typename... Args>
+		auto submitWith(const TaskOptions& options, Func&& func, Args&&... args)
+		{
+			auto result = makeTask(std::bind(std::forward<Func>(func), std::forward<Args>(args)...));
+			schedule(result.m_task, options);
 			return result;
 		}
 
-	private:
 		/**
-		* Constantly running function each thread uses to acquire work items from the queue.
+		* Fire-and-forget submit. Allocation free once the pool's task slots are warm, as long as the bound callable
+		* fits kTaskInlineSize. An exception escaping the job is dropped, catch inside the job if it matters.
 		*/
-		void worker(void)
+		template <typename Func, typename... Args>
+		void post(Func&& func, Args&&... args)
 		{
-			while (!m_done)
-			{
-				std::unique_ptr<IThreadTask> pTask{ nullptr };
-				if (m_workQueue.waitPop(pTask))
-				{
-					pTask->execute();
-				}
-			}
+			postWith(TaskOptions{}, std::forward<Func>(func), std::forward<Args>(args)...);
 		}
 
 		/**
-		* Invalidates the queue and joins all running threads.
+		* post() with a priority and a deadline.
 		*/
-		void destroy(void)
+		template <typename Func, typename... Args>
+		void postWith(const TaskOptions& options, Func&& func, Args&&... args)
 		{
-			m_done = true;
-			m_workQueue.invalidate();
+			auto boundTask = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
+			PooledTask* task = acquireSlot(1);
+			task->m_func = [boundTask = std::move(boundTask)](void*) mutable
+			{
+				boundTask();
+			};
+			schedule(task, options);
+		}
+
+		/**
+		* submit() without the heap: the job and its result live in a recycled task slot. The result must fit
+		* kResultSize, use submit() for bigger ones.
+		*/
+		template <typename Func, typename... Args>
+		auto submitPooled(Func&& func, Args&&... args)
+		{
+			return submitPooledWith(TaskOptions{}, std::forward<Func>(func), std::forward<Args>(args)...);
+		}
+
+		/**
+		* submitPooled() with a priority and a deadline.
+		*/
+		template <typename Func, typename... Args>
+		auto submitPooledWith(const TaskOptions& options, Func&& func, Args&&... args)
+		{
+			auto boundTask = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
+			using ResultType = std::result_of_t<decltype(boundTask)()>;
+			using StoredType = std::conditional_t<std::is_void<ResultType>::value, char, ResultType>;
+			static_assert(sizeof(StoredType) <= kResultSize && alignof(StoredType) <= alignof(std::max_align_t),
+				"result does not fit a task slot, use submit()");
+
+			PooledTask* task = acquireSlot(2);
+			task->m_func = wrapPooled<ResultType>(std::move(boundTask), std::is_void<ResultType>{});
+			if (!std::is_trivially_destructible<StoredType>::value)
+			{
+				task->m_destroyResult = &destroyStored<StoredType>;
+			}
+			PooledTaskFuture<ResultType> result{ task };
+			schedule(task, options);
+			return result;
+		}
+
+		/**
+		* Future completing once every one of futures has, with their results in the same order (nothing for void
+		* jobs). No thread waits in the meantime, the last job to complete schedules the gathering on the pool.
+		* If jobs threw, the returned future rethrows the exception of the first of them in futures.
+		* futures must not be empty, the futures in it are invalid afterwards.
+		*/
+		template <typename T>
+		static TaskFuture<std::conditional_t<std::is_void<T>::value, void, std::vector<T>>> whenAll(std::vector<TaskFuture<T>>&& futures)
+		{
+			checkFutures(futures);
+			std::vector<ContinuableTask*> antecedents;
+			std::vector<std::future<T>> inputs;
+			antecedents.reserve(futures.size());
+			inputs.reserve(futures.size());
+			for (auto& future : futures)
+			{
+				antecedents.push_back(future.m_task);
+				future.m_task = nullptr;
+				inputs.push_back(std::move(future.m_future));
+			}
+			futures.clear();
+
+			ThreadPool* pool = antecedents.front()->pool();
+			auto result = pool->makeTask([inputs = std::move(inputs)]() mutable
+			{
+				return collectAll(inputs, std::is_void<T>{});
+			});
+			ContinuableTask* gather = result.m_task;
+			auto remaining = std::make_shared<std::atomic<std::size_t>>(antecedents.size());
+			for (ContinuableTask* antecedent : antecedents)
+			{
+				antecedent->onComplete([pool, gather, remaining]()
+				{
+					if (remaining->fetch_sub(1, std::memory_order_acq_rel) == 1)
+					{
+						pool->schedule(gather);
+					}
+				});
+				antecedent->release();
+			}
+			return result;
+		}
+
+		/**
+		* Future completing as soon as one of futures has, with its index and all the futures. The others may
+		* still be running, they block on destruction like any TaskFuture unless detached.
+		* futures must not be empty.
+		*/
+		template <typename T>
+		static TaskFuture<WhenAnyResult<T>> whenAny(std::vector<TaskFuture<T>>&& futures)
+		{
+			checkFutures(futures);
+			// the futures keep their references, the tasks live at least until the result is taken
+			std::vector<ContinuableTask*> antecedents;
+			antecedents.reserve(futures.size());
+			for (const auto& future : futures)
+			{
+				antecedents.push_back(future.m_task);
+			}
+
+			ThreadPool* pool = antecedents.front()->pool();
+			auto first = std::make_shared<std::atomic<std::size_t>>(std::size_t{ kNoIndex });
+			auto result = pool->makeTask([pending = DetachedFutures<T>{ std::move(futures) }, first]() mutable
+			{
+				return WhenAnyResult<T>{ first->load(std::memory_order_acquire), std::move(pending.futures) };
+			});
+			ContinuableTask* gather = result.m_task;
+			for (std::size_t i = 0; i < antecedents.size(); ++i)
+			{
+				antecedents[i]->onComplete([pool, gather, first, i]()
+				{
+					std::size_t none = kNoIndex;
+					if (first->compare_exchange_strong(none, i, std::memory_order_acq_rel))
+					{
+						pool->schedule(gather);
+					}
+				});
+			}
+			return result;
+		}
+
+		/**
+		* Number of worker threads.
+		*/
+		std::uint32_t size(void) const
+		{
+			return static_cast<std::uint32_t>(m_threads.size());
+		}
+
+		/**
+		* Runs one queued task on the calling thread, if there is one. A thread waiting on work it handed to the pool
+		* calls this in its wait loop, so the work still gets done when every worker is busy, or when the waiter is
+		* itself the worker whose deque holds the work.
+		* Returns true if a task was run.
+		*/
+		bool tryRunPendingTask(void)
+		{
+			WorkerContext& context = workerContext();
+			IThreadTask* task = nullptr;
+			if (context.pool == this)
+			{
+				task = findTask(context);
+			}
+			else
+			{
+				task = popLane(kHighLane, nullptr);
+				for (std::size_t i = 0; i < m_workers.size() && task == nullptr; ++i)
+				{
+					m_workers[i]->tasks.steal(task);
+				}
+				if (task == nullptr)
+				{
+					task = popLane(kNormalLane, nullptr);
+				}
+				if (task == nullptr)
+				{
+					task = popLane(kBackgroundLane, nullptr);
+				}
+			}
+			if (task == nullptr)
+			{
+				return false;
+			}
+			runTask(task, context.pool == this ? m_workers[context.index].get() : nullptr);
+			return true;
+		}
+
+		/**
+		* Counters of one lane, summed over the workers. Cheap enough to poll every few seconds.
+		*/
+		LaneStats laneStats(TaskPriority priority) const
+		{
+			const std::size_t index = static_cast<std::size_t>(priority);
+			LaneStats stats;
+			{
+				std::lock_guard<std::mutex> lock{ m_laneMutex };
+				const Lane& lane = m_lanes[index];
+				stats.submitted = lane.submitted;
+				stats.depth = lane.count.load(std::memory_order_relaxed);
+				stats.maxDepth = lane.maxDepth;
+				stats.promoted = lane.promoted;
+			}
+			addCounters(stats, m_externalLanes[index]);
+			for (const auto& worker : m_workers)
+			{
+				addCounters(stats, worker->lanes[index]);
+			}
+			return stats;
+		}
+
+		/**
+		* How long a normal or background job may wait before it is taken ahead of the higher lanes. Applies to
+		* jobs queued afterwards.
+		*/
+		void setStarvationLimit(std::chrono::nanoseconds limit)
+		{
+			m_starvationLimitNs.store(limit.count(), std::memory_order_relaxed);
+		}
+
+		/**
+		* Called on the thread starting a job later than its deadline, just before the job runs. Set it before
+		* submitting jobs with deadlines, it is not synchronized with running workers.
+		*/
+		void setDeadlineMissHandler(DeadlineMissHandler handler)
+		{
+			m_deadlineMissHandler = std::move(handler);
+		}
+
+	private:
+		/** Worker identity of the calling thread, so submits from inside a task stay local. */
+		struct WorkerContext
+		{
+			ThreadPool* pool{ nullptr };
+			std::uint32_t index{ 0 };
+			/** xorshift state for picking steal victims */
+			std::uint32_t rng{ 0 };
+		};
+
+		static WorkerContext& workerContext(void)
+		{
+			static thread_local WorkerContext context;
+			return context;
+		}
+
+		/** Rounds of a failed search for work before a worker parks, each round yields once. */
+		static constexpr int kSpinRounds = 16;
+		/** Most tasks a worker moves from the normal lane to its own deque at once, for the others to steal. */
+		static constexpr std::size_t kInjectBatch = 32;
+		/** Task slots moved between a worker's freelist and the pool's at once. */
+		static constexpr std::size_t kSlotBatch = 32;
+		/** Task slots allocated at once when every freelist is empty. */
+		static constexpr std::size_t kSlotChunkSize = 64;
+
+		static constexpr std::size_t kHighLane = static_cast<std::size_t>(TaskPriority::High);
+		static constexpr std::size_t kNormalLane = static_cast<std::size_t>(TaskPriority::Normal);
+		static constexpr std::size_t kBackgroundLane = static_cast<std::size_t>(TaskPriority::Background);
+		static constexpr std::size_t kLaneCount = 3;
+		static constexpr std::int64_t kNever = std::numeric_limits<std::int64_t>::max();
+		static constexpr std::int64_t kDefaultStarvationLimitNs = 50 * 1000 * 1000;
+		/** One in this many normal lane tasks is timestamped, the clock costs more than queueing an empty task. */
+		static constexpr std::uint32_t kWaitSampleInterval = 16;
+		/** Searches a worker running only untimed tasks makes between clock reads of popUrgent(). */
+		static constexpr std::uint32_t kUrgentCheckInterval = 16;
+
+		/** Intrusive FIFO of one priority, guarded by m_laneMutex. */
+		struct Lane
+		{
+			IThreadTask* head{ nullptr };
+			IThreadTask* tail{ nullptr };
+			/** Written under m_laneMutex, lets idle workers skip the lock when it is 0 */
+			std::atomic<std::size_t> count{ 0 };
+			/** m_promoteNs of the head, kNever when empty, lets workers check for starving jobs without the lock */
+			std::atomic<std::int64_t> headPromoteNs{ kNever };
+			std::size_t maxDepth{ 0 };
+			std::uint64_t submitted{ 0 };
+			std::uint64_t promoted{ 0 };
+			/** Enqueue time of the last timestamped task */
+			std::int64_t lastStampNs{ 0 };
+			/** Normal tasks queued since the last timestamped one */
+			std::uint32_t unstamped{ 0 };
+		};
+
+		/** Start side counters of one lane, written by one worker, or by any thread for m_externalLanes. */
+		struct LaneCounters
+		{
+			std::atomic<std::uint64_t> sampled{ 0 };
+			std::atomic<std::uint64_t> deadlineMisses{ 0 };
+			std::atomic<std::int64_t> totalWaitNs{ 0 };
+			std::atomic<std::int64_t> maxWaitNs{ 0 };
+			std::atomic<std::uint64_t> waitHistogram[kWaitBuckets]{};
+		};
+
+		struct Worker
+		{
+			WorkStealingDeque<IThreadTask*> tasks;
+			/** Free task slots only this worker touches */
+			IThreadTask* freeSlots{ nullptr };
+			std::size_t freeSlotCount{ 0 };
+			LaneCounters lanes[kLaneCount];
+			/** Clock read when the last lane task started, 0 once popUrgent() used it */
+			std::int64_t lastStartNs{ 0 };
+			/** Searches since popUrgent() last read the clock itself */
+			std::uint32_t urgentSkips{ 0 };
+		};
+
+		static std::int64_t nowNs(void)
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		/** Counters only their worker writes skip the locked read-modify-write. */
+		template <typename T>
+		static void addCounter(std::atomic<T>& counter, T value, bool shared)
+		{
+			if (shared)
+			{
+				counter.fetch_add(value, std::memory_order_relaxed);
+			}
+			else
+			{
+				counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+			}
+		}
+
+		static void maxCounter(std::atomic<std::int64_t>& counter, std::int64_t value)
+		{
+			std::int64_t current = counter.load(std::memory_order_relaxed);
+			while (value > current && !counter.compare_exchange_weak(current, value, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		static void addCounters(LaneStats& stats, const LaneCounters& counters)
+		{
+			stats.sampled += counters.sampled.load(std::memory_order_relaxed);
+			stats.deadlineMisses += counters.deadlineMisses.load(std::memory_order_relaxed);
+			stats.totalWaitNs += counters.totalWaitNs.load(std::memory_order_relaxed);
+			stats.maxWaitNs = std::max(stats.maxWaitNs, counters.maxWaitNs.load(std::memory_order_relaxed));
+			for (std::size_t bucket = 0; bucket < kWaitBuckets; ++bucket)
+			{
+				stats.waitHistogram[bucket] += counters.waitHistogram[bucket].load(std::memory_order_relaxed);
+			}
+		}
+
+		/**
+		* Runs a task, first recording its wait and checking its deadline if it was timestamped in a lane.
+		* @param worker The calling worker, nullptr for threads outside the pool.
+		*/
+		void runTask(IThreadTask* task, Worker* worker)
+		{
+			if (task->m_enqueueNs != 0)
+			{
+				const std::int64_t now = nowNs();
+				const std::int64_t wait = now - task->m_enqueueNs;
+				const bool shared = worker == nullptr;
+				LaneCounters& lane = shared ? m_externalLanes[task->m_lane] : worker->lanes[task->m_lane];
+				if (worker)
+				{
+					worker->lastStartNs = now;
+				}
+				addCounter<std::uint64_t>(lane.sampled, 1, shared);
+				addCounter<std::int64_t>(lane.totalWaitNs, wait, shared);
+				maxCounter(lane.maxWaitNs, wait);
+				const std::size_t bucket = wait > 0 ? std::min<std::size_t>(FloorLog2_64(static_cast<std::uint64_t>(wait)) + 1, kWaitBuckets - 1) : 0;
+				addCounter<std::uint64_t>(lane.waitHistogram[bucket], 1, shared);
+				if (task->m_deadlineNs != 0 && now > task->m_deadlineNs)
+				{
+					addCounter<std::uint64_t>(lane.deadlineMisses, 1, shared);
+					if (m_deadlineMissHandler)
+					{
+						m_deadlineMissHandler(static_cast<TaskPriority>(task->m_lane), std::chrono::nanoseconds(now - task->m_deadlineNs));
+					}
+				}
+			}
+			task->execute();
+			task->finish();
+		}
+
+		static constexpr std::size_t kNoIndex = static_cast<std::size_t>(-1);
+
+		/**
+		* Futures held by the task of whenAny() until it runs. If the pool drops that task they are detached,
+		* waiting on jobs the pool will drop as well would never end.
+		*/
+		template <typename T>
+		struct DetachedFutures
+		{
+			explicit DetachedFutures(std::vector<TaskFuture<T>>&& futures)
+				:futures{ std::move(futures) }
+			{
+			}
+			DetachedFutures(DetachedFutures&& other) = default;
+			~DetachedFutures(void)
+			{
+				for (auto& future : futures)
+				{
+					future.detach();
+				}
+			}
+
+			std::vector<TaskFuture<T>> futures;
+		};
+
+		/** Wraps boundTask in a heap task and its future, ready for schedule(). */
+		template <typename BoundTask>
+		auto makeTask(BoundTask&& boundTask)
+		{
+			using ResultType = std::result_of_t<BoundTask()>;
+			using PackagedTask = std::packaged_task<ResultType()>;
+			using TaskType = FutureTask<PackagedTask>;
+
+			PackagedTask task{ std::move(boundTask) };
+			std::future<ResultType> future = task.get_future();
+			return TaskFuture<ResultType>{ std::move(future), new TaskType(this, std::move(task)) };
+		}
+
+		/** Backs TaskFuture::then(), takes over the future's reference to antecedent. */
+		template <typename T, typename Func>
+		auto continueWith(ContinuableTask* antecedent, std::future<T>&& future, Func&& func)
+		{
+			auto result = makeTask([func = std::forward<Func>(func), future = std::move(future)]() mutable
+			{
+				return invokeContinuation(func, future, std::is_void<T>{});
+			});
+			ContinuableTask* continuation = result.m_task;
+			antecedent->onComplete([this, continuation]()
+			{
+				schedule(continuation);
+			});
+			antecedent->release();
+			return result;
+		}
+
+		template <typename T, typename Func>
+		static auto invokeContinuation(Func& func, std::future<T>& future, std::false_type)
+		{
+			return func(future.get());
+		}
+		template <typename T, typename Func>
+		static auto invokeContinuation(Func& func, std::future<T>& future, std::true_type)
+		{
+			future.get();
+			return func();
+		}
+
+		template <typename T>
+		static void checkFutures(const std::vector<TaskFuture<T>>& futures)
+		{
+			if (futures.empty())
+			{
+				throw std::invalid_argument("no futures to wait for");
+			}
+			for (const auto& future : futures)
+			{
+				if (!future.valid())
+				{
+					throw std::future_error(std::future_errc::no_state);
+				}
+			}
+		}
+
+		template <typename T>
+		static std::vector<T> collectAll(std::vector<std::future<T>>& inputs, std::false_type)
+		{
+			std::vector<T> results;
+			results.reserve(inputs.size());
+			for (auto& input : inputs)
+			{
+				results.push_back(input.get());
+			}
+			return results;
+		}
+		template <typename T>
+		static void collectAll(std::vector<std::future<T>>& inputs, std::true_type)
+		{
+			for (auto& input : inputs)
+			{
+				input.get();
+			}
+		}
+
+		template <typename StoredType>
+		static void destroyStored(void* result)
+		{
+			static_cast<StoredType*>(result)->~StoredType();
+		}
+
+		template <typename ResultType, typename BoundTask>
+		static typename PooledTask::Function wrapPooled(BoundTask&& boundTask, std::false_type)
+		{
+			return [boundTask = std::move(boundTask)](void* result) mutable
+			{
+				::new (result) ResultType(boundTask());
+			};
+		}
+		template <typename ResultType, typename BoundTask>
+		static typename PooledTask::Function wrapPooled(BoundTask&& boundTask, std::true_type)
+		{
+			return [boundTask = std::move(boundTask)](void*) mutable
+			{
+				boundTask();
+			};
+		}
+
+		/**
+		* Takes a free slot, from the calling worker's own freelist when it is a worker of this pool, otherwise
+		* from the pool's. Only allocates when all of them are empty.
+		*/
+		PooledTask* acquireSlot(int refs)
+		{
+			IThreadTask* slot = nullptr;
+			WorkerContext& context = workerContext();
+			if (context.pool == this)
+			{
+				Worker& worker = *m_workers[context.index];
+				if (worker.freeSlots == nullptr)
+				{
+					std::lock_guard<std::mutex> lock{ m_slotMutex };
+					for (std::size_t i = 0; i < kSlotBatch; ++i)
+					{
+						pushSlot(worker.freeSlots, worker.freeSlotCount, popSharedSlot());
+					}
+				}
+				slot = popSlot(worker.freeSlots, worker.freeSlotCount);
+			}
+			else
+			{
+				std::lock_guard<std::mutex> lock{ m_slotMutex };
+				slot = popSharedSlot();
+			}
+			PooledTask* task = static_cast<PooledTask*>(slot);
+			task->reset(this, refs);
+			return task;
+		}
+
+		/** Puts a finished slot back, on the calling worker's freelist when it can, spilling a batch when it is long. */
+		void recycleSlot(PooledTask* task)
+		{
+			WorkerContext& context = workerContext();
+			if (context.pool == this)
+			{
+				Worker& worker = *m_workers[context.index];
+				pushSlot(worker.freeSlots, worker.freeSlotCount, task);
+				if (worker.freeSlotCount >= 2 * kSlotBatch)
+				{
+					std::lock_guard<std::mutex> lock{ m_slotMutex };
+					for (std::size_t i = 0; i < kSlotBatch; ++i)
+					{
+						pushSlot(m_freeSlots, m_freeSlotCount, popSlot(worker.freeSlots, worker.freeSlotCount));
+					}
+				}
+			}
+			else
+			{
+				std::lock_guard<std::mutex> lock{ m_slotMutex };
+				pushSlot(m_freeSlots, m_freeSlotCount, task);
+			}
+		}
+
+		static void pushSlot(IThreadTask*& head, std::size_t& count, IThreadTask* slot)
+		{
+			slot->m_next = head;
+			head = slot;
+			++count;
+		}
+
+		static IThreadTask* popSlot(IThreadTask*& head, std::size_t& count)
+		{
+			IThreadTask* slot = head;
+			head = slot->m_next;
+			slot->m_next = nullptr;
+			--count;
+			return slot;
+		}
+
+		/** Pops from the pool's freelist, growing it by a chunk when empty. Needs m_slotMutex. */
+		IThreadTask* popSharedSlot(void)
+		{
+			if (m_freeSlots == nullptr)
+			{
+				m_slotChunks.emplace_back(new PooledTask[kSlotChunkSize]);
+				PooledTask* chunk = m_slotChunks.back().get();
+				for (std::size_t i = 0; i < kSlotChunkSize; ++i)
+				{
+					pushSlot(m_freeSlots, m_freeSlotCount, &chunk[i]);
+				}
+			}
+			return popSlot(m_freeSlots, m_freeSlotCount);
+		}
+
+		void schedule(IThreadTask* task)
+		{
+			WorkerContext& context = workerContext();
+			if (context.pool == this)
+			{
+				m_workers[context.index]->tasks.push(task);
+			}
+			else
+			{
+				pushLane(task, kNormalLane, 0);
+			}
+			notifyWork();
+		}
+
+		void schedule(IThreadTask* task, const TaskOptions& options)
+		{
+			if (options.priority == TaskPriority::Normal && options.deadline == std::chrono::steady_clock::time_point{})
+			{
+				schedule(task);
+				return;
+			}
+			const std::int64_t deadlineNs = options.deadline == std::chrono::steady_clock::time_point{} ? 0
+				: std::chrono::duration_cast<std::chrono::nanoseconds>(options.deadline.time_since_epoch()).count();
+			pushLane(task, static_cast<std::size_t>(options.priority), deadlineNs);
+			notifyWork();
+		}
+
+		/**
+		* Queues a task in a lane. High and background tasks, tasks with a deadline and every
+		* kWaitSampleInterval-th normal task are timestamped. The other normal tasks borrow the last timestamp of
+		* their lane for the starvation limit, which makes them at most kWaitSampleInterval pushes early.
+		*/
+		void pushLane(IThreadTask* task, std::size_t index, std::int64_t deadlineNs)
+		{
+			task->m_deadlineNs = deadlineNs;
+			task->m_lane = static_cast<std::uint8_t>(index);
+
+			std::lock_guard<std::mutex> lock{ m_laneMutex };
+			Lane& lane = m_lanes[index];
+			std::int64_t enqueueNs = lane.lastStampNs;
+			if (index != kNormalLane || deadlineNs != 0 || lane.head == nullptr || ++lane.unstamped >= kWaitSampleInterval)
+			{
+				enqueueNs = nowNs();
+				lane.lastStampNs = enqueueNs;
+				lane.unstamped = 0;
+				task->m_enqueueNs = enqueueNs;
+			}
+			else
+			{
+				task->m_enqueueNs = 0;
+			}
+			task->m_promoteNs = kNever;
+			if (index != kHighLane)
+			{
+				task->m_promoteNs = enqueueNs + m_starvationLimitNs.load(std::memory_order_relaxed);
+				if (deadlineNs != 0)
+				{
+					task->m_promoteNs = std::min(task->m_promoteNs, deadlineNs);
+				}
+			}
+
+			if (lane.tail)
+			{
+				lane.tail->m_next = task;
+			}
+			else
+			{
+				lane.head = task;
+				lane.headPromoteNs.store(task->m_promoteNs, std::memory_order_relaxed);
+			}
+			lane.tail = task;
+			const std::size_t count = lane.count.load(std::memory_order_relaxed) + 1;
+			lane.count.store(count, std::memory_order_relaxed);
+			lane.maxDepth = std::max(lane.maxDepth, count);
+			++lane.submitted;
+		}
+
+		/**
+		* Wakes a parked worker, if any. The epoch bump pairs with the re-check in park(), so a worker either sees
+		* the new epoch before sleeping or is counted in m_sleeping and gets notified.
+		*/
+		void notifyWork(void)
+		{
+			m_workEpoch.fetch_add(1, std::memory_order_seq_cst);
+			if (m_sleeping.load(std::memory_order_seq_cst) > 0)
+			{
+				std::lock_guard<std::mutex> lock{ m_parkMutex };
+				m_parkCondition.notify_one();
+			}
+		}
+
+		/**
+		* Takes one task from a lane. From the normal lane a worker also moves a fair share of the rest to its own
+		* deque, for the others to steal.
+		*/
+		IThreadTask* popLane(std::size_t index, Worker* worker)
+		{
+			Lane& lane = m_lanes[index];
+			if (lane.count.load(std::memory_order_relaxed) == 0)
+			{
+				return nullptr;
+			}
+			std::lock_guard<std::mutex> lock{ m_laneMutex };
+			if (lane.head == nullptr)
+			{
+				return nullptr;
+			}
+			IThreadTask* task = popLaneLocked(lane);
+			const std::size_t count = lane.count.load(std::memory_order_relaxed);
+			const std::size_t share = worker && index == kNormalLane ? std::min(count / m_workers.size(), std::size_t{ kInjectBatch }) : 0;
+			for (std::size_t i = 0; i < share; ++i)
+			{
+				worker->tasks.push(popLaneLocked(lane));
+			}
+			return task;
+		}
+
+		/**
+		* Takes the head of the normal or the background lane if it waited past the starvation limit or reached its
+		* deadline. Reuses the time the worker's last lane task started, a task's length late at worst, and only
+		* reads the clock itself every kUrgentCheckInterval searches.
+		*/
+		IThreadTask* popUrgent(Worker& worker)
+		{
+			std::int64_t now = worker.lastStartNs;
+			worker.lastStartNs = 0;
+			for (std::size_t index = kNormalLane; index < kLaneCount; ++index)
+			{
+				Lane& lane = m_lanes[index];
+				if (lane.count.load(std::memory_order_relaxed) == 0)
+				{
+					continue;
+				}
+				if (now == 0)
+				{
+					if (++worker.urgentSkips < kUrgentCheckInterval)
+					{
+						return nullptr;
+					}
+					worker.urgentSkips = 0;
+					now = nowNs();
+				}
+				if (lane.headPromoteNs.load(std::memory_order_relaxed) > now)
+				{
+					continue;
+				}
+				std::lock_guard<std::mutex> lock{ m_laneMutex };
+				if (lane.head && lane.head->m_promoteNs <= now)
+				{
+					++lane.promoted;
+					return popLaneLocked(lane);
+				}
+			}
+			return nullptr;
+		}
+
+		/** Needs m_laneMutex and a non-empty lane. */
+		static IThreadTask* popLaneLocked(Lane& lane)
+		{
+			IThreadTask* task = lane.head;
+			lane.head = task->m_next;
+			if (lane.head == nullptr)
+			{
+				lane.tail = nullptr;
+			}
+			lane.headPromoteNs.store(lane.head ? lane.head->m_promoteNs : kNever, std::memory_order_relaxed);
+			lane.count.store(lane.count.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+			task->m_next = nullptr;
+			return task;
+		}
+
+		IThreadTask* steal(WorkerContext& context)
+		{
+			const std::uint32_t count = static_cast<std::uint32_t>(m_workers.size());
+			context.rng ^= context.rng << 13;
+			context.rng ^= context.rng >> 17;
+			context.rng ^= context.rng << 5;
+			const std::uint32_t start = context.rng % count;
+			for (std::uint32_t i = 0; i < count; ++i)
+			{
+				const std::uint32_t victim = (start + i) % count;
+				IThreadTask* task = nullptr;
+				if (victim != context.index && m_workers[victim]->tasks.steal(task))
+				{
+					return task;
+				}
+			}
+			return nullptr;
+		}
+
+		IThreadTask* findTask(WorkerContext& context)
+		{
+			Worker& worker = *m_workers[context.index];
+			IThreadTask* task = nullptr;
+			if ((task = popUrgent(worker)) != nullptr || (task = popLane(kHighLane, nullptr)) != nullptr)
+			{
+				return task;
+			}
+			if (worker.tasks.pop(task))
+			{
+				return task;
+			}
+			if ((task = popLane(kNormalLane, &worker)) != nullptr || (task = steal(context)) != nullptr)
+			{
+				return task;
+			}
+			return popLane(kBackgroundLane, nullptr);
+		}
+
+		/** Sleeps until the work epoch moves past the one seen before the last failed search. */
+		void park(std::uint64_t epoch)
+		{
+			std::unique_lock<std::mutex> lock{ m_parkMutex };
+			m_sleeping.fetch_add(1, std::memory_order_seq_cst);
+			m_parkCondition.wait(lock, [this, epoch]()
+			{
+				return m_workEpoch.load(std::memory_order_seq_cst) != epoch || m_done;
+			});
+			m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		/**
+		* Constantly running function each thread uses to acquire work items from the queues.
+		*/
+		void worker(std::uint32_t index, const std::string& name, const ThreadAffinity& affinity)
+		{
+			ThreadPlatform::SetCurrentThreadName(name.c_str());
+			ThreadPlatform::SetCurrentThreadAffinity(affinity);
+			ScopedThreadRegistration registration{ name.c_str() };
+			ThreadRecord& record = *registration.GetRecord();
+			WorkerContext& context = workerContext();
+			context.pool = this;
+			context.index = index;
+			context.rng = index * 2654435761u + 1u;
+
+			int idleRounds = 0;
+			while (!m_done)
+			{
+				const std::uint64_t epoch = m_workEpoch.load(std::memory_order_seq_cst);
+				if (IThreadTask* task = findTask(context))
+				{
+					record.MarkBusy();
+					runTask(task, m_workers[index].get());
+					record.AddTasks(1);
+					idleRounds = 0;
+				}
+				else
+				{
+					record.MarkIdle();
+					if (++idleRounds < kSpinRounds)
+					{
+						std::this_thread::yield();
+					}
+					else
+					{
+						park(epoch);
+						idleRounds = 0;
+					}
+				}
+			}
+			context.pool = nullptr;
+		}
+
+		/** CPUs PinEach hands out, every CPU when the options name none. */
+		static std::vector<std::uint32_t> placementCpus(const ThreadPoolOptions& options)
+		{
+			if (options.placement != WorkerPlacement::PinEach)
+			{
+				return {};
+			}
+			std::vector<std::uint32_t> cpus = options.affinity.Resolve();
+			if (cpus.empty())
+			{
+				for (std::uint32_t cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); ++cpu)
+				{
+					cpus.push_back(cpu);
+				}
+			}
+			return cpus;
+		}
+
+		static ThreadAffinity workerAffinity(const ThreadPoolOptions& options, const std::vector<std::uint32_t>& cpus, std::int32_t numaNodes, std::uint32_t index)
+		{
+			switch (options.placement)
+			{
+			case WorkerPlacement::PinEach:
+				return ThreadAffinity::Cpu(cpus[index % cpus.size()]);
+			case WorkerPlacement::SpreadNumaNodes:
+				return ThreadAffinity::NumaNode(static_cast<std::int32_t>(index % static_cast<std::uint32_t>(numaNodes)));
+			default:
+				return options.affinity;
+			}
+		}
+
+		/**
+		* Stops and joins all running threads, tasks that did not start are dropped.
+		*/
+		void destroy(void)
+		{
+			{
+				std::lock_guard<std::mutex> lock{ m_parkMutex };
+				m_done = true;
+				m_parkCondition.notify_all();
+			}
 			for (auto& thread : m_threads)
 			{
 				if (thread.joinable())
@@ -202,14 +1658,73 @@ namespace terra
 					thread.join();
 				}
 			}
+			for (auto& worker : m_workers)
+			{
+				IThreadTask* task = nullptr;
+				while (worker->tasks.pop(task))
+				{
+					task->finish();
+				}
+			}
+			// dropping a task completes its future, which may schedule continuations, drop those too
+			for (bool dropped = true; dropped;)
+			{
+				dropped = false;
+				for (std::size_t index = 0; index < kLaneCount; ++index)
+				{
+					IThreadTask* task = nullptr;
+					while ((task = popLane(index, nullptr)) != nullptr)
+					{
+						task->finish();
+						dropped = true;
+					}
+				}
+			}
 		}
 
 	private:
 		std::atomic_bool m_done;
-		ThreadSafeQueue<std::unique_ptr<IThreadTask>> m_workQueue;
+		std::vector<std::unique_ptr<Worker>> m_workers;
+
+		/** Tasks submitted from outside the pool, and high or background tasks from inside */
+		mutable std::mutex m_laneMutex;
+		Lane m_lanes[kLaneCount];
+		/** Counters of lane tasks run by threads outside the pool through tryRunPendingTask() */
+		LaneCounters m_externalLanes[kLaneCount];
+		std::atomic<std::int64_t> m_starvationLimitNs{ kDefaultStarvationLimitNs };
+		DeadlineMissHandler m_deadlineMissHandler;
+
+		std::mutex m_slotMutex;
+		IThreadTask* m_freeSlots{ nullptr };
+		std::size_t m_freeSlotCount{ 0 };
+		std::vector<std::unique_ptr<PooledTask[]>> m_slotChunks;
+
+		std::mutex m_parkMutex;
+		std::condition_variable m_parkCondition;
+		std::atomic<std::uint64_t> m_workEpoch{ 0 };
+		std::atomic<std::uint32_t> m_sleeping{ 0 };
+
 		std::vector<std::thread> m_threads;
 	};
 
+	/**
+	* ThreadPool::whenAll(), for futures of any pool.
+	*/
+	template <typename T>
+	inline auto when_all(std::vector<ThreadPool::TaskFuture<T>>&& futures)
+	{
+		return ThreadPool::whenAll(std::move(futures));
+	}
+
+	/**
+	* ThreadPool::whenAny(), for futures of any pool.
+	*/
+	template <typename T>
+	inline auto when_any(std::vector<ThreadPool::TaskFuture<T>>&& futures)
+	{
+		return ThreadPool::whenAny(std::move(futures));
+	}
+
 	namespace DefaultThreadPool
 	{
 		/**
@@ -230,6 +1745,15 @@ namespace terra
 		{
 			return getThreadPool().submit(std::forward<Func>(func), std::forward<Args>(args)...);
 		}
+
+		/**
+		* Post a fire-and-forget job to the default thread pool.
+		*/
+		template <typename Func, typename... Args>
+		inline void postJob(Func&& func, Args&&... args)
+		{
+			getThreadPool().post(std::forward<Func>(func), std::forward<Args>(args)...);
+		}
 	}
 	/*
 	int main() {
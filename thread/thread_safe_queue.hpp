@@ -4,18 +4,170 @@
 */
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
+#include <thread>
 #include <utility>
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#endif
+
 namespace terra
 {
+	namespace detail
+	{
+		/**
+		* Growable FIFO ring in one contiguous block, the backing store of ThreadSafeQueue. Unlike std::deque it
+		* allocates only when it grows, which stops once the queue reached its working size, and consecutive items
+		* share cache lines.
+		*/
+		template <typename T>
+		class QueueRing
+		{
+		public:
+			QueueRing(void) = default;
+			QueueRing(const QueueRing& rhs) = delete;
+			QueueRing& operator=(const QueueRing& rhs) = delete;
+
+			~QueueRing(void)
+			{
+				clear();
+				std::allocator<T>().deallocate(m_slots, m_capacity);
+			}
+
+			bool empty(void) const { return m_size == 0; }
+			std::size_t size(void) const { return m_size; }
+
+			T& front(void) { return m_slots[m_head]; }
+
+			template <typename U>
+			void push(U&& value)
+			{
+				if (m_size == m_capacity)
+				{
+					reserve(m_size + 1);
+				}
+				new (&m_slots[(m_head + m_size) & (m_capacity - 1)]) T(std::forward<U>(value));
+				++m_size;
+			}
+
+			void pop(void)
+			{
+				m_slots[m_head].~T();
+				m_head = (m_head + 1) & (m_capacity - 1);
+				--m_size;
+			}
+
+			void clear(void)
+			{
+				while (m_size > 0)
+				{
+					pop();
+				}
+				m_head = 0;
+			}
+
+			/** Grows to the next power of two holding at least count items, never shrinks. */
+			void reserve(std::size_t count)
+			{
+				if (count <= m_capacity)
+				{
+					return;
+				}
+				std::size_t capacity = m_capacity > 0 ? m_capacity : std::size_t{ kMinCapacity };
+				while (capacity < count)
+				{
+					capacity *= 2;
+				}
+				std::allocator<T> allocator;
+				T* slots = allocator.allocate(capacity);
+				std::size_t moved = 0;
+				try
+				{
+					for (; moved < m_size; ++moved)
+					{
+						new (&slots[moved]) T(std::move_if_noexcept(m_slots[(m_head + moved) & (m_capacity - 1)]));
+					}
+				}
+				catch (...)
+				{
+					for (std::size_t i = 0; i < moved; ++i)
+					{
+						slots[i].~T();
+					}
+					allocator.deallocate(slots, capacity);
+					throw;
+				}
+				const std::size_t size = m_size;
+				clear();
+				allocator.deallocate(m_slots, m_capacity);
+				m_slots = slots;
+				m_capacity = capacity;
+				m_size = size;
+			}
+
+		private:
+			static constexpr std::size_t kMinCapacity = 16;
+
+			T* m_slots{ nullptr };
+			/** Zero or a power of two */
+			std::size_t m_capacity{ 0 };
+			std::size_t m_head{ 0 };
+			std::size_t m_size{ 0 };
+		};
+	}
+
+	/**
+	* How ThreadSafeQueue::waitPop waits for an item: polls spinRounds times, then yields yieldRounds times, then
+	* parks on the condition variable. Spinning and yielding skip the futex sleep and wake-up of short waits at the
+	* cost of burning CPU while they last.
+	*/
+	struct QueueWaitPolicy
+	{
+		/** Polls with a CPU pause in between, ignored on single CPU machines where it can't help */
+		std::uint32_t spinRounds{ 64 };
+		/** Polls with std::this_thread::yield() in between */
+		std::uint32_t yieldRounds{ 16 };
+
+		/** Parks right away, the old behavior. For consumers that mostly sit idle. */
+		static constexpr QueueWaitPolicy blocking(void)
+		{
+			return QueueWaitPolicy{ 0, 0 };
+		}
+
+		/** Gives the CPU away while waiting but stays runnable for a while. */
+		static constexpr QueueWaitPolicy yielding(void)
+		{
+			return QueueWaitPolicy{ 0, 64 };
+		}
+
+		/** Spins for several microseconds, for a consumer with a core of its own. */
+		static constexpr QueueWaitPolicy spinning(void)
+		{
+			return QueueWaitPolicy{ 4096, 16 };
+		}
+	};
+
 	template <typename T>
 	class ThreadSafeQueue
 	{
 	public:
+		/**
+		* Constructor.
+		*/
+		explicit ThreadSafeQueue(QueueWaitPolicy policy = QueueWaitPolicy{})
+			:m_policy{ policy }
+		{
+		}
+
 		/**
 		* Destructor.
 		*/
@@ -35,23 +187,52 @@ namespace terra
 			{
 				return false;
 			}
-			out = std::move(m_queue.front());
-			m_queue.pop();
+			popLocked(out);
 			return true;
 		}
 
 		/**
 		* Get the first value in the queue.
-		* Will block until a value is available unless clear is called or the instance is destructed.
+		* Will block until a value is available unless clear is called or the instance is destructed, waiting the
+		* way the wait policy says.
 		* Returns true if a value was successfully written to the out parameter, false otherwise.
 		*/
 		bool waitPop(T& out)
 		{
+			const std::uint32_t spinRounds = hasSpareCpu() ? m_policy.spinRounds : 0;
+			for (std::uint32_t i = 0; i < spinRounds + m_policy.yieldRounds; ++i)
+			{
+				if (m_size.load(std::memory_order_acquire) > 0 || !m_valid)
+				{
+					std::lock_guard<std::mutex> lock{ m_mutex };
+					if (!m_valid)
+					{
+						return false;
+					}
+					if (!m_queue.empty())
+					{
+						popLocked(out);
+						return true;
+					}
+				}
+				if (i < spinRounds)
+				{
+					cpuRelax();
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+
 			std::unique_lock<std::mutex> lock{ m_mutex };
+			// push() reads m_parked under the same lock, so it either sees this waiter or its item is seen below
+			++m_parked;
 			m_condition.wait(lock, [this]()
 			{
 				return !m_queue.empty() || !m_valid;
 			});
+			--m_parked;
 			/*
 			* Using the condition in the predicate ensures that spurious wakeups with a valid
 			* but empty queue will not proceed, so only need to check for validity before proceeding.
@@ -60,19 +241,102 @@ namespace terra
 			{
 				return false;
 			}
-			out = std::move(m_queue.front());
-			m_queue.pop();
+			popLocked(out);
 			return true;
 		}
 
 		/**
 		* Push a new value onto the queue.
+		* Only notifies when a waiter is parked, and after unlocking, so the woken thread doesn't block on the lock
+		* right away.
 		*/
 		void push(T value)
+		{
+			bool wake = false;
+			{
+				std::lock_guard<std::mutex> lock{ m_mutex };
+				m_queue.push(std::move(value));
+				m_size.store(m_queue.size(), std::memory_order_release);
+				wake = m_parked > 0;
+			}
+			if (wake)
+			{
+				m_condition.notify_one();
+			}
+		}
+
+		/**
+		* Push [first, last) onto the queue in one critical section, items are copied or moved as the iterators
+		* dereference. Wakes as many parked waiters as there are items.
+		*/
+		template <typename InputIt>
+		void pushBulk(InputIt first, InputIt last)
+		{
+			std::size_t pushed = 0;
+			std::size_t parked = 0;
+			{
+				std::lock_guard<std::mutex> lock{ m_mutex };
+				reserveFor(first, last, typename std::iterator_traits<InputIt>::iterator_category());
+				for (; first != last; ++first, ++pushed)
+				{
+					m_queue.push(*first);
+				}
+				m_size.store(m_queue.size(), std::memory_order_release);
+				parked = m_parked;
+			}
+			if (parked == 0 || pushed == 0)
+			{
+				return;
+			}
+			if (pushed == 1)
+			{
+				m_condition.notify_one();
+			}
+			else
+			{
+				m_condition.notify_all();
+			}
+		}
+
+		/**
+		* Pop up to max values in one critical section, moving them to out in queue order. Doesn't wait.
+		* Returns the number of values written, 0 if the queue was empty or invalid.
+		*/
+		template <typename OutputIt>
+		std::size_t tryPopBulk(OutputIt out, std::size_t max)
 		{
 			std::lock_guard<std::mutex> lock{ m_mutex };
-			m_queue.push(std::move(value));
-			m_condition.notify_one();
+			if (!m_valid)
+			{
+				return 0;
+			}
+			const std::size_t count = std::min(max, m_queue.size());
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				*out = std::move(m_queue.front());
+				++out;
+				m_queue.pop();
+			}
+			m_size.store(m_queue.size(), std::memory_order_release);
+			return count;
+		}
+
+		/**
+		* Move every value in the queue to the back of container in one critical section. Doesn't wait.
+		* Returns the number of values moved.
+		*/
+		template <typename Container>
+		std::size_t drainInto(Container& container)
+		{
+			return tryPopBulk(std::back_inserter(container), static_cast<std::size_t>(-1));
+		}
+
+		/**
+		* Change how waitPop waits, for calls starting afterwards. Not synchronized with waiting threads.
+		*/
+		void setWaitPolicy(QueueWaitPolicy policy)
+		{
+			m_policy = policy;
 		}
 
 		/**
@@ -90,10 +354,8 @@ namespace terra
 		void clear(void)
 		{
 			std::lock_guard<std::mutex> lock{ m_mutex };
-			while (!m_queue.empty())
-			{
-				m_queue.pop();
-			}
+			m_queue.clear();
+			m_size.store(0, std::memory_order_release);
 			m_condition.notify_all();
 		}
 
@@ -120,10 +382,50 @@ namespace terra
 			return m_valid;
 		}
 
+	private:
+		template <typename ForwardIt>
+		void reserveFor(ForwardIt first, ForwardIt last, std::forward_iterator_tag)
+		{
+			m_queue.reserve(m_queue.size() + static_cast<std::size_t>(std::distance(first, last)));
+		}
+
+		template <typename InputIt>
+		void reserveFor(InputIt, InputIt, std::input_iterator_tag)
+		{
+		}
+
+		/** Needs m_mutex and a non-empty queue. */
+		void popLocked(T& out)
+		{
+			out = std::move(m_queue.front());
+			m_queue.pop();
+			m_size.store(m_queue.size(), std::memory_order_release);
+		}
+
+		static bool hasSpareCpu(void)
+		{
+			static const bool spare = std::thread::hardware_concurrency() > 1;
+			return spare;
+		}
+
+		static void cpuRelax(void)
+		{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+			_mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+			__asm__ __volatile__("yield");
+#endif
+		}
+
 	private:
 		std::atomic_bool m_valid{ true };
 		mutable std::mutex m_mutex;
-		std::queue<T> m_queue;
+		detail::QueueRing<T> m_queue;
 		std::condition_variable m_condition;
+		QueueWaitPolicy m_policy;
+		/** Size of m_queue, written under m_mutex, lets spinning waiters poll without the lock */
+		std::atomic<std::size_t> m_size{ 0 };
+		/** Waiters blocked on m_condition, guarded by m_mutex */
+		std::size_t m_parked{ 0 };
 	};
 }
@@ -0,0 +1,190 @@
+/**
+* The WorkStealingDeque class.
+* Lock-free Chase-Lev deque: the owning thread pushes and pops at the bottom, any other thread steals from the top.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace terra
+{
+	/**
+	* Unbounded single-owner deque for work stealing schedulers, after
+	* "Correct and Efficient Work-Stealing for Weak Memory Models" (Le, Pop, Cohen, Zappa Nardelli, PPoPP 2013).
+	*
+	* push() and pop() may only be called by the owning thread and work LIFO, so the owner keeps running the task
+	* whose data is still in its cache. steal() may be called from any thread and works FIFO, thieves take the oldest
+	* and usually biggest piece of work. Neither side ever blocks.
+	*
+	* The ring grows when full. Thieves may still be reading a replaced ring, so those are kept until the deque is
+	* destroyed, the memory of a deque is bounded by twice its peak size.
+	*
+	* @param T A trivially copyable item, a task pointer in practice.
+	*/
+	template <typename T>
+	class WorkStealingDeque
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "items are copied with atomic loads and stores");
+
+	private:
+		class Ring
+		{
+		public:
+			explicit Ring(int64_t capacity)
+				:m_mask{ capacity - 1 },
+				m_slots{ new std::atomic<T>[static_cast<size_t>(capacity)] }
+			{
+			}
+
+			int64_t capacity(void) const { return m_mask + 1; }
+
+			T load(int64_t index) const { return m_slots[index & m_mask].load(std::memory_order_relaxed); }
+			void store(int64_t index, T item) { m_slots[index & m_mask].store(item, std::memory_order_relaxed); }
+
+			/** Copy of the live range [top, bottom) into a ring twice as big. */
+			Ring* grow(int64_t top, int64_t bottom) const
+			{
+				Ring* ring = new Ring(capacity() * 2);
+				for (int64_t i = top; i < bottom; ++i)
+				{
+					ring->store(i, load(i));
+				}
+				return ring;
+			}
+
+		private:
+			const int64_t m_mask;
+			std::unique_ptr<std::atomic<T>[]> m_slots;
+		};
+
+	public:
+		/**
+		* Constructor.
+		* @param capacity Initial capacity, rounded up to a power of two.
+		*/
+		explicit WorkStealingDeque(int64_t capacity = 256)
+			:m_top{ 0 },
+			m_bottom{ 0 }
+		{
+			int64_t size = 2;
+			while (size < capacity)
+			{
+				size *= 2;
+			}
+			m_rings.emplace_back(new Ring(size));
+			m_ring.store(m_rings.back().get(), std::memory_order_relaxed);
+		}
+
+		WorkStealingDeque(const WorkStealingDeque& rhs) = delete;
+		WorkStealingDeque& operator=(const WorkStealingDeque& rhs) = delete;
+
+		/**
+		* Push an item at the bottom. Owner thread only.
+		*/
+		void push(T item)
+		{
+			const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+			const int64_t top = m_top.load(std::memory_order_acquire);
+			Ring* ring = m_ring.load(std::memory_order_relaxed);
+			if (bottom - top > ring->capacity() - 1)
+			{
+				ring = ring->grow(top, bottom);
+				m_rings.emplace_back(ring);
+				m_ring.store(ring, std::memory_order_release);
+			}
+			ring->store(bottom, item);
+			m_bottom.store(bottom + 1, std::memory_order_release);
+		}
+
+		/**
+		* Pop the most recently pushed item. Owner thread only.
+		* Returns true if an item was written to the out parameter, false if the deque was empty.
+		*/
+		bool pop(T& out)
+		{
+			const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+			Ring* ring = m_ring.load(std::memory_order_relaxed);
+			// the store to bottom and the load of top must not be reordered against a thief doing the opposite,
+			// seq_cst operations instead of the paper's fences, same cost on x86 and visible to TSan
+			m_bottom.store(bottom, std::memory_order_seq_cst);
+			int64_t top = m_top.load(std::memory_order_seq_cst);
+
+			if (top > bottom)
+			{
+				m_bottom.store(bottom + 1, std::memory_order_relaxed);
+				return false;
+			}
+			out = ring->load(bottom);
+			if (top == bottom)
+			{
+				// last item, race the thieves for it
+				const bool won = m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+				m_bottom.store(bottom + 1, std::memory_order_relaxed);
+				return won;
+			}
+			return true;
+		}
+
+		/**
+		* Take the oldest item. Any thread.
+		* Returns false if the deque was empty or another thread took the item first, callers just move on to the
+		* next victim then.
+		*/
+		bool steal(T& out)
+		{
+			int64_t top = m_top.load(std::memory_order_seq_cst);
+			const int64_t bottom = m_bottom.load(std::memory_order_seq_cst);
+			if (top >= bottom)
+			{
+				return false;
+			}
+			Ring* ring = m_ring.load(std::memory_order_acquire);
+			const T item = ring->load(top);
+			if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				return false;
+			}
+			out = item;
+			return true;
+		}
+
+		/**
+		* Check whether or not the deque is empty. Only a hint while other threads are pushing or stealing.
+		*/
+		bool empty(void) const
+		{
+			return size() <= 0;
+		}
+
+		/**
+		* Number of items. Only a hint while other threads are pushing or stealing.
+		*/
+		int64_t size(void) const
+		{
+			const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+			const int64_t top = m_top.load(std::memory_order_relaxed);
+			return bottom - top;
+		}
+
+	private:
+		/** Cache line size assumed by the padding */
+		static constexpr size_t kCacheLineSize = 64;
+
+		// thieves hammer top and the owner bottom, keep them on separate cache lines. Padding, not alignas: the
+		// deque lives on the heap inside its worker and C++14 new doesn't honour over-alignment
+		char m_padBeforeTop[kCacheLineSize];
+		std::atomic<int64_t> m_top;
+		char m_padBeforeBottom[kCacheLineSize];
+		std::atomic<int64_t> m_bottom;
+		char m_padBeforeRing[kCacheLineSize];
+		std::atomic<Ring*> m_ring;
+		char m_padAfterRing[kCacheLineSize];
+		/** Every ring this deque ever used, owner thread only */
+		std::vector<std::unique_ptr<Ring>> m_rings;
+	};
+}
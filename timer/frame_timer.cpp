@@ -2,41 +2,78 @@
 
 using namespace terra;
 
-FrameTimer::FrameTimer()
+FrameTimer::FrameTimer(size_t stats_window/* = 120*/)
+	: start_time_(Clock::now())
+	, frame_samples_(std::max<size_t>(stats_window, 1), 0)
 {
-#ifdef _WIN32
-	LARGE_INTEGER perf_freq;
-	QueryPerformanceFrequency(&perf_freq);
-	perf_count_duration_ = 1.0 / perf_freq.QuadPart;
+	frame_start_ns_ = GetTimeNs();
+}
+
+void FrameTimer::Tick()
+{
+	const int64_t current_time = GetTimeNs();
+	frame_interval_ns_ = current_time - frame_start_ns_;
+	frame_start_ns_ = current_time;
 
-	QueryPerformanceCounter(&start_time_);
+	frame_samples_[next_sample_] = frame_interval_ns_;
+	next_sample_ = (next_sample_ + 1) % frame_samples_.size();
+	sample_count_ = std::min(sample_count_ + 1, frame_samples_.size());
 
-	frame_start_time_ = GetTime();
-#else
-	start_time_ = high_resolution_clock::now();
-#endif
+	if (fixed_step_ns_ > 0)
+	{
+		accumulator_ns_ += frame_interval_ns_;
+		const int64_t max_backlog = fixed_step_ns_ * max_steps_per_frame_;
+		if (accumulator_ns_ > max_backlog)
+		{
+			dropped_ns_ += accumulator_ns_ - max_backlog;
+			accumulator_ns_ = max_backlog;
+		}
+	}
 }
 
-void FrameTimer::Tick()
+FrameTimeStats FrameTimer::GetFrameStats() const
+{
+	FrameTimeStats stats;
+	stats.sample_count = sample_count_;
+	if (sample_count_ == 0)
+	{
+		return stats;
+	}
+
+	// the ring is only partially filled during the first frames, the valid samples are at the front then
+	std::vector<int64_t> samples(frame_samples_.begin(), frame_samples_.begin() + sample_count_);
+	auto minmax = std::minmax_element(samples.begin(), samples.end());
+	stats.min_ns = *minmax.first;
+	stats.max_ns = *minmax.second;
+
+	auto percentile = [&samples](double p) {
+		auto nth = samples.begin() + static_cast<size_t>(p * (samples.size() - 1));
+		std::nth_element(samples.begin(), nth, samples.end());
+		return *nth;
+	};
+	stats.p50_ns = percentile(0.50);
+	stats.p99_ns = percentile(0.99);
+	return stats;
+}
+
+void FrameTimer::SetFixedTimestep(std::chrono::nanoseconds step, int max_steps_per_frame/* = 8*/)
 {
-	double current_time = GetTime();
-	frame_interval_ = (float)(current_time - frame_start_time_);
-	frame_start_time_ = current_time;
+	fixed_step_ns_ = std::max<int64_t>(step.count(), 0);
+	max_steps_per_frame_ = std::max(max_steps_per_frame, 1);
+	accumulator_ns_ = 0;
 }
 
-double FrameTimer::GetTime() const
+bool FrameTimer::ConsumeFixedStep()
 {
-#ifdef _WIN32
-	LARGE_INTEGER cur_time, time_since_start;
-	QueryPerformanceCounter(&cur_time);
-
-	time_since_start.QuadPart = cur_time.QuadPart - start_time_.QuadPart;
-
-	return time_since_start.QuadPart * perf_count_duration_;
-#else
-	auto now = high_resolution_clock::now();
-	auto ms = duration_cast<milliseconds>(now - start_time_).count();
-	//a little uncool to then convert into a double just to go back, but oh well.
-	return static_cast<double>(ms) / 1000;
-#endif
-}
\ No newline at end of file
+	if (fixed_step_ns_ <= 0 || accumulator_ns_ < fixed_step_ns_)
+	{
+		return false;
+	}
+	accumulator_ns_ -= fixed_step_ns_;
+	return true;
+}
+
+int64_t FrameTimer::GetTimeNs() const
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time_).count();
+}
@@ -4,29 +4,96 @@
 
 namespace terra
 {
-    class FrameTimer
-    {
-    private:
-#ifdef _WIN32
-        LARGE_INTEGER start_time_{0};
-#else
-        high_resolution_clock::time_point start_time_;
-#endif
-        float frame_interval_;
-        double frame_start_time_;
-        double perf_count_duration_;
-
-    public:
-        FrameTimer();
-
-        void Tick();
-		float GetFrameTimeS() const { return frame_interval_; }
-		int GetFrameTimeMs() const { return static_cast<int>(frame_interval_ * 1000); }
-        float GetFrameTotalS() const { return static_cast<float>(GetTime()); }
-		int64_t GetFrameTotalMs() const { return static_cast<int64_t>(GetTime() * 1000); }
-		float GetFrameStartTimeS() const { return static_cast<float>(frame_start_time_); }
-		int64_t GetFrameStartTimeMs() const { return static_cast<int64_t>(frame_start_time_) * 1000; }
+	/** Frame time statistics over the last GetStatsWindow() frames, in nanoseconds. */
+	struct FrameTimeStats
+	{
+		int64_t min_ns{ 0 };
+		int64_t max_ns{ 0 };
+		int64_t p50_ns{ 0 };
+		int64_t p99_ns{ 0 };
+		size_t sample_count{ 0 };
+	};
+
+	/**
+	* Frame clock of a server loop, nanosecond resolution on top of std::chrono::steady_clock.
+	*
+	* Call Tick() once at the start of every frame. Besides the frame interval it keeps a rolling window of
+	* frame times for GetFrameStats(), and an optional fixed timestep accumulator for deterministic sub-steps:
+	*
+	*	frame_timer.SetFixedTimestep(std::chrono::milliseconds(50));
+	*	while (running)
+	*	{
+	*		frame_timer.Tick();
+	*		while (frame_timer.ConsumeFixedStep())
+	*		{
+	*			world.Simulate(frame_timer.GetFixedTimestepS());
+	*		}
+	*	}
+	*
+	* The accumulator counts whole nanoseconds, so sub-steps never drift against the wall clock.
+	*/
+	class FrameTimer
+	{
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		Clock::time_point start_time_;
+		/** Start of the current frame, relative to start_time_ */
+		int64_t frame_start_ns_{ 0 };
+		/** Length of the last frame */
+		int64_t frame_interval_ns_{ 0 };
+
+		/** Ring of the last frame intervals */
+		std::vector<int64_t> frame_samples_;
+		size_t next_sample_{ 0 };
+		size_t sample_count_{ 0 };
+
+		int64_t fixed_step_ns_{ 0 };
+		int max_steps_per_frame_{ 0 };
+		int64_t accumulator_ns_{ 0 };
+		/** Simulation time dropped because a frame needed more than max_steps_per_frame_ steps */
+		int64_t dropped_ns_{ 0 };
+
+	public:
+		/** @param stats_window Number of frames GetFrameStats() looks at. */
+		explicit FrameTimer(size_t stats_window = 120);
+
+		void Tick();
+
+		float GetFrameTimeS() const { return static_cast<float>(frame_interval_ns_ / 1e9); }
+		int GetFrameTimeMs() const { return static_cast<int>(frame_interval_ns_ / 1000000); }
+		int64_t GetFrameTimeNs() const { return frame_interval_ns_; }
+
+		float GetFrameTotalS() const { return static_cast<float>(GetTimeNs() / 1e9); }
+		int64_t GetFrameTotalMs() const { return GetTimeNs() / 1000000; }
+		int64_t GetFrameTotalNs() const { return GetTimeNs(); }
+
+		float GetFrameStartTimeS() const { return static_cast<float>(frame_start_ns_ / 1e9); }
+		int64_t GetFrameStartTimeMs() const { return frame_start_ns_ / 1000000; }
+		int64_t GetFrameStartTimeNs() const { return frame_start_ns_; }
+
+		/** O(window), meant for periodic reporting rather than every frame. */
+		FrameTimeStats GetFrameStats() const;
+		size_t GetStatsWindow() const { return frame_samples_.size(); }
+
+		/**
+		* Enables the fixed timestep accumulator, a zero step disables it.
+		* @param max_steps_per_frame Caps the catch-up after a long frame, the rest of the backlog is dropped.
+		*/
+		void SetFixedTimestep(std::chrono::nanoseconds step, int max_steps_per_frame = 8);
+
+		/** Takes one fixed step off the accumulator, call in a loop after Tick() until it returns false. */
+		bool ConsumeFixedStep();
+
+		double GetFixedTimestepS() const { return fixed_step_ns_ / 1e9; }
+		int64_t GetFixedTimestepNs() const { return fixed_step_ns_; }
+
+		/** How far into the next fixed step the frame is, in [0, 1), for interpolating rendered or sent state. */
+		double GetFixedStepAlpha() const { return fixed_step_ns_ > 0 ? static_cast<double>(accumulator_ns_) / fixed_step_ns_ : 0.0; }
+
+		int64_t GetDroppedTimeNs() const { return dropped_ns_; }
+
 	private:
-		double GetTime() const;
-    };
-}
\ No newline at end of file
+		int64_t GetTimeNs() const;
+	};
+}
@@ -1,68 +1,86 @@
 #include "schedule_timer.h"
-#include "util/vector_util.h"
 using namespace terra;
 
 void ScheduleTimer::ListTimers() const
 {
-	LOGF(INFO, "------- %lu Active Timers -------", active_timer_heap_.size());
-	for (const auto& e : active_timer_heap_)
+	auto log_timer = [this](uint32_t slot) {
+		LOGF(INFO, "%s", timer_slots_[slot].timer.timer_cb.target_type().name());
+	};
+
+	LOGF(INFO, "------- %lu Active Timers -------", ActiveSize());
+	if (active_timer_wheel_)
 	{
-		LOGF(INFO, "%s", e.timer_cb.target_type().name());
+		active_timer_wheel_->ForEach(log_timer);
 	}
+	active_timer_heap_.ForEach([&log_timer](uint32_t slot, int64_t) { log_timer(slot); });
 
 	LOGF(INFO, "------- %lu Paused Timers -------", paused_timer_list_.size());
-	for (const auto& e : paused_timer_list_)
+	for (auto slot : paused_timer_list_)
 	{
-		LOGF(INFO, "%s", e.timer_cb.target_type().name());
+		log_timer(slot);
 	}
 	
 	LOGF(INFO, "------- %lu Pending Timers -------", pending_timer_list_.size());
-	for (const auto& e : pending_timer_list_)
+	for (auto slot : pending_timer_list_)
 	{
-		LOGF(INFO, "%s", e.timer_cb.target_type().name());
+		log_timer(slot);
 	}
 
-	LOGF(INFO, "------- %lu Total Timers -------", active_timer_heap_.size() + paused_timer_list_.size() + pending_timer_list_.size());
-}
-
-int64_t ScheduleTimer::last_assigned_handle_ = 0;
+	LOGF(INFO, "------- %lu Total Timers -------", ActiveSize() + paused_timer_list_.size() + pending_timer_list_.size());
 
-//	static function
-void ScheduleTimer::ValidateHandle(TimerHandle & in_out_handle)
-{
-	if (!in_out_handle.IsValid())
+#ifdef ENABLE_TIMER_STATS
+	TimerStatsSnapshot snapshot;
+	GetTimerStats(snapshot);
+	LOGF(INFO, "------- %lu Timer Sites -------", snapshot.sites.size());
+	for (const auto& site : snapshot.sites)
 	{
-		++last_assigned_handle_;
-		in_out_handle.timer_handle = last_assigned_handle_;
+		LOGF(INFO, "%s fired %llu exec p50 %lldns p99 %lldns max %lldns late p99 %lldms catch-up max %lld", site.name,
+			static_cast<unsigned long long>(site.fire_count),
+			static_cast<long long>(site.exec_time_ns.GetPercentile(0.5)), static_cast<long long>(site.exec_time_ns.GetPercentile(0.99)),
+			static_cast<long long>(site.exec_time_ns.max), static_cast<long long>(site.lateness_ms.GetPercentile(0.99)),
+			static_cast<long long>(site.catch_up_count.max));
 	}
+#endif
 }
 
-ScheduleTimer::ScheduleTimer()
+void ScheduleTimer::GetTimerStats(TimerStatsSnapshot& out_snapshot) const
 {
+#ifdef ENABLE_TIMER_STATS
+	stats_.GetSnapshot(out_snapshot);
+#else
+	out_snapshot.sites.clear();
+#endif
 }
 
-ScheduleTimer::~ScheduleTimer()
+void ScheduleTimer::ResetTimerStats()
 {
+#ifdef ENABLE_TIMER_STATS
+	stats_.Reset();
+#endif
 }
 
-void ScheduleTimer::SetTimer(TimerHandle & in_out_handle, const TimerCallback & timer_cb, int rate_ms, bool loop, int first_delay_ms/* = -1*/)
+namespace
 {
-	if (in_out_handle.IsValid())
-	{
-		ClearTimer(in_out_handle);
-	}
+	// Spread the serial numbers of different managers apart so a handle from one manager is not a valid
+	// handle of another. Only touched on construction, each manager counts on its own afterwards.
+	constexpr uint32_t kSerialNumberStrideBits = 24;
+	std::atomic<uint64_t> GNextTimerSerialBase{ 0 };
+}
 
-	if (rate_ms > 0)
+ScheduleTimer::ScheduleTimer(ETimerQueueType queue_type/* = ETimerQueueType::BINARY_HEAP*/)
+	: queue_type_(queue_type)
+{
+	last_assigned_serial_number_ = (GNextTimerSerialBase.fetch_add(1, std::memory_order_relaxed) << kSerialNumberStrideBits) & TimerHandle::kMaxSerialNumber;
+	if (queue_type_ == ETimerQueueType::TIMING_WHEEL)
 	{
-		ValidateHandle(in_out_handle);
-
-		TimerData new_timer;
-		new_timer.timer_handle = in_out_handle;
-		new_timer.timer_cb = timer_cb;
-		InternalSetTimer(new_timer, rate_ms, loop, first_delay_ms);
+		active_timer_wheel_ = std::make_unique<TimingWheel>();
 	}
 }
 
+ScheduleTimer::~ScheduleTimer()
+{
+}
+
 void ScheduleTimer::SetTimer(TimerHandle & in_out_handle, TimerCallback&& timer_cb, int rate_ms, bool loop, int first_delay_ms/* = -1*/)
 {
 	if (in_out_handle.IsValid())
@@ -72,155 +90,285 @@ void ScheduleTimer::SetTimer(TimerHandle & in_out_handle, TimerCallback&& timer_
 
 	if (rate_ms > 0)
 	{
-		ValidateHandle(in_out_handle);
-
-		TimerData new_timer;
-		new_timer.timer_handle = in_out_handle;
-		new_timer.timer_cb = std::move(timer_cb);
-		InternalSetTimer(new_timer, rate_ms, loop, first_delay_ms);
+		uint32_t slot = AllocTimerSlot(&in_out_handle);
+		timer_slots_[slot].timer.timer_cb = std::move(timer_cb);
+		InternalSetTimer(slot, rate_ms, loop, first_delay_ms);
 	}
 }
 
-void ScheduleTimer::SetTimerForNextTick(const TimerCallback & timer_cb)
+void ScheduleTimer::SetTimerForNextTick(TimerCallback&& timer_cb)
 {
-	TimerData new_timer;
+	uint32_t slot = AllocTimerSlot(nullptr);
+	TimerData& new_timer = timer_slots_[slot].timer;
 	new_timer.rate_ms = 0;
 	new_timer.loop = false;
 	new_timer.is_require_cb = true;
-	new_timer.timer_cb = timer_cb;
+	new_timer.timer_cb = std::move(timer_cb);
+	TIMER_STATS_BIND_SITE(stats_, new_timer);
 	new_timer.expire_time = internal_time_;
 	new_timer.status = ETimerStatus::ACTIVE;
 
-	VectorUtils<decltype(active_timer_heap_)>::HeapPush(active_timer_heap_, new_timer);
+	ActivePush(slot);
 }
 
-void ScheduleTimer::InternalSetTimer(TimerData & new_timer, int rate_ms, bool loop, int first_delay_ms)
+void ScheduleTimer::SetTimers(TArrayView<TimerParams> timers)
 {
-	if (new_timer.timer_handle.IsValid() || new_timer.timer_cb)
+	// clear the handles still set in one go, tag each handle with its last entry and count the timers to add
+	size_t count = 0;
+	for (size_t i = 0; i < timers.size(); ++i)
 	{
-		new_timer.rate_ms = rate_ms;
-		new_timer.loop = loop;
-		new_timer.is_require_cb = new_timer.timer_cb ? true : false;
-
-		first_delay_ms = first_delay_ms > 0 ? first_delay_ms : rate_ms;
-		if (HasBeenTickedThisFrame())
+		TimerParams& params = timers[i];
+		Expects(params.handle);
+		TimerHandle& handle = *params.handle;
+		if (handle.IsBatchEntry())
 		{
-			new_timer.expire_time = internal_time_ + first_delay_ms;
-			new_timer.status = ETimerStatus::ACTIVE;
-			VectorUtils<decltype(active_timer_heap_)>::HeapPush(active_timer_heap_, new_timer);
+			// listed before, the earlier entry is dropped
+			if (timers[handle.GetBatchEntry()].rate_ms > 0)
+			{
+				--count;
+			}
+		}
+		else if (handle.IsValid())
+		{
+			ClearTimerForBatch(handle);
+		}
+		handle.SetBatchEntry(i);
+		if (params.rate_ms > 0)
+		{
+			++count;
+		}
+	}
+	ActiveRemoveBatch(batch_slots_);
+	batch_slots_.clear();
+
+	// take the slots in bulk: the newest free slots first, then grow the storage once
+	const size_t free_count = free_timer_slots_.size();
+	const size_t reused = std::min(count, free_count);
+	const size_t first_new_slot = timer_slots_.size();
+	timer_slots_.resize(first_new_slot + count - reused);
+
+	// keys go on the heap while the slot is hot, a large batch is appended and the heap rebuilt at the end
+	const bool ticked_this_frame = HasBeenTickedThisFrame();
+	const bool rebuild = !active_timer_wheel_ && ticked_this_frame && active_timer_heap_.IsWorthRebuild(count);
+	const size_t first_appended = active_timer_heap_.Size();
+	if (rebuild)
+	{
+		active_timer_heap_.Reserve(first_appended + count);
+	}
+	size_t taken = 0;
+	for (size_t i = 0; i < timers.size(); ++i)
+	{
+		TimerParams& params = timers[i];
+		if (params.handle->GetBatchEntry() != i)
+		{
+			continue;
+		}
+		params.handle->Invalidate();
+		if (params.rate_ms <= 0)
+		{
+			continue;
+		}
+		const uint32_t slot = taken < reused
+			? free_timer_slots_[free_count - 1 - taken]
+			: static_cast<uint32_t>(first_new_slot + taken - reused);
+		++taken;
+
+		AssignTimerHandle(slot, *params.handle);
+		TimerData& new_timer = timer_slots_[slot].timer;
+		new_timer.timer_cb = std::move(params.timer_cb);
+		if (!InitTimer(slot, params.rate_ms, params.loop, params.first_delay_ms, ticked_this_frame))
+		{
+			continue;
+		}
+		if (active_timer_wheel_)
+		{
+			active_timer_wheel_->Push(slot, new_timer.expire_time);
+		}
+		else if (rebuild)
+		{
+			active_timer_heap_.AppendUnordered(slot, new_timer.expire_time);
 		}
 		else
 		{
-			new_timer.expire_time = first_delay_ms;
-			new_timer.status = ETimerStatus::PENDING;
-			pending_timer_list_.push_back(new_timer);
+			active_timer_heap_.Push(slot, new_timer.expire_time);
 		}
 	}
+	free_timer_slots_.resize(free_count - reused);
+	if (rebuild)
+	{
+		active_timer_heap_.Rebuild(first_appended);
+	}
 }
 
-const TimerData* ScheduleTimer::FindTimer(const TimerHandle& timer_handle, int* out_timer_index) const
+void ScheduleTimer::ClearTimers(TArrayView<TimerHandle> handles)
 {
-	if (!timer_handle.IsValid())
+	for (auto& handle : handles)
 	{
-		return nullptr;
+		ClearTimerForBatch(handle);
 	}
-	if (currently_executing_timer_.timer_handle == timer_handle)
+	ActiveRemoveBatch(batch_slots_);
+	batch_slots_.clear();
+}
+
+void ScheduleTimer::ClearTimerForBatch(TimerHandle& in_handle)
+{
+	int32_t slot = FindTimerSlot(in_handle);
+	in_handle.Invalidate();
+	if (slot == INDEX_NONE)
 	{
-		if (out_timer_index)
-		{
-			*out_timer_index = -1;
-		}
-		return &currently_executing_timer_;
+		return;
 	}
-	int active_timer_idx = FindTimerInList(active_timer_heap_, timer_handle);
-	if (active_timer_idx != INDEX_NONE)
+	if (timer_slots_[slot].timer.status == ETimerStatus::ACTIVE)
 	{
-		if (out_timer_index)
-		{
-			*out_timer_index = active_timer_idx;
-		}
-		return &active_timer_heap_[active_timer_idx];
+		// The active queue only knows slot ids, so the slot can be freed now and taken off the queue after the loop.
+		// Freeing invalidates the stored handle, a handle listed twice is not found the second time.
+		batch_slots_.push_back(static_cast<uint32_t>(slot));
+		FreeTimerSlot(static_cast<uint32_t>(slot));
+	}
+	else
+	{
+		InternalClearTimer(static_cast<uint32_t>(slot));
 	}
+}
 
-	int paused_timer_idx = FindTimerInList(paused_timer_list_, timer_handle);
-	if (paused_timer_idx != INDEX_NONE)
+void ScheduleTimer::InternalSetTimer(uint32_t slot, int rate_ms, bool loop, int first_delay_ms)
+{
+	if (InitTimer(slot, rate_ms, loop, first_delay_ms, HasBeenTickedThisFrame()))
 	{
-		if (out_timer_index)
-		{
-			*out_timer_index = paused_timer_idx;
-		}
-		return &paused_timer_list_[paused_timer_idx];
+		ActivePush(slot);
 	}
+}
 
-	int pending_timer_idx = FindTimerInList(pending_timer_list_, timer_handle);
-	if (pending_timer_idx != INDEX_NONE)
+/** Fills in a newly allocated timer. Returns true when it has to go on the active queue, otherwise it is already pending. */
+bool ScheduleTimer::InitTimer(uint32_t slot, int rate_ms, bool loop, int first_delay_ms, bool ticked_this_frame)
+{
+	TimerData& new_timer = timer_slots_[slot].timer;
+	new_timer.rate_ms = rate_ms;
+	new_timer.loop = loop;
+	new_timer.is_require_cb = new_timer.timer_cb ? true : false;
+	TIMER_STATS_BIND_SITE(stats_, new_timer);
+
+	first_delay_ms = first_delay_ms > 0 ? first_delay_ms : rate_ms;
+	if (ticked_this_frame)
 	{
-		if (out_timer_index)
-		{
-			*out_timer_index = pending_timer_idx;
-		}
-		return &pending_timer_list_[pending_timer_idx];
+		new_timer.expire_time = internal_time_ + first_delay_ms;
+		new_timer.status = ETimerStatus::ACTIVE;
+		return true;
 	}
 
-	return nullptr;
+	new_timer.expire_time = first_delay_ms;
+	new_timer.status = ETimerStatus::PENDING;
+	ListPush(pending_timer_list_, slot);
+	return false;
 }
 
-int ScheduleTimer::FindTimerInList(const std::vector<TimerData>& search_list, const TimerHandle& timer_handle) const
+int32_t ScheduleTimer::FindTimerSlot(const TimerHandle& timer_handle) const
 {
-	if (timer_handle.IsValid())
+	if (!timer_handle.IsValid())
 	{
-		for (size_t i = 0; i < search_list.size(); i++)
-		{
-			if (search_list[i].timer_handle == timer_handle)
-			{
-				return static_cast<int>(i);
-			}
-		}
+		return INDEX_NONE;
+	}
+	// A stale handle points at a free slot or at a slot reused with another serial number
+	const uint32_t slot = timer_handle.GetIndex();
+	if (slot >= timer_slots_.size() || timer_slots_[slot].timer.timer_handle != timer_handle)
+	{
+		return INDEX_NONE;
 	}
-	return INDEX_NONE;
+	return static_cast<int32_t>(slot);
 }
 
-void ScheduleTimer::InternalClearTimer(TimerHandle& in_handle)
+const TimerData* ScheduleTimer::FindTimer(const TimerHandle& timer_handle) const
 {
-	//SCOPE_CYCLE_COUNTER(STAT_ClearTimer);
-	if (!in_handle.IsValid())
+	int32_t slot = FindTimerSlot(timer_handle);
+	return slot != INDEX_NONE ? &timer_slots_[slot].timer : nullptr;
+}
+
+uint32_t ScheduleTimer::AllocTimerSlot(TimerHandle* out_handle)
+{
+	uint32_t slot;
+	if (!free_timer_slots_.empty())
 	{
-		return;
+		slot = free_timer_slots_.back();
+		free_timer_slots_.pop_back();
 	}
-	int timer_idx;
-	const TimerData* const timer_data = FindTimer(in_handle, &timer_idx);
-	if (timer_data)
+	else
 	{
-		InternalClearTimer(timer_idx, timer_data->status);
+		slot = static_cast<uint32_t>(timer_slots_.size());
+		timer_slots_.emplace_back();
 	}
 
+	// Timers without a handle (SetTimerForNextTick) can not be looked up
+	if (out_handle)
+	{
+		AssignTimerHandle(slot, *out_handle);
+	}
+	return slot;
 }
 
-void ScheduleTimer::InternalClearTimer(int timer_idx, ETimerStatus timer_status)
+void ScheduleTimer::AssignTimerHandle(uint32_t slot, TimerHandle& out_handle)
 {
-	switch (timer_status)
+	if (++last_assigned_serial_number_ > TimerHandle::kMaxSerialNumber)
+	{
+		last_assigned_serial_number_ = 1;
+	}
+	out_handle.SetIndexAndSerialNumber(slot, last_assigned_serial_number_);
+	timer_slots_[slot].timer.timer_handle = out_handle;
+}
+
+void ScheduleTimer::FreeTimerSlot(uint32_t slot)
+{
+	TimerSlot& timer_slot = timer_slots_[slot];
+	timer_slot.timer.timer_handle.Invalidate();
+
+	if (static_cast<int32_t>(slot) == currently_executing_slot_)
+	{
+		// Edge case. We're currently handling this timer when it got cleared.  Keep the slot until Tick is done with it
+		// and prevent it firing again in case it was scheduled to fire multiple times.
+		timer_slot.timer.status = ETimerStatus::PENDING_REMOVAL;
+		return;
+	}
+
+	timer_slot = TimerSlot();
+	free_timer_slots_.push_back(slot);
+}
+
+void ScheduleTimer::InternalClearTimer(TimerHandle& in_handle)
+{
+	//SCOPE_CYCLE_COUNTER(STAT_ClearTimer);
+	int32_t slot = FindTimerSlot(in_handle);
+	if (slot != INDEX_NONE)
+	{
+		InternalClearTimer(static_cast<uint32_t>(slot));
+	}
+}
+
+void ScheduleTimer::InternalClearTimer(uint32_t slot)
+{
+	switch (timer_slots_[slot].timer.status)
 	{
 	case ETimerStatus::PENDING:
-		VectorUtils<decltype(pending_timer_list_)>::RemoveAtSwap(pending_timer_list_, timer_idx);
+		ListRemove(pending_timer_list_, slot);
 		break;
 
 	case ETimerStatus::ACTIVE:
-		VectorUtils<decltype(active_timer_heap_)>::HeapRemoveAt(active_timer_heap_, timer_idx);
+		ActiveRemove(slot);
 		break;
 
 	case ETimerStatus::PAUSED:
-		VectorUtils<decltype(pending_timer_list_)>::RemoveAtSwap(pending_timer_list_, timer_idx);
+		ListRemove(paused_timer_list_, slot);
 		break;
 
 	case ETimerStatus::EXECUTING:
-		// Edge case. We're currently handling this timer when it got cleared.  Clear it to prevent it firing again
-		// in case it was scheduled to fire multiple times.
-		currently_executing_timer_.Clear();
+		// FreeTimerSlot defers the release until the delegate returns
 		break;
 
+	case ETimerStatus::PENDING_REMOVAL:
+		return;
+
 	default:
 		Expects(false);
 	}
+	FreeTimerSlot(slot);
 }
 
 int64_t ScheduleTimer::InternalGetTimerRemaining(const TimerData* const timer_data) const
@@ -267,65 +415,60 @@ int ScheduleTimer::InternalGetTimerRate(const TimerData* const timer_data) const
 	return -1;
 }
 
-void ScheduleTimer::InternalPauseTimer(TimerData const* timer_to_pause, int timer_idx)
+void ScheduleTimer::InternalPauseTimer(uint32_t slot)
 {
-	if (timer_to_pause && (timer_to_pause->status != ETimerStatus::PAUSED))
+	TimerData& timer_to_pause = timer_slots_[slot].timer;
+
+	// Remove from previous container
+	switch (timer_to_pause.status)
 	{
-		ETimerStatus previous_status = timer_to_pause->status;
+	case ETimerStatus::ACTIVE:
+		ActiveRemove(slot);
+		timer_to_pause.expire_time = timer_to_pause.expire_time - internal_time_;
+		break;
 
-		if (previous_status != ETimerStatus::EXECUTING || timer_to_pause->loop)
-		{
-			 paused_timer_list_.push_back(*timer_to_pause);
-			 TimerData& new_timer = paused_timer_list_.back();
-			 new_timer.status = ETimerStatus::PAUSED;
-
-			 if (previous_status != ETimerStatus::PENDING)
-			 {
-				 new_timer.expire_time = new_timer.expire_time - internal_time_;
-			 }
-		}
+	case ETimerStatus::PENDING:
+		ListRemove(pending_timer_list_, slot);
+		break;
 
-		// Remove from previous TArray
-		switch (previous_status)
+	case ETimerStatus::EXECUTING:
+		if (!timer_to_pause.loop)
 		{
-		case ETimerStatus::ACTIVE:
-			VectorUtils<decltype(active_timer_heap_)>::HeapRemoveAt(active_timer_heap_, timer_idx);
-			break;
-
-		case ETimerStatus::PENDING:
-			VectorUtils<decltype(pending_timer_list_)>::RemoveAtSwap(pending_timer_list_, timer_idx);
-			break;
-
-		case ETimerStatus::EXECUTING:
-			currently_executing_timer_.Clear();
-			break;
-
-		default:
-			Expects(false);
+			// A one shot timer which is already firing has nothing left to pause
+			FreeTimerSlot(slot);
+			return;
 		}
+		timer_to_pause.expire_time = timer_to_pause.expire_time - internal_time_;
+		break;
+
+	default:
+		// PAUSED or PENDING_REMOVAL
+		return;
 	}
+
+	timer_to_pause.status = ETimerStatus::PAUSED;
+	ListPush(paused_timer_list_, slot);
 }
 
-void ScheduleTimer::InternalContinueTimer(int paused_timer_idx)
+void ScheduleTimer::InternalContinueTimer(uint32_t slot)
 {
-	if (paused_timer_idx != INDEX_NONE)
+	TimerData& timer_to_continue = timer_slots_[slot].timer;
+	if (timer_to_continue.status != ETimerStatus::PAUSED)
 	{
-		TimerData& timer_to_continue = pending_timer_list_[paused_timer_idx];
-		Expects(timer_to_continue.status == ETimerStatus::PAUSED);
-
-		if (HasBeenTickedThisFrame())
-		{
-			timer_to_continue.expire_time += internal_time_;
-			timer_to_continue.status = ETimerStatus::ACTIVE;
-			VectorUtils<decltype(active_timer_heap_)>::HeapPush(active_timer_heap_, timer_to_continue);
-		}
-		else
-		{
-			timer_to_continue.status = ETimerStatus::PENDING;
-			pending_timer_list_.push_back(timer_to_continue);
-		}
+		return;
+	}
 
-		VectorUtils<decltype(pending_timer_list_)>::RemoveAtSwap(pending_timer_list_, paused_timer_idx);
+	ListRemove(paused_timer_list_, slot);
+	if (HasBeenTickedThisFrame())
+	{
+		timer_to_continue.expire_time += internal_time_;
+		timer_to_continue.status = ETimerStatus::ACTIVE;
+		ActivePush(slot);
+	}
+	else
+	{
+		timer_to_continue.status = ETimerStatus::PENDING;
+		ListPush(pending_timer_list_, slot);
 	}
 }
 
@@ -339,55 +482,72 @@ void ScheduleTimer::Tick(int tick_ms)
 
 	internal_time_ += tick_ms;
 
-	while (active_timer_heap_.size() > 0)
+	// Pop expired timers off the active queue one at a time and mark it EXECUTING
+	uint32_t slot;
+	while (ActivePopExpired(slot))
 	{
-		TimerData& top = VectorUtils<decltype(active_timer_heap_)>::HeadTop(active_timer_heap_);
-		if (internal_time_ > top.expire_time)
+		// Timer has expired! Fire the delegate, then handle potential looping.
+		currently_executing_slot_ = static_cast<int32_t>(slot);
+		TimerData* timer = &timer_slots_[slot].timer;
+		timer->status = ETimerStatus::EXECUTING;
+
+		// Determine how many times the timer may have elapsed (e.g. for large DeltaTime on a short looping timer)
+		int64_t const call_count = timer->loop ?
+			(internal_time_ - timer->expire_time) / timer->rate_ms + 1
+			: 1;
+
+		TIMER_STATS_ADD(timer->site_stats, lateness_ms, internal_time_ - timer->expire_time);
+		if (timer->loop)
 		{
-			// Timer has expired! Fire the delegate, then handle potential looping.
-
-			// Remove it from the heap and store it while we're EXECUTING
-			VectorUtils<decltype(active_timer_heap_)>::HeapPop(active_timer_heap_, currently_executing_timer_);
-			currently_executing_timer_.status = ETimerStatus::EXECUTING;
+			TIMER_STATS_ADD(timer->site_stats, catch_up_count, call_count - 1);
+		}
 
-			// Determine how many times the timer may have elapsed (e.g. for large DeltaTime on a short looping timer)
-			int64_t const call_count = currently_executing_timer_.loop ?
-				(internal_time_ - currently_executing_timer_.expire_time) / currently_executing_timer_.rate_ms + 1
-				: 1;
+		// Hold the delegate outside of the slot while it runs, timers set from inside it may grow timer_slots_
+		TimerCallback timer_cb = std::move(timer->timer_cb);
 
-			// Now call the function
-			for (int64_t call_idx = 0; call_idx < call_count; ++call_idx)
+		// Now call the function
+		for (int64_t call_idx = 0; call_idx < call_count; ++call_idx)
+		{
+			if (timer_cb)
 			{
-				if (currently_executing_timer_.timer_cb)
-				{
-					currently_executing_timer_.timer_cb();
-				}
-
-				// If timer was cleared in the delegate execution, don't execute further 
-				if (currently_executing_timer_.status != ETimerStatus::EXECUTING)
-				{
-					break;
-				}
+				TIMER_STATS_SCOPE_EXEC(timer_slots_[slot].timer.site_stats);
+				timer_cb();
 			}
 
-			// Status test needed to ensure it didn't get cleared during execution
-			if (currently_executing_timer_.loop && currently_executing_timer_.status == ETimerStatus::EXECUTING)
+			// If timer was cleared or paused in the delegate execution, don't execute further 
+			if (timer_slots_[slot].timer.status != ETimerStatus::EXECUTING)
 			{
-				// if timer requires a delegate, make sure it's still validly bound (i.e. the delegate's object didn't get deleted or something)
-				if (!currently_executing_timer_.is_require_cb || currently_executing_timer_.timer_cb)
-				{
-					// Put this timer back on the heap
-					currently_executing_timer_.expire_time += call_count * currently_executing_timer_.rate_ms;
-					currently_executing_timer_.status = ETimerStatus::ACTIVE;
-					VectorUtils<decltype(active_timer_heap_)>::HeapPush(active_timer_heap_, currently_executing_timer_);
-				}
+				break;
 			}
-
-			currently_executing_timer_.Clear();
 		}
-		else
+
+		currently_executing_slot_ = INDEX_NONE;
+		timer = &timer_slots_[slot].timer;
+		switch (timer->status)
 		{
-			// no need to go further down the heap, we can be finished
+		case ETimerStatus::EXECUTING:
+			// if timer requires a delegate, make sure it's still validly bound (i.e. the delegate's object didn't get deleted or something)
+			if (timer->loop && (!timer->is_require_cb || timer_cb))
+			{
+				// Put this timer back on the active queue
+				timer->timer_cb = std::move(timer_cb);
+				timer->expire_time += call_count * timer->rate_ms;
+				timer->status = ETimerStatus::ACTIVE;
+				ActivePush(slot);
+			}
+			else
+			{
+				FreeTimerSlot(slot);
+			}
+			break;
+
+		case ETimerStatus::PENDING_REMOVAL:
+			FreeTimerSlot(slot);
+			break;
+
+		default:
+			// Paused (and maybe continued) from its own delegate, it already lives in another list
+			timer->timer_cb = std::move(timer_cb);
 			break;
 		}
 	}
@@ -396,19 +556,131 @@ void ScheduleTimer::Tick(int tick_ms)
 	last_ticked_frame_ = GTLFrameCounter;
 
 	// If we have any Pending Timers, add them to the Active Queue.
-	for (auto&& e : pending_timer_list_)
+	for (auto pending_slot : pending_timer_list_)
 	{
-		e.expire_time += internal_time_;
-		e.status = ETimerStatus::ACTIVE;
-		VectorUtils<decltype(active_timer_heap_)>::HeapPush(active_timer_heap_, e);
+		TimerSlot& timer_slot = timer_slots_[pending_slot];
+		timer_slot.list_index = INDEX_NONE;
+		timer_slot.timer.expire_time += internal_time_;
+		timer_slot.timer.status = ETimerStatus::ACTIVE;
 	}
+	ActivePushBatch(pending_timer_list_);
 	pending_timer_list_.clear();
 }
 
 void ScheduleTimer::ClearAllTimers()
 {
-	active_timer_heap_.clear();
+	active_timer_heap_.Clear();
+	if (active_timer_wheel_)
+	{
+		active_timer_wheel_->Clear();
+	}
 	paused_timer_list_.clear();
 	pending_timer_list_.clear();
-	currently_executing_timer_.Clear();
+
+	free_timer_slots_.clear();
+	for (size_t i = timer_slots_.size(); i-- > 0;)
+	{
+		if (static_cast<int32_t>(i) == currently_executing_slot_)
+		{
+			timer_slots_[i].timer.timer_handle.Invalidate();
+			timer_slots_[i].timer.status = ETimerStatus::PENDING_REMOVAL;
+			continue;
+		}
+		timer_slots_[i] = TimerSlot();
+		free_timer_slots_.push_back(static_cast<uint32_t>(i));
+	}
+}
+
+void ScheduleTimer::ActivePush(uint32_t slot)
+{
+	const int64_t expire_time = timer_slots_[slot].timer.expire_time;
+	if (active_timer_wheel_)
+	{
+		active_timer_wheel_->Push(slot, expire_time);
+	}
+	else
+	{
+		active_timer_heap_.Push(slot, expire_time);
+	}
+}
+
+void ScheduleTimer::ActivePushBatch(const std::vector<uint32_t>& slots)
+{
+	if (active_timer_wheel_)
+	{
+		// already O(1) per timer
+		for (auto slot : slots)
+		{
+			active_timer_wheel_->Push(slot, timer_slots_[slot].timer.expire_time);
+		}
+	}
+	else
+	{
+		active_timer_heap_.PushBatch(slots.begin(), slots.end(),
+			[this](uint32_t slot) { return timer_slots_[slot].timer.expire_time; });
+	}
+}
+
+void ScheduleTimer::ActiveRemoveBatch(const std::vector<uint32_t>& slots)
+{
+	if (active_timer_wheel_)
+	{
+		for (auto slot : slots)
+		{
+			active_timer_wheel_->Remove(slot);
+		}
+	}
+	else
+	{
+		active_timer_heap_.RemoveBatch(slots.begin(), slots.end());
+	}
+}
+
+void ScheduleTimer::ActiveRemove(uint32_t slot)
+{
+	if (active_timer_wheel_)
+	{
+		active_timer_wheel_->Remove(slot);
+	}
+	else
+	{
+		active_timer_heap_.Remove(slot);
+	}
+}
+
+bool ScheduleTimer::ActivePopExpired(uint32_t& out_slot)
+{
+	if (active_timer_wheel_)
+	{
+		return active_timer_wheel_->PopExpired(internal_time_, out_slot);
+	}
+	if (!active_timer_heap_.IsEmpty() && internal_time_ > active_timer_heap_.TopKey())
+	{
+		out_slot = active_timer_heap_.Pop();
+		return true;
+	}
+	// no need to go further down the heap, we can be finished
+	return false;
+}
+
+size_t ScheduleTimer::ActiveSize() const
+{
+	return active_timer_wheel_ ? active_timer_wheel_->Size() : active_timer_heap_.Size();
+}
+
+void ScheduleTimer::ListPush(std::vector<uint32_t>& timer_list, uint32_t slot)
+{
+	timer_slots_[slot].list_index = static_cast<int32_t>(timer_list.size());
+	timer_list.push_back(slot);
+}
+
+void ScheduleTimer::ListRemove(std::vector<uint32_t>& timer_list, uint32_t slot)
+{
+	const int32_t list_index = timer_slots_[slot].list_index;
+	Expects(list_index != INDEX_NONE && timer_list[list_index] == slot);
+
+	timer_slots_[timer_list.back()].list_index = list_index;
+	timer_list[list_index] = timer_list.back();
+	timer_list.pop_back();
+	timer_slots_[slot].list_index = INDEX_NONE;
 }
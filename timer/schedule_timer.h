@@ -1,44 +1,88 @@
 #pragma once
 
 #include "timer_data.h"
+#include "timing_wheel.h"
+#include "container/indexed_heap.h"
+#include "container/array_view.h"
 
 namespace terra
 {
-	//min heap, not thread-safe
+	enum class ETimerQueueType : uint8_t
+	{
+		/** Binary min heap, O(log n) insert and expire. */
+		BINARY_HEAP,
+		/** Hierarchical timing wheel, O(1) amortized insert, cancel and expire. Better with lots of live timers. */
+		TIMING_WHEEL,
+	};
+
+	//min heap or timing wheel, O(1) lookup by handle, not thread-safe.
+	//no shared state between instances, one per thread is fine.
     class ScheduleTimer
     {
     private:
-		/** Heap of actively running timers. */
-		std::vector<TimerData> active_timer_heap_;
+		/** Storage of a timer. Timers never move while alive, the containers below only hold slot indices. */
+		struct TimerSlot
+		{
+			TimerData timer;
+			/** Position in paused_timer_list_ or pending_timer_list_ while PAUSED or PENDING */
+			int32_t list_index{ INDEX_NONE };
+		};
+
+		const ETimerQueueType queue_type_;
+		/** Every timer of this manager, indexed by slot. */
+		std::vector<TimerSlot> timer_slots_;
+		/** Slots released by cleared or finished timers, reused before timer_slots_ grows. */
+		std::vector<uint32_t> free_timer_slots_;
+
+		/** Heap of actively running timers, keyed by expire time. */
+		TIndexedHeap<int64_t> active_timer_heap_;
+		/** Wheel of actively running timers, only used with ETimerQueueType::TIMING_WHEEL. */
+		std::unique_ptr<TimingWheel> active_timer_wheel_;
 		/** Unordered list of paused timers. */
-		std::vector<TimerData> paused_timer_list_;
+		std::vector<uint32_t> paused_timer_list_;
 		/** List of timers added this frame, to be added after timer has been ticked */
-		std::vector<TimerData> pending_timer_list_;
+		std::vector<uint32_t> pending_timer_list_;
+		/** Scratch list of the batch calls, kept to reuse its memory */
+		std::vector<uint32_t> batch_slots_;
 
 		/** An internally consistent clock, independent of World.  Advances during ticking. */
 		int64_t internal_time_{ 0 };
 
-		/** Timer delegate currently being executed.  Used to handle "timer delegates that manipulate timers" cases. */
-		TimerData currently_executing_timer_;
+		/** Slot of the timer delegate currently being executed.  Used to handle "timer delegates that manipulate timers" cases. */
+		int32_t currently_executing_slot_{ INDEX_NONE };
 
 		/** Set this to GFrameCounter when Timer is ticked. To figure out if Timer has been already ticked or not this frame. */
 		int64_t last_ticked_frame_{ static_cast<int64_t>(-1) };
 
-		/** The last handle we assigned from this timer manager */
-		static int64_t last_assigned_handle_;
+		/** The last handle serial number we assigned from this timer manager */
+		uint64_t last_assigned_serial_number_{ 0 };
+
+#ifdef ENABLE_TIMER_STATS
+		TimerStats stats_;
+#endif
 		
 	public:
-		ScheduleTimer();
+		explicit ScheduleTimer(ETimerQueueType queue_type = ETimerQueueType::BINARY_HEAP);
 		virtual ~ScheduleTimer();
 
 		void Tick(int tick_ms);
 
 		void ClearAllTimers();
 
-		void SetTimer(TimerHandle& in_out_handle, const TimerCallback& timer_cb, int rate_ms, bool loop, int first_delay_ms = -1);
 		void SetTimer(TimerHandle& in_out_handle, TimerCallback&& timer_cb, int rate_ms, bool loop, int first_delay_ms = -1);
 
-		void SetTimerForNextTick(const TimerCallback& timer_cb);
+		void SetTimerForNextTick(TimerCallback&& timer_cb);
+
+		/**
+		* Sets many timers at once, e.g. all respawn timers of a zone being loaded. The callbacks are moved out of timers.
+		* Handles still set are cleared together first, slots are taken in bulk and, for a large batch, the heap is
+		* rebuilt once instead of pushing timer by timer. Every entry needs a handle. A handle listed more than once
+		* ends up with its last entry, as with repeated SetTimer() calls.
+		*/
+		void SetTimers(TArrayView<TimerParams> timers);
+
+		/** Clears many timers at once and invalidates their handles, the heap is rebuilt once for the whole batch. */
+		void ClearTimers(TArrayView<TimerHandle> handles);
 
 		void ClearTimer(TimerHandle& in_handle)
 		{
@@ -48,14 +92,19 @@ namespace terra
 
 		void PauseTimer(TimerHandle timer_handle)
 		{
-			int timer_idx;
-			TimerData const* timer_to_pause = FindTimer(timer_handle, &timer_idx);
-			InternalPauseTimer(timer_to_pause, timer_idx);
+			int32_t slot = FindTimerSlot(timer_handle);
+			if (slot != INDEX_NONE)
+			{
+				InternalPauseTimer(static_cast<uint32_t>(slot));
+			}
 		}
 		void ContiuneTimer(TimerHandle timer_handle)
 		{
-			int timer_idx = FindTimerInList(paused_timer_list_, timer_handle);
-			InternalContinueTimer(timer_idx);
+			int32_t slot = FindTimerSlot(timer_handle);
+			if (slot != INDEX_NONE)
+			{
+				InternalContinueTimer(static_cast<uint32_t>(slot));
+			}
 		}
 
 		int GetTimerRateMs(TimerHandle timer_handle) const
@@ -95,23 +144,43 @@ namespace terra
 		}
 		bool HasBeenTickedThisFrame() const { return last_ticked_frame_ == GTLFrameCounter; }
 
+		ETimerQueueType GetQueueType() const { return queue_type_; }
+
 		/** Debug command to output info on all timers currently set to the log. */
 		void ListTimers() const;
 
-		/** Get the current last assigned handle */
-		static void ValidateHandle(TimerHandle& in_out_handle);
+		/** Copies the per callback site stats, empty unless built with ENABLE_TIMER_STATS. */
+		void GetTimerStats(TimerStatsSnapshot& out_snapshot) const;
+		void ResetTimerStats();
 
 	private:
-		void InternalSetTimer(TimerData& new_timer, int rate_ms, bool loop, int first_delay_ms);
+		void InternalSetTimer(uint32_t slot, int rate_ms, bool loop, int first_delay_ms);
+		bool InitTimer(uint32_t slot, int rate_ms, bool loop, int first_delay_ms, bool ticked_this_frame);
 		void InternalClearTimer(TimerHandle& in_handle);
-		void InternalClearTimer(int timer_idx, ETimerStatus timer_status);
+		void InternalClearTimer(uint32_t slot);
 		int64_t InternalGetTimerRemaining(const TimerData* const timer_data) const;
 		int64_t InternalGetTimerElapsed(const TimerData* const timer_data) const;
 		int InternalGetTimerRate(const TimerData* const timer_data) const;
-		void InternalPauseTimer(TimerData const* timer_to_pause, int timer_idx);
-		void InternalContinueTimer(int paused_timer_idx);
-
-		const TimerData* FindTimer(const TimerHandle& timer_handle, int* out_timer_index = nullptr) const;
-		int FindTimerInList(const std::vector<TimerData>& search_list, const TimerHandle& timer_handle) const;
+		void InternalPauseTimer(uint32_t slot);
+		void InternalContinueTimer(uint32_t slot);
+
+		uint32_t AllocTimerSlot(TimerHandle* out_handle);
+		void AssignTimerHandle(uint32_t slot, TimerHandle& out_handle);
+		/** ClearTimer() for the batch calls, ACTIVE slots are freed and left in batch_slots_ for ActiveRemoveBatch(). */
+		void ClearTimerForBatch(TimerHandle& in_handle);
+		void FreeTimerSlot(uint32_t slot);
+
+		void ActivePush(uint32_t slot);
+		void ActivePushBatch(const std::vector<uint32_t>& slots);
+		void ActiveRemoveBatch(const std::vector<uint32_t>& slots);
+		void ActiveRemove(uint32_t slot);
+		bool ActivePopExpired(uint32_t& out_slot);
+		size_t ActiveSize() const;
+
+		void ListPush(std::vector<uint32_t>& timer_list, uint32_t slot);
+		void ListRemove(std::vector<uint32_t>& timer_list, uint32_t slot);
+
+		int32_t FindTimerSlot(const TimerHandle& timer_handle) const;
+		const TimerData* FindTimer(const TimerHandle& timer_handle) const;
     };
 }
\ No newline at end of file
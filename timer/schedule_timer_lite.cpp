@@ -2,6 +2,11 @@
 
 using namespace terra;
 
+namespace
+{
+	/** Don't bother compacting small heaps, skipping a few stale entries is cheaper. */
+	constexpr size_t kMinStaleEntriesToCompact = 64;
+}
 
 ScheduleTimerLite::ScheduleTimerLite(int64_t tick_ms)
 	: kTickIntervalMs(tick_ms)
@@ -10,57 +15,216 @@ ScheduleTimerLite::ScheduleTimerLite(int64_t tick_ms)
 	next_sample_time_ = elapsed_time_ + kTickIntervalMs;
 }
 
-void ScheduleTimerLite::RunAfter(int delay_ms, const TimerCallback& timer_cb)
+TimerHandleLite ScheduleTimerLite::RunAfter(int delay_ms, TimerCallback&& timer_cb)
+{
+	return AddTimer(elapsed_time_ + delay_ms, 0, std::move(timer_cb));
+}
+
+TimerHandleLite ScheduleTimerLite::RunEvery(int interval_ms, TimerCallback&& timer_cb, int first_delay_ms/* = -1*/)
 {
-	timers_.emplace(elapsed_time_ + delay_ms, timer_cb);
+	Expects(interval_ms > 0);
+	return AddTimer(elapsed_time_ + (first_delay_ms >= 0 ? first_delay_ms : interval_ms), interval_ms, std::move(timer_cb));
 }
 
-void ScheduleTimerLite::RunAfter(int delay_ms, TimerCallback&& timer_cb)
+bool ScheduleTimerLite::Cancel(TimerHandleLite& handle)
 {
-	timers_.emplace(elapsed_time_ + delay_ms, std::move(timer_cb));
+	const int32_t slot = FindTimerSlot(handle);
+	handle.Invalidate();
+	if (slot == INDEX_NONE)
+	{
+		return false;
+	}
+	// the heap entry is skipped once it comes up, unless the timer is firing right now and has no entry
+	if (slot != executing_slot_)
+	{
+		++stale_entries_;
+	}
+	ReleaseSlot(static_cast<uint32_t>(slot));
+	return true;
+}
+
+void ScheduleTimerLite::GetTimerStats(TimerStatsSnapshot& out_snapshot) const
+{
+#ifdef ENABLE_TIMER_STATS
+	stats_.GetSnapshot(out_snapshot);
+#else
+	out_snapshot.sites.clear();
+#endif
+}
+
+void ScheduleTimerLite::ResetTimerStats()
+{
+#ifdef ENABLE_TIMER_STATS
+	stats_.Reset();
+#endif
 }
 
 void ScheduleTimerLite::Tick(int tick_ms)
 {
 	elapsed_time_ += tick_ms;
-	if (!IsTimeToTick())
+	if (IsTimeToTick())
+	{
+		next_sample_time_ += kTickIntervalMs;
+	}
+	else if (!has_carry_over_)
 	{
 		return;
 	}
-	next_sample_time_ += kTickIntervalMs;
+	has_carry_over_ = false;
+#ifdef ENABLE_TIMER_STATS
+	++tick_count_;
+#endif
+
+	size_t fired = 0;
 	while (!timers_.empty())
 	{
-		auto& e = timers_.top();
-		if (elapsed_time_ >= e.expire_time)
+		const TimerEntry& top = timers_.front();
+		if (IsStale(top))
+		{
+			PopEntry();
+			--stale_entries_;
+			continue;
+		}
+		if (elapsed_time_ < top.expire_time)
 		{
-			e.timer_cb();
-			timers_.pop();
+			break;
 		}
-		else
+		if (max_callbacks_per_tick_ > 0 && fired >= max_callbacks_per_tick_)
 		{
+			// counted as they fire, walking the due part of the heap on every capped tick would cost what the cap saves
+			has_carry_over_ = true;
+			last_capped_time_ = elapsed_time_;
 			break;
 		}
+
+		const TimerEntry entry = PopEntry();
+		++fired;
+		if (entry.expire_time <= last_capped_time_)
+		{
+			++overflow_count_;
+		}
+		TimerDataLite& timer_to_fire = timer_slots_[entry.slot];
+		TIMER_STATS_ADD(timer_to_fire.site_stats, lateness_ms, elapsed_time_ - entry.expire_time);
+		TimerCallback timer_cb = std::move(timer_to_fire.timer_cb);
+		if (timer_to_fire.rate_ms <= 0)
+		{
+			// one shot, the handle is dead before the callback runs so it may reuse the slot
+			TIMER_STATS_SCOPE_EXEC(timer_to_fire.site_stats);
+			ReleaseSlot(entry.slot);
+			if (timer_cb)
+			{
+				timer_cb();
+			}
+			continue;
+		}
+
+		// recurring timers fire once per pop, the ones still due come up again right after
+#ifdef ENABLE_TIMER_STATS
+		// recorded on the first pop of the tick only, the extra calls still owed as ScheduleTimer records them
+		if (timer_to_fire.catch_up_tick != tick_count_)
+		{
+			timer_to_fire.catch_up_tick = tick_count_;
+			TIMER_STATS_ADD(timer_to_fire.site_stats, catch_up_count, (elapsed_time_ - entry.expire_time) / timer_to_fire.rate_ms);
+		}
+#endif
+		executing_slot_ = static_cast<int32_t>(entry.slot);
+		if (timer_cb)
+		{
+			TIMER_STATS_SCOPE_EXEC(timer_to_fire.site_stats);
+			timer_cb();
+		}
+		executing_slot_ = INDEX_NONE;
+
+		// timers set from the callback may have grown timer_slots_, and a cancel bumps the serial number
+		TimerDataLite& timer = timer_slots_[entry.slot];
+		if (timer.serial_number == entry.serial_number)
+		{
+			timer.timer_cb = std::move(timer_cb);
+			timer.expire_time += timer.rate_ms;
+			PushEntry(entry.slot);
+		}
+	}
+
+	if (stale_entries_ >= kMinStaleEntriesToCompact && stale_entries_ * 2 > timers_.size())
+	{
+		Compact();
 	}
 }
 
-//#include <iostream>
-//#include <thread>
-//#include <chrono>
-//
-//void test()
-//{
-//	ScheduleTimerLite stl(1000);
-//	stl.RunAfter(1000, []() { std::cout << "after 1280ms, timer called!" << std::endl; });
-//	stl.RunAfter(5280, []() { std::cout << "after 5280ms, timer called!" << std::endl; });
-//	stl.RunAfter(10280, []() { std::cout << "after 10280ms, timer called!" << std::endl; });
-//
-//	using namespace std::chrono;
-//	using namespace std::literals;
-//	for (int i = 0; i < 150; i++)
-//	{
-//		stl.Tick(100);
-//		std::this_thread::sleep_for(100ms);
-//	}
-//
-//	std::cout << "end" << std::endl;
-//}
+TimerHandleLite ScheduleTimerLite::AddTimer(int64_t expire_time, int rate_ms, TimerCallback&& timer_cb)
+{
+	uint32_t slot;
+	if (!free_timer_slots_.empty())
+	{
+		slot = free_timer_slots_.back();
+		free_timer_slots_.pop_back();
+	}
+	else
+	{
+		slot = static_cast<uint32_t>(timer_slots_.size());
+		timer_slots_.emplace_back();
+	}
+
+	TimerDataLite& timer = timer_slots_[slot];
+	timer.timer_cb = std::move(timer_cb);
+	timer.expire_time = expire_time;
+	timer.rate_ms = rate_ms;
+	TIMER_STATS_BIND_SITE(stats_, timer);
+#ifdef ENABLE_TIMER_STATS
+	timer.catch_up_tick = 0;
+#endif
+	PushEntry(slot);
+
+	TimerHandleLite handle;
+	handle.timer_handle = (static_cast<uint64_t>(timer.serial_number) << 32) | slot;
+	return handle;
+}
+
+void ScheduleTimerLite::PushEntry(uint32_t slot)
+{
+	const TimerDataLite& timer = timer_slots_[slot];
+	timers_.push_back(TimerEntry{ timer.expire_time, slot, timer.serial_number });
+	heap::PushHeap(timers_.begin(), timers_.end(), std::greater<TimerEntry>());
+}
+
+ScheduleTimerLite::TimerEntry ScheduleTimerLite::PopEntry()
+{
+	heap::PopHeap(timers_.begin(), timers_.end(), std::greater<TimerEntry>());
+	const TimerEntry entry = timers_.back();
+	timers_.pop_back();
+	return entry;
+}
+
+void ScheduleTimerLite::ReleaseSlot(uint32_t slot)
+{
+	TimerDataLite& timer = timer_slots_[slot];
+	timer.timer_cb = nullptr;
+	if (++timer.serial_number == 0)
+	{
+		timer.serial_number = 1;
+	}
+	free_timer_slots_.push_back(slot);
+}
+
+int32_t ScheduleTimerLite::FindTimerSlot(TimerHandleLite handle) const
+{
+	if (!handle.IsValid())
+	{
+		return INDEX_NONE;
+	}
+	const uint32_t slot = static_cast<uint32_t>(handle.timer_handle);
+	const uint32_t serial_number = static_cast<uint32_t>(handle.timer_handle >> 32);
+	if (slot >= timer_slots_.size() || timer_slots_[slot].serial_number != serial_number)
+	{
+		return INDEX_NONE;
+	}
+	return static_cast<int32_t>(slot);
+}
+
+void ScheduleTimerLite::Compact()
+{
+	timers_.erase(std::remove_if(timers_.begin(), timers_.end(),
+		[this](const TimerEntry& entry) { return IsStale(entry); }), timers_.end());
+	heap::MakeHeap(timers_.begin(), timers_.end(), std::greater<TimerEntry>());
+	stale_entries_ = 0;
+}
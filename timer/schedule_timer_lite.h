@@ -1,28 +1,94 @@
 #pragma once
 
 #include "timer_data.h"
-#include  <queue>
+#include "container/make_heap.h"
 
 namespace terra
 {
-	//priority_queue
-	// only support run after once
+	//min heap of (expire time, slot), callbacks live in slots and are moved out to fire.
+	//cancel is lazy: the heap entry stays until it comes up and is skipped. not thread-safe.
 	class ScheduleTimerLite
 	{
 	private:
-		std::priority_queue<TimerDataLite, std::vector<TimerDataLite>, std::greater<TimerDataLite>> timers_;
+		struct TimerEntry
+		{
+			int64_t expire_time;
+			uint32_t slot;
+			uint32_t serial_number;
+
+			bool operator>(const TimerEntry& rhs) const
+			{
+				return expire_time > rhs.expire_time;
+			}
+		};
+
+		std::vector<TimerEntry> timers_;
+		std::vector<TimerDataLite> timer_slots_;
+		std::vector<uint32_t> free_timer_slots_;
+		/** Entries in timers_ whose timer has been cancelled */
+		size_t stale_entries_{ 0 };
+		/** Slot of the recurring timer being fired, it is off the heap while its callback runs */
+		int32_t executing_slot_{ INDEX_NONE };
 
 		int64_t elapsed_time_{ 0 };
 		int64_t next_sample_time_{ 0 };
 		const int64_t kTickIntervalMs;
+
+		/** 0 means no limit */
+		size_t max_callbacks_per_tick_{ 0 };
+		/** Due timers left for the next tick because the cap was hit */
+		bool has_carry_over_{ false };
+		/** elapsed_time_ of the last tick the cap cut short, timers due by then which fire later were deferred */
+		int64_t last_capped_time_{ std::numeric_limits<int64_t>::min() };
+		uint64_t overflow_count_{ 0 };
+
+#ifdef ENABLE_TIMER_STATS
+		TimerStats stats_;
+		/** Ticks that looked at the heap, starts from 1 */
+		uint64_t tick_count_{ 0 };
+#endif
+
 	public:
 		ScheduleTimerLite(int64_t tick_ms);
-		void RunAfter(int delay_ms, const TimerCallback& timer_cb);
-		void RunAfter(int delay_ms, TimerCallback&& timer_cb);
+
+		TimerHandleLite RunAfter(int delay_ms, TimerCallback&& timer_cb);
+		/** Fires every interval_ms, first after first_delay_ms or interval_ms if negative. interval_ms must be positive. */
+		TimerHandleLite RunEvery(int interval_ms, TimerCallback&& timer_cb, int first_delay_ms = -1);
+
+		/** Returns false if the timer already fired (one shot) or was cancelled. Safe from inside callbacks. */
+		bool Cancel(TimerHandleLite& handle);
+		bool IsPending(TimerHandleLite handle) const { return FindTimerSlot(handle) != INDEX_NONE; }
 
 		void Tick(int tick_ms);
 
 		bool IsTimeToTick() { return elapsed_time_ >= next_sample_time_; }
+
+		/**
+		* Caps how many callbacks one tick runs, so a burst of expiries can't stall a frame.
+		* Due timers over the cap stay queued and run first on the next tick. 0 disables the cap.
+		*/
+		void SetMaxCallbacksPerTick(size_t max_callbacks) { max_callbacks_per_tick_ = max_callbacks; }
+		/**
+		* Total number of callbacks the cap pushed to a later tick, each counted once when it finally runs. A timer set
+		* between a capped tick and the next one and already due by the capped tick counts as well.
+		*/
+		uint64_t GetOverflowCount() const { return overflow_count_; }
+
+		/** Copies the per callback site stats, empty unless built with ENABLE_TIMER_STATS. */
+		void GetTimerStats(TimerStatsSnapshot& out_snapshot) const;
+		void ResetTimerStats();
+
+		/** Number of live timers. */
+		size_t Size() const { return timers_.size() - stale_entries_; }
+
+	private:
+		TimerHandleLite AddTimer(int64_t expire_time, int rate_ms, TimerCallback&& timer_cb);
+		void PushEntry(uint32_t slot);
+		TimerEntry PopEntry();
+		bool IsStale(const TimerEntry& entry) const { return timer_slots_[entry.slot].serial_number != entry.serial_number; }
+		void ReleaseSlot(uint32_t slot);
+		int32_t FindTimerSlot(TimerHandleLite handle) const;
+		void Compact();
 	};
 
-}
\ No newline at end of file
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "timer_handle.h"
+#include "inline_function.h"
+#include "timer_stats.h"
 
 namespace terra
 {
@@ -10,32 +12,52 @@ namespace terra
 		ACTIVE,
 		PAUSED,
 		EXECUTING,
+		/** Cleared while its delegate was executing, the slot is released once the delegate returns. */
+		PENDING_REMOVAL,
 	};
 
-	using TimerCallback = std::function<void()>;
+	/**
+	* Timer delegate. Lambdas capturing up to 48 bytes are stored inside TimerData itself, so setting and firing
+	* timers does not allocate once the timer storage has grown to its working size.
+	*/
+	using TimerCallback = TInlineFunction<void(), 48>;
 
+	/** One entry of ScheduleTimer::SetTimers, same meaning as the SetTimer arguments. */
+	struct TimerParams
+	{
+		TimerHandle* handle{ nullptr };
+		TimerCallback timer_cb;
+		int rate_ms{ 0 };
+		bool loop{ false };
+		int first_delay_ms{ -1 };
+	};
+
+	/** Handle of a ScheduleTimerLite timer, packs the slot index and the serial number the slot had when set. */
+	struct TimerHandleLite
+	{
+		uint64_t timer_handle{ 0 };
+
+		bool IsValid() const { return timer_handle != 0; }
+		void Invalidate() { timer_handle = 0; }
+
+		bool operator==(const TimerHandleLite& rhs) const { return timer_handle == rhs.timer_handle; }
+		bool operator!=(const TimerHandleLite& rhs) const { return timer_handle != rhs.timer_handle; }
+	};
+
+	/** Storage of a ScheduleTimerLite timer. */
 	struct TimerDataLite
 	{
-		TimerDataLite(int64_t in_expire_time, const TimerCallback& cb)
-			: expire_time(in_expire_time)
-			, timer_cb(cb)
-		{
-		}
-		TimerDataLite(int64_t in_expire_time, TimerCallback&& cb)
-			: expire_time(in_expire_time)
-			, timer_cb(std::move(cb))
-		{
-		}
-		int64_t expire_time;
 		TimerCallback timer_cb;
-		bool operator<(const TimerDataLite& rhs) const
-		{
-			return expire_time < rhs.expire_time;
-		}
-		bool operator>(const TimerDataLite& rhs) const
-		{
-			return expire_time > rhs.expire_time;
-		}
+		int64_t expire_time{ 0 };
+		/** Interval of a recurring timer, 0 for a one shot */
+		int rate_ms{ 0 };
+		/** Bumped every time the slot is released, so handles of earlier timers no longer match. Never 0. */
+		uint32_t serial_number{ 1 };
+#ifdef ENABLE_TIMER_STATS
+		TimerSiteStats* site_stats{ nullptr };
+		/** Tick the catch-up count was last recorded in, so a timer catching up records it once per tick */
+		uint64_t catch_up_tick{ 0 };
+#endif
 	};
 
 
@@ -49,10 +71,17 @@ namespace terra
 		int64_t expire_time{ 0 };
 		TimerCallback timer_cb;
 		TimerHandle timer_handle;
+#ifdef ENABLE_TIMER_STATS
+		TimerSiteStats* site_stats{ nullptr };
+#endif
 		bool operator<(const TimerData& rhs) const
 		{
 			return expire_time < rhs.expire_time;
 		}
+		bool operator>(const TimerData& rhs) const
+		{
+			return expire_time > rhs.expire_time;
+		}
 
 		void Clear()
 		{
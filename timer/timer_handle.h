@@ -6,12 +6,45 @@
 namespace terra
 {
 	class ScheduleTimer;
+
+	/**
+	* Unique handle of a timer in one ScheduleTimer.
+	*
+	* Packs the slot index of the timer in its manager and the serial number the slot was given when the timer
+	* was set. A slot is reused by later timers with a new serial number, so a stale handle is rejected by one
+	* compare instead of a search.
+	*/
 	struct TimerHandle
 	{
 	private:
+		static constexpr uint32_t kIndexBits = 24;
+		static constexpr uint32_t kSerialNumberBits = 40;
+		static constexpr uint32_t kMaxIndex = (static_cast<uint32_t>(1) << kIndexBits) - 1;
+		static constexpr uint64_t kMaxSerialNumber = (static_cast<uint64_t>(1) << kSerialNumberBits) - 1;
+
 		uint64_t timer_handle{ 0 };
+
+		/** Serial numbers start from 1, so a valid handle is never 0. */
+		void SetIndexAndSerialNumber(uint32_t index, uint64_t serial_number)
+		{
+			Expects(index <= kMaxIndex && serial_number > 0 && serial_number <= kMaxSerialNumber);
+			timer_handle = (serial_number << kIndexBits) | index;
+		}
+		uint32_t GetIndex() const { return static_cast<uint32_t>(timer_handle & kMaxIndex); }
+		uint64_t GetSerialNumber() const { return timer_handle >> kIndexBits; }
+
+		/** Serial number 0 never names a timer, ScheduleTimer::SetTimers() uses it to tag a handle with its batch entry. */
+		void SetBatchEntry(size_t entry)
+		{
+			Expects(entry < kMaxIndex);
+			timer_handle = entry + 1;
+		}
+		bool IsBatchEntry() const { return IsValid() && GetSerialNumber() == 0; }
+		size_t GetBatchEntry() const { return GetIndex() - 1; }
+
 	public:
 		friend class ScheduleTimer;
+		friend struct std::hash<TimerHandle>;
 		bool IsValid() const
 		{
 			return timer_handle != 0;
@@ -34,8 +67,17 @@ namespace terra
 
 		std::string ToString() const
 		{
-			return StringUtils::Format("%ull", timer_handle);
+			return StringUtils::Format("%u:%llu", GetIndex(), static_cast<unsigned long long>(GetSerialNumber()));
 		}
 
 	};
+}
+
+namespace std {
+	template<> struct hash<terra::TimerHandle>
+	{
+		size_t operator()(const terra::TimerHandle& handle) const noexcept {
+			return std::hash<uint64_t>()(handle.timer_handle);
+		}
+	};
 }
\ No newline at end of file
@@ -0,0 +1,259 @@
+#include "timer_service.h"
+#include "thread/thread_manager.h"
+
+using namespace terra;
+
+namespace terra
+{
+	/** One ScheduleTimer and the thread which owns it. Everything but the command queue is only touched by that thread. */
+	class TimerShard : public Runnable
+	{
+	private:
+		enum class ECommandType : uint8_t
+		{
+			SET,
+			CLEAR,
+		};
+
+		struct TimerCommand
+		{
+			ECommandType type{ ECommandType::SET };
+			uint64_t timer_id{ 0 };
+			TimerCallback timer_cb;
+			int rate_ms{ 0 };
+			bool loop{ false };
+			int first_delay_ms{ -1 };
+			ITimerExecutor* executor{ nullptr };
+		};
+
+		struct TimerEntry
+		{
+			TimerHandle timer_handle;
+			TimerCallback timer_cb;
+			/** Looping timers posted to an executor share their callback with the posted closures. */
+			std::shared_ptr<TimerCallback> shared_cb;
+			ITimerExecutor* executor{ nullptr };
+			bool loop{ false };
+		};
+
+		ScheduleTimer timer_manager_;
+		TQueue<TimerCommand, EQueueMode::Mpsc> commands_;
+		std::unordered_map<uint64_t, TimerEntry> timers_;
+		const int tick_ms_;
+		/** Callbacks fired since the last report to the ThreadManager */
+		uint64_t fired_count_{ 0 };
+		std::atomic<bool> stopping_{ false };
+
+	public:
+		explicit TimerShard(int tick_ms) : tick_ms_(tick_ms) {}
+
+		void PostSetTimer(uint64_t timer_id, TimerCallback&& timer_cb, int rate_ms, bool loop, int first_delay_ms, ITimerExecutor* executor)
+		{
+			TimerCommand command;
+			command.type = ECommandType::SET;
+			command.timer_id = timer_id;
+			command.timer_cb = std::move(timer_cb);
+			command.rate_ms = rate_ms;
+			command.loop = loop;
+			command.first_delay_ms = first_delay_ms;
+			command.executor = executor;
+			commands_.Enqueue(std::move(command));
+		}
+
+		void PostClearTimer(uint64_t timer_id)
+		{
+			TimerCommand command;
+			command.type = ECommandType::CLEAR;
+			command.timer_id = timer_id;
+			commands_.Enqueue(std::move(command));
+		}
+
+		uint32_t Run() override
+		{
+			using Clock = std::chrono::steady_clock;
+			const Clock::time_point start_time = Clock::now();
+			ThreadRecord* record = GetThreadRecord();
+			int64_t ticked_ms = 0;
+			while (!stopping_.load(std::memory_order_relaxed))
+			{
+				if (record)
+				{
+					record->MarkBusy();
+				}
+				const int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start_time).count();
+				++GTLFrameCounter;
+				timer_manager_.Tick(static_cast<int>(now_ms - ticked_ms));
+				ticked_ms = now_ms;
+
+				// after Tick, so new timers go straight onto the active queue relative to the current time
+				ProcessCommands();
+
+				// the shard sleeps most of the time, without this it would look busy and stalled
+				if (record)
+				{
+					record->AddTasks(fired_count_);
+					record->MarkIdle();
+				}
+				fired_count_ = 0;
+				std::this_thread::sleep_for(std::chrono::milliseconds(tick_ms_));
+			}
+			return 0;
+		}
+
+		void Stop() override
+		{
+			stopping_.store(true, std::memory_order_relaxed);
+		}
+
+	private:
+		void ProcessCommands()
+		{
+			TimerCommand command;
+			while (commands_.Dequeue(command))
+			{
+				switch (command.type)
+				{
+				case ECommandType::SET:
+					SetTimer(command);
+					break;
+
+				case ECommandType::CLEAR:
+					ClearTimer(command.timer_id);
+					break;
+				}
+			}
+		}
+
+		void SetTimer(TimerCommand& command)
+		{
+			TimerEntry& entry = timers_[command.timer_id];
+			entry.executor = command.executor;
+			entry.loop = command.loop;
+			if (entry.executor && entry.loop)
+			{
+				entry.shared_cb = std::make_shared<TimerCallback>(std::move(command.timer_cb));
+			}
+			else
+			{
+				entry.timer_cb = std::move(command.timer_cb);
+			}
+
+			const uint64_t timer_id = command.timer_id;
+			timer_manager_.SetTimer(entry.timer_handle, [this, timer_id]() { Fire(timer_id); },
+				command.rate_ms, command.loop, command.first_delay_ms);
+		}
+
+		void ClearTimer(uint64_t timer_id)
+		{
+			auto it = timers_.find(timer_id);
+			if (it == timers_.end())
+			{
+				// already fired, or cleared twice
+				return;
+			}
+			timer_manager_.ClearTimer(it->second.timer_handle);
+			timers_.erase(it);
+		}
+
+		void Fire(uint64_t timer_id)
+		{
+			auto it = timers_.find(timer_id);
+			if (it == timers_.end())
+			{
+				return;
+			}
+
+			++fired_count_;
+			TimerEntry& entry = it->second;
+			if (entry.loop)
+			{
+				if (entry.executor)
+				{
+					if (*entry.shared_cb)
+					{
+						std::shared_ptr<TimerCallback> shared_cb = entry.shared_cb;
+						entry.executor->Post([shared_cb]() { (*shared_cb)(); });
+					}
+				}
+				else if (entry.timer_cb)
+				{
+					entry.timer_cb();
+				}
+				return;
+			}
+
+			// one shot, ScheduleTimer releases its side once this returns
+			TimerCallback timer_cb = std::move(entry.timer_cb);
+			ITimerExecutor* executor = entry.executor;
+			timers_.erase(it);
+			if (!timer_cb)
+			{
+				return;
+			}
+			if (executor)
+			{
+				executor->Post(std::move(timer_cb));
+			}
+			else
+			{
+				timer_cb();
+			}
+		}
+	};
+}
+
+size_t TimerCallbackQueue::Drain()
+{
+	size_t count = 0;
+	TimerCallback timer_cb;
+	while (callbacks_.Dequeue(timer_cb))
+	{
+		if (timer_cb)
+		{
+			timer_cb();
+			++count;
+		}
+	}
+	return count;
+}
+
+TimerService::TimerService(int shard_count, int tick_ms/* = 1*/)
+{
+	Expects(shard_count > 0 && tick_ms > 0);
+	for (int i = 0; i < shard_count; ++i)
+	{
+		shards_.emplace_back(std::make_unique<TimerShard>(tick_ms));
+	}
+	for (int i = 0; i < shard_count; ++i)
+	{
+		const std::string thread_name = "TimerShard" + std::to_string(i);
+		shard_threads_.emplace_back(RunnableThread::CreateThread(shards_[i].get(), thread_name.c_str()));
+	}
+}
+
+TimerService::~TimerService()
+{
+	// stop and join every thread before the shards they run go away
+	shard_threads_.clear();
+	shards_.clear();
+}
+
+TimerServiceHandle TimerService::SetTimer(TimerCallback&& timer_cb, int rate_ms, bool loop, int first_delay_ms/* = -1*/, ITimerExecutor* executor/* = nullptr*/)
+{
+	TimerServiceHandle handle;
+	if (rate_ms > 0)
+	{
+		handle.timer_id = next_timer_id_.fetch_add(1, std::memory_order_relaxed);
+		GetShard(handle.timer_id).PostSetTimer(handle.timer_id, std::move(timer_cb), rate_ms, loop, first_delay_ms, executor);
+	}
+	return handle;
+}
+
+void TimerService::ClearTimer(TimerServiceHandle& in_out_handle)
+{
+	if (in_out_handle.IsValid())
+	{
+		GetShard(in_out_handle.timer_id).PostClearTimer(in_out_handle.timer_id);
+		in_out_handle.Invalidate();
+	}
+}
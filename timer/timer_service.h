@@ -0,0 +1,85 @@
+#pragma once
+
+#include "schedule_timer.h"
+#include "container/mpsc_queue.h"
+#include "thread/runnable_thread.h"
+
+namespace terra
+{
+	/** Where TimerService runs a callback when it should not run on the shard thread. */
+	class ITimerExecutor
+	{
+	public:
+		virtual ~ITimerExecutor() = default;
+
+		/** Called on a shard thread, must be thread-safe. */
+		virtual void Post(TimerCallback&& timer_cb) = 0;
+	};
+
+	/** Executor which keeps the callbacks until the owning thread drains them, e.g. once per game frame. */
+	class TimerCallbackQueue : public ITimerExecutor
+	{
+	private:
+		TQueue<TimerCallback, EQueueMode::Mpsc> callbacks_;
+
+	public:
+		void Post(TimerCallback&& timer_cb) override
+		{
+			callbacks_.Enqueue(std::move(timer_cb));
+		}
+
+		/** Runs every queued callback on the calling thread, returns how many ran. Empty callbacks are dropped. */
+		size_t Drain();
+	};
+
+	/** Handle of a TimerService timer, usable from any thread. */
+	struct TimerServiceHandle
+	{
+		uint64_t timer_id{ 0 };
+
+		bool IsValid() const { return timer_id != 0; }
+		void Invalidate() { timer_id = 0; }
+
+		bool operator==(const TimerServiceHandle& rhs) const { return timer_id == rhs.timer_id; }
+		bool operator!=(const TimerServiceHandle& rhs) const { return timer_id != rhs.timer_id; }
+	};
+
+	class TimerShard;
+
+	/**
+	* Timer manager which can be fed from any thread, e.g. network handlers scheduling timeouts.
+	*
+	* Timers are spread over shards by id. Every shard is a ScheduleTimer ticked by its own RunnableThread, and other
+	* threads only talk to it through an MPSC TQueue of set/clear commands, so the ScheduleTimer itself stays
+	* single threaded. Commands are applied and timers fire at the shard's tick interval.
+	*
+	* Callbacks run on the shard thread unless an executor is given, then they are posted to it instead.
+	*/
+	class TimerService
+	{
+	private:
+		std::vector<std::unique_ptr<TimerShard>> shards_;
+		std::vector<std::unique_ptr<RunnableThread>> shard_threads_;
+		std::atomic<uint64_t> next_timer_id_{ 1 };
+
+	public:
+		/**
+		* @param shard_count Number of shard threads.
+		* @param tick_ms How often a shard applies commands and ticks its timers.
+		*/
+		explicit TimerService(int shard_count, int tick_ms = 1);
+		~TimerService();
+		DISABLE_COPY(TimerService)
+
+		/** Same arguments as ScheduleTimer::SetTimer. Returns an invalid handle when rate_ms is not positive. */
+		TimerServiceHandle SetTimer(TimerCallback&& timer_cb, int rate_ms, bool loop, int first_delay_ms = -1, ITimerExecutor* executor = nullptr);
+
+		/** The timer may still fire if its shard already started executing it. */
+		void ClearTimer(TimerServiceHandle& in_out_handle);
+
+		int GetShardCount() const { return static_cast<int>(shards_.size()); }
+
+	private:
+		TimerShard& GetShard(uint64_t timer_id) { return *shards_[timer_id % shards_.size()]; }
+	};
+}
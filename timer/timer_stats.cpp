@@ -0,0 +1,58 @@
+#include "timer_stats.h"
+
+using namespace terra;
+
+int64_t TimerHistogram::GetPercentile(double p) const
+{
+	if (count == 0)
+	{
+		return 0;
+	}
+	const uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(p * count + 0.5), 1);
+	uint64_t seen = 0;
+	for (int bucket = 0; bucket < kBucketCount; ++bucket)
+	{
+		seen += buckets[bucket];
+		if (seen >= rank)
+		{
+			const int64_t upper_bound = bucket == 0 ? 0 : (static_cast<int64_t>(1) << bucket) - 1;
+			return std::min(upper_bound, max);
+		}
+	}
+	return max;
+}
+
+TimerSiteStats* TimerStats::FindOrAddSite(const std::type_info& callback_type)
+{
+	std::unique_ptr<TimerSiteStats>& site = sites_[&callback_type];
+	if (!site)
+	{
+		site = std::make_unique<TimerSiteStats>();
+		site->name = callback_type.name();
+	}
+	return site.get();
+}
+
+void TimerStats::GetSnapshot(TimerStatsSnapshot& out_snapshot) const
+{
+	out_snapshot.sites.clear();
+	out_snapshot.sites.reserve(sites_.size());
+	for (const auto& site : sites_)
+	{
+		out_snapshot.sites.push_back(*site.second);
+	}
+	std::sort(out_snapshot.sites.begin(), out_snapshot.sites.end(), [](const TimerSiteStats& lhs, const TimerSiteStats& rhs) {
+		return lhs.exec_time_ns.sum > rhs.exec_time_ns.sum;
+	});
+}
+
+void TimerStats::Reset()
+{
+	// keep the sites, live timers point at them
+	for (auto& site : sites_)
+	{
+		const char* name = site.second->name;
+		*site.second = TimerSiteStats();
+		site.second->name = name;
+	}
+}
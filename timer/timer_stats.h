@@ -0,0 +1,115 @@
+#pragma once
+
+#include "core.h"
+#include <typeinfo>
+
+// Define ENABLE_TIMER_STATS (CMake option CETUS_TIMER_STATS) to have ScheduleTimer and ScheduleTimerLite record
+// per callback site execution time, lateness and catch-up histograms. Without it the stats calls compile to nothing
+// and snapshots are empty.
+
+namespace terra
+{
+	/**
+	* Histogram with fixed power of two buckets: bucket 0 counts values <= 0, bucket i counts [2^(i-1), 2^i).
+	* Adding a value is a few instructions, percentiles are accurate to the bucket (a factor of two).
+	*/
+	struct TimerHistogram
+	{
+		static constexpr int kBucketCount = 40;
+
+		uint64_t buckets[kBucketCount]{};
+		uint64_t count{ 0 };
+		int64_t sum{ 0 };
+		int64_t max{ 0 };
+
+		void Add(int64_t value)
+		{
+			const uint32_t bucket = value > 0 ? std::min<uint32_t>(FloorLog2_64(static_cast<uint64_t>(value)) + 1, kBucketCount - 1) : 0;
+			++buckets[bucket];
+			++count;
+			sum += value;
+			max = std::max(max, value);
+		}
+
+		/** Upper bound of the bucket holding the p-th fraction of the values, clamped to max. */
+		int64_t GetPercentile(double p) const;
+		double GetMean() const { return count > 0 ? static_cast<double>(sum) / count : 0.0; }
+	};
+
+	/**
+	* Everything recorded for the timers set with one callback type, i.e. one lambda in the source.
+	*
+	* Sites are told apart by the type of the callable only. Callbacks passed as a std::function, a plain function
+	* pointer or a std::bind result of the same signature share one type, so all the timers set that way anywhere
+	* in the program end up in one site. Wrap them in a lambda at the call site to give it a site of its own.
+	*/
+	struct TimerSiteStats
+	{
+		/** Mangled name of the callback type */
+		const char* name{ nullptr };
+		uint64_t fire_count{ 0 };
+		/** Time spent in the callback per call, in nanoseconds */
+		TimerHistogram exec_time_ns;
+		/** How late the timer fired, scheduler time minus expire time, in milliseconds */
+		TimerHistogram lateness_ms;
+		/** Extra calls a looping timer needed to catch up with a long tick, once per tick it fired in, 0 when on time */
+		TimerHistogram catch_up_count;
+	};
+
+	struct TimerStatsSnapshot
+	{
+		/** Sorted by total execution time, most expensive first */
+		std::vector<TimerSiteStats> sites;
+	};
+
+	/** Per timer manager stats storage, not thread-safe, lives on the thread of its manager. */
+	class TimerStats
+	{
+	private:
+		std::unordered_map<const std::type_info*, std::unique_ptr<TimerSiteStats>> sites_;
+
+	public:
+		/** Looked up once when a timer is set, the timer keeps the pointer. */
+		TimerSiteStats* FindOrAddSite(const std::type_info& callback_type);
+
+		void GetSnapshot(TimerStatsSnapshot& out_snapshot) const;
+		void Reset();
+	};
+
+#ifdef ENABLE_TIMER_STATS
+	/** Adds the time spent in its scope to a site's execution time histogram. */
+	class TimerExecScope
+	{
+	private:
+		TimerSiteStats* const site_stats_;
+		const std::chrono::steady_clock::time_point start_time_;
+
+	public:
+		explicit TimerExecScope(TimerSiteStats* site_stats)
+			: site_stats_(site_stats)
+			, start_time_(std::chrono::steady_clock::now())
+		{
+		}
+		~TimerExecScope()
+		{
+			if (site_stats_)
+			{
+				++site_stats_->fire_count;
+				site_stats_->exec_time_ns.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time_).count());
+			}
+		}
+		DISABLE_COPY(TimerExecScope)
+	};
+#endif
+}
+
+#ifdef ENABLE_TIMER_STATS
+#define TIMER_STATS_BIND_SITE(stats, timer) ((timer).site_stats = (stats).FindOrAddSite((timer).timer_cb.target_type()))
+#define TIMER_STATS_SCOPE_EXEC(site_stats) ::terra::TimerExecScope timer_exec_scope(site_stats)
+#define TIMER_STATS_ADD(site_stats, histogram, value) \
+	do { if (site_stats) { (site_stats)->histogram.Add(value); } } while (0)
+#else
+#define TIMER_STATS_BIND_SITE(stats, timer) ((void)0)
+#define TIMER_STATS_SCOPE_EXEC(site_stats) ((void)0)
+#define TIMER_STATS_ADD(site_stats, histogram, value) ((void)0)
+#endif
@@ -0,0 +1,162 @@
+#include "timing_wheel.h"
+
+using namespace terra;
+
+constexpr int64_t TimingWheel::kMaxDelta;
+
+void TimingWheel::Push(IdType id, int64_t expire_time)
+{
+	Expects(!Contains(id));
+	if (id >= locations_.size())
+	{
+		locations_.resize(static_cast<size_t>(id) + 1, Location{ INDEX_NONE, INDEX_NONE });
+	}
+	++size_;
+	Insert(Entry{ expire_time, id });
+}
+
+void TimingWheel::Insert(const Entry& entry)
+{
+	// already due timers go to the slot which is processed next
+	int64_t expire_time = std::max(entry.expire_time, current_);
+	const int64_t delta = std::min(expire_time - current_, kMaxDelta);
+	expire_time = current_ + delta;
+
+	int bucket = static_cast<int>(expire_time & kNearMask);
+	if (delta >= kNearSize)
+	{
+		int level = 0;
+		int shift = kNearBits;
+		for (; level < kFarLevels - 1; ++level, shift += kFarBits)
+		{
+			if (delta < (static_cast<int64_t>(1) << (shift + kFarBits)))
+			{
+				break;
+			}
+		}
+		bucket = kNearSize + level * kFarSize + static_cast<int>((expire_time >> shift) & kFarMask);
+	}
+	else
+	{
+		++near_size_;
+	}
+
+	buckets_[bucket].push_back(entry);
+	SetLocation(entry.id, bucket, buckets_[bucket].size() - 1);
+}
+
+bool TimingWheel::Remove(IdType id)
+{
+	if (!Contains(id))
+	{
+		return false;
+	}
+	const Location location = locations_[id];
+	locations_[id] = Location{ INDEX_NONE, INDEX_NONE };
+
+	Bucket& bucket = buckets_[location.bucket];
+	if (static_cast<size_t>(location.index) + 1 != bucket.size())
+	{
+		bucket[location.index] = bucket.back();
+		SetLocation(bucket[location.index].id, location.bucket, location.index);
+	}
+	bucket.pop_back();
+
+	--size_;
+	if (location.bucket < kNearSize)
+	{
+		--near_size_;
+	}
+	return true;
+}
+
+bool TimingWheel::PopExpired(int64_t now, IdType& out_id)
+{
+	Bucket& ready = buckets_[kReadyBucket];
+	while (ready.empty())
+	{
+		if (current_ >= now)
+		{
+			return false;
+		}
+		if (size_ == 0)
+		{
+			current_ = now;
+			return false;
+		}
+
+		const int slot = static_cast<int>(current_ & kNearMask);
+		if (slot == 0)
+		{
+			Cascade();
+		}
+		if (near_size_ == 0)
+		{
+			// Nothing on the near wheel, skip ahead to the next cascade point
+			current_ = std::min((current_ | kNearMask) + 1, now);
+			continue;
+		}
+
+		++current_;
+		Bucket& bucket = buckets_[slot];
+		if (!bucket.empty())
+		{
+			// copy rather than swap, so every bucket keeps its own capacity and the wheel stops allocating once warm
+			ready.assign(bucket.begin(), bucket.end());
+			bucket.clear();
+			near_size_ -= ready.size();
+			for (size_t i = 0; i < ready.size(); ++i)
+			{
+				SetLocation(ready[i].id, kReadyBucket, i);
+			}
+		}
+	}
+
+	out_id = ready.back().id;
+	ready.pop_back();
+	locations_[out_id] = Location{ INDEX_NONE, INDEX_NONE };
+	--size_;
+	return true;
+}
+
+void TimingWheel::Clear()
+{
+	for (auto& bucket : buckets_)
+	{
+		for (const auto& e : bucket)
+		{
+			locations_[e.id] = Location{ INDEX_NONE, INDEX_NONE };
+		}
+		bucket.clear();
+	}
+	size_ = 0;
+	near_size_ = 0;
+}
+
+void TimingWheel::Cascade()
+{
+	int shift = kNearBits;
+	for (int level = 0; level < kFarLevels; ++level, shift += kFarBits)
+	{
+		const int slot = static_cast<int>((current_ >> shift) & kFarMask);
+		Bucket& bucket = buckets_[kNearSize + level * kFarSize + slot];
+		cascade_.assign(bucket.begin(), bucket.end());
+		bucket.clear();
+		for (const auto& e : cascade_)
+		{
+			Insert(e);
+		}
+		cascade_.clear();
+
+		// Only roll the next wheel when this one wrapped around
+		if (slot != 0)
+		{
+			break;
+		}
+	}
+}
+
+void TimingWheel::SetLocation(IdType id, int bucket, size_t index)
+{
+	locations_[id] = Location{ bucket, static_cast<int32_t>(index) };
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "core.h"
+
+namespace terra
+{
+	/**
+	* Hierarchical timing wheel of timer ids, not thread-safe.
+	*
+	* Timers are hashed by expire time into a 256 slot near wheel (1ms per slot) and four 64 slot far wheels,
+	* covering 2^32 ms. Far slots are cascaded down when the near wheel wraps, so insert, cancel and expiry are
+	* all O(1) amortized. Timers farther away than the wheel span are parked in the outermost wheel and
+	* re-hashed on every cascade until they come into range.
+	*
+	* Ids are small dense integers owned by the caller (ScheduleTimer slot indices), the wheel only keeps
+	* where each id currently sits. A timer is due once the wheel time is strictly greater than its expire time,
+	* same as the heap in ScheduleTimer.
+	*/
+	class TimingWheel
+	{
+	public:
+		using IdType = uint32_t;
+
+	private:
+		static constexpr int kNearBits = 8;
+		static constexpr int kFarBits = 6;
+		static constexpr int kFarLevels = 4;
+		static constexpr int kNearSize = 1 << kNearBits;
+		static constexpr int kFarSize = 1 << kFarBits;
+		static constexpr int64_t kNearMask = kNearSize - 1;
+		static constexpr int64_t kFarMask = kFarSize - 1;
+		static constexpr int64_t kMaxDelta = (static_cast<int64_t>(1) << (kNearBits + kFarLevels * kFarBits)) - 1;
+		/** Bucket used for timers which have been taken off the near wheel and wait to be popped. */
+		static constexpr int kReadyBucket = kNearSize + kFarLevels * kFarSize;
+		static constexpr int kBucketCount = kReadyBucket + 1;
+
+		struct Entry
+		{
+			int64_t expire_time;
+			IdType id;
+		};
+		using Bucket = std::vector<Entry>;
+
+		struct Location
+		{
+			int32_t bucket;
+			int32_t index;
+		};
+
+		/** near wheel first, then the far wheels level by level, then the ready bucket */
+		Bucket buckets_[kBucketCount];
+		/** Scratch bucket reused by Cascade() so re-hashing does not allocate */
+		Bucket cascade_;
+		/** Where each id sits, bucket is INDEX_NONE when the id is not in the wheel */
+		std::vector<Location> locations_;
+
+		/** The earliest expire time which has not been processed yet */
+		int64_t current_{ 0 };
+		size_t size_{ 0 };
+		size_t near_size_{ 0 };
+
+	public:
+		TimingWheel() = default;
+		DISABLE_COPY(TimingWheel)
+
+		void Push(IdType id, int64_t expire_time);
+		bool Remove(IdType id);
+		bool Contains(IdType id) const { return id < locations_.size() && locations_[id].bucket != INDEX_NONE; }
+
+		/** Pops one timer whose expire time is less than now, advancing the wheel as needed. */
+		bool PopExpired(int64_t now, IdType& out_id);
+
+		size_t Size() const { return size_; }
+		bool IsEmpty() const { return size_ == 0; }
+		void Clear();
+
+		template<typename Fn>
+		void ForEach(Fn&& fn) const
+		{
+			for (const auto& bucket : buckets_)
+			{
+				for (const auto& e : bucket)
+				{
+					fn(e.id);
+				}
+			}
+		}
+
+	private:
+		void Insert(const Entry& entry);
+		void Cascade();
+		void SetLocation(IdType id, int bucket, size_t index);
+	};
+}
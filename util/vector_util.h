@@ -123,7 +123,22 @@ namespace terra
 
 		static void HeapRemoveAt(T& vec, DiffType pos)
 		{
-			heap::PopHeapHoleByIndex(vec.begin(), pos, vec.end() - vec.begin(), vec.back());
+			HeapRemoveAt(vec, pos, std::less<>());
+		}
+
+		template<typename Pred>
+		static void HeapRemoveAt(T& vec, DiffType pos, const Pred& pred)
+		{
+			ValueType val = std::move(vec.back());
+			vec.pop_back();
+			const DiffType bottom = static_cast<DiffType>(vec.size());
+			if (pos < bottom)
+			{
+				// fill the hole from below, then let whatever ended up at pos bubble up past it if needed
+				heap::PopHeapHoleByIndex(vec.begin(), pos, bottom, std::move(val), pred);
+				ValueType hole_val = std::move(vec[pos]);
+				heap::PushHeapByIndex(vec.begin(), pos, DiffType(0), std::move(hole_val), pred);
+			}
 		}
 
 		static ValueType& HeadTop(T& vec) { return vec.front(); }